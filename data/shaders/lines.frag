@@ -0,0 +1,19 @@
+#version 460 core
+
+noperspective in vec2 local;
+flat in float half_length;
+flat in float half_width;
+flat in vec4 color;
+
+out vec4 out_color;
+
+void main() {
+    // Distance in pixels from the edge of a capsule around the segment, which rounds the caps and, where segments
+    // meet, the joins
+    const float distance = length(vec2(max(abs(local.x) - half_length, 0.0f), local.y)) - half_width;
+    const float coverage = clamp(0.5f - distance, 0.0f, 1.0f);
+    if (coverage <= 0.0f) {
+        discard;
+    }
+    out_color = vec4(color.rgb, color.a * coverage);
+}
@@ -0,0 +1,85 @@
+#version 460 core
+
+// Must match `LineSegment`. Colours are RGBA8 with red in the lowest byte.
+struct Segment {
+    vec3 a;
+    float width;
+    vec3 b;
+    uint color;
+};
+
+// Must match `GPULineStyle` in lines.cpp
+struct Style {
+    float width_scale;
+    float opacity;
+    uint first;
+    uint count;
+};
+
+layout (std430, binding = 0) readonly buffer Segments {
+    Segment segments[];
+};
+
+layout (std430, binding = 1) readonly buffer Styles {
+    Style styles[];
+};
+
+layout (std140) uniform ViewProjection {
+    mat4 vp;
+};
+
+// Size of the render target in pixels
+uniform vec2 viewport;
+
+// Pixels along and across the segment from its middle
+noperspective out vec2 local;
+flat out float half_length;
+flat out float half_width;
+flat out vec4 color;
+
+// Lines float just above the surface, so that they aren't cut by the planet mesh between its vertices.
+const float line_radius = 1.0002f;
+const int style_count = 3;
+
+void main() {
+    const Segment segment = segments[gl_BaseInstance + gl_InstanceID];
+
+    // Each class is drawn from its own range of instances.
+    Style style = styles[0];
+    for (int i = 1; i < style_count; ++i) {
+        if (styles[i].count > 0u && styles[i].first == uint(gl_BaseInstance)) {
+            style = styles[i];
+        }
+    }
+
+    color = unpackUnorm4x8(segment.color);
+    color.a *= style.opacity;
+    half_width = 0.5f * segment.width * style.width_scale;
+
+    const vec4 clip_a = vp * vec4(segment.a * line_radius, 1.0f);
+    const vec4 clip_b = vp * vec4(segment.b * line_radius, 1.0f);
+    // Behind the camera. All four corners end up in the same place, so nothing is drawn.
+    if (clip_a.w <= 1e-6f || clip_b.w <= 1e-6f) {
+        gl_Position = vec4(0.0f, 0.0f, 2.0f, 1.0f);
+        return;
+    }
+
+    const vec2 screen_a = (clip_a.xy / clip_a.w * 0.5f + 0.5f) * viewport;
+    const vec2 screen_b = (clip_b.xy / clip_b.w * 0.5f + 0.5f) * viewport;
+    const float screen_length = length(screen_b - screen_a);
+    const vec2 along = screen_length > 1e-4f ? (screen_b - screen_a) / screen_length : vec2(1.0f, 0.0f);
+    const vec2 across = vec2(-along.y, along.x);
+    half_length = 0.5f * screen_length;
+
+    // Triangle strip over the corners (-1, -1), (1, -1), (-1, 1), (1, 1), pushed out past the ends by the width of the
+    // caps and past everything by a pixel for anti-aliasing
+    const vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0f - 1.0f;
+    const float margin = half_width + 1.0f;
+    local = vec2(corner.x * (half_length + margin), corner.y * margin);
+    const vec2 screen = 0.5f * (screen_a + screen_b) + along * local.x + across * local.y;
+
+    // Depth follows the segment, and stays at the endpoint's past either end.
+    const float t = clamp(0.5f + local.x / max(screen_length, 1e-4f), 0.0f, 1.0f);
+    const vec4 clip = mix(clip_a, clip_b, t);
+    gl_Position = vec4((screen / viewport * 2.0f - 1.0f) * clip.w, clip.z, clip.w);
+}
@@ -1,9 +1,95 @@
 #version 460 core
 
 in vec3 vert_pos;
+in vec3 vert_edges;
 
 out vec4 out_color;
 
+// Borders drawn in this pass rather than as lines over it
+uniform bool borders_enabled;
+// In pixels, across both provinces
+uniform float border_width;
+
+uniform bool terrain_enabled;
+uniform bool terrain_colour;
+// Converts heights in metres to planet radii, with exaggeration
+uniform float terrain_height_scale;
+uniform sampler2DArray terrain_tiles;
+// Layer and level of the finest loaded tile, for each cube face
+uniform usampler2DArray terrain_indirection;
+
+const uint no_layer = 0xFFFFu;
+
+// Cube faces as (normal, right, up). Must match terrain.cpp.
+const vec3 face_axes[18] = vec3[](
+    vec3(1, 0, 0), vec3(0, 0, -1), vec3(0, 1, 0),
+    vec3(-1, 0, 0), vec3(0, 0, 1), vec3(0, 1, 0),
+    vec3(0, 1, 0), vec3(1, 0, 0), vec3(0, 0, -1),
+    vec3(0, -1, 0), vec3(1, 0, 0), vec3(0, 0, 1),
+    vec3(0, 0, 1), vec3(1, 0, 0), vec3(0, 1, 0),
+    vec3(0, 0, -1), vec3(-1, 0, 0), vec3(0, 1, 0)
+);
+
+vec3 apply_terrain(vec3 color) {
+    const vec3 p = normalize(vert_pos);
+    const vec3 a = abs(p);
+    const int face = a.x >= a.y && a.x >= a.z ? (p.x > 0.0f ? 0 : 1)
+                   : a.y >= a.z               ? (p.y > 0.0f ? 2 : 3)
+                                              : (p.z > 0.0f ? 4 : 5);
+    const vec3 normal = face_axes[face * 3];
+    const vec3 right = face_axes[face * 3 + 1];
+    const vec3 up = face_axes[face * 3 + 2];
+    const vec2 st = clamp(vec2(dot(p, right), dot(p, up)) / dot(p, normal) * 0.5f + 0.5f, 0.0f, 1.0f);
+
+    const int size = textureSize(terrain_indirection, 0).x;
+    const ivec2 texel = min(ivec2(st * size), size - 1);
+    const uvec2 entry = texelFetch(terrain_indirection, ivec3(texel, face), 0).rg;
+    if (entry.x == no_layer) {
+        return color;
+    }
+
+    // Position within the tile. Samples are at the tile's edges and spaced evenly between them.
+    const int level = int(entry.y);
+    const float tiles = float(1 << level);
+    const vec2 local = st * tiles - vec2(texel >> (findMSB(size) - level));
+    const float n = float(textureSize(terrain_tiles, 0).x);
+    const vec3 uv = vec3((local * (n - 1.0f) + 0.5f) / n, float(entry.x));
+
+    if (terrain_colour) {
+        const vec4 terrain = texture(terrain_tiles, uv);
+        return mix(color, terrain.rgb, terrain.a);
+    }
+
+    // Slope from the neighbouring samples. Their spacing on the face is close to their angle on the sphere.
+    const float west = textureOffset(terrain_tiles, uv, ivec2(-1, 0)).r;
+    const float east = textureOffset(terrain_tiles, uv, ivec2(1, 0)).r;
+    const float south = textureOffset(terrain_tiles, uv, ivec2(0, -1)).r;
+    const float north = textureOffset(terrain_tiles, uv, ivec2(0, 1)).r;
+    const float spacing = 2.0f / (tiles * (n - 1.0f));
+    const vec2 slope = vec2(east - west, north - south) * terrain_height_scale / (2.0f * spacing);
+    const vec3 surface_normal = normalize(p - slope.x * right - slope.y * up);
+
+    // Lit from the north west, 45 degrees above the horizon, as is usual for hillshading
+    const vec3 to_pole = vec3(0.0f, 1.0f, 0.0f) - p.y * p;
+    const vec3 geo_north = dot(to_pole, to_pole) > 1e-8f ? normalize(to_pole) : up;
+    const vec3 geo_east = cross(geo_north, p);
+    const vec3 light = normalize(normalize(geo_north - geo_east) + p);
+    const float shade = max(dot(surface_normal, light), 0.0f) / dot(p, light);
+
+    return color * clamp(shade, 0.0f, 1.5f);
+}
+
 void main() {
-    out_color = vec4((vert_pos + 1) / 2.0f, 1.0f);
+    vec3 color = (vert_pos + 1) / 2.0f;
+    if (terrain_enabled) {
+        color = apply_terrain(color);
+    }
+    if (borders_enabled) {
+        // Distance in pixels to the nearest border edge. Each province draws half the border's width on its side.
+        const vec3 pixels = vert_edges / max(fwidth(vert_edges), vec3(1e-6f));
+        const float distance = min(min(pixels.x, pixels.y), pixels.z);
+        const float coverage = 1.0f - smoothstep(0.5f * border_width - 0.5f, 0.5f * border_width + 0.5f, distance);
+        color = mix(color, vec3(0.0f), coverage);
+    }
+    out_color = vec4(color, 1.0f);
 }
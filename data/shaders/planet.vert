@@ -1,14 +1,105 @@
 #version 460 core
 
 layout (location = 0) in vec3 pos;
+// 1 if the vertex is on the east side of the antimeridian, -1 if it's on the west side, 0 if it's away from it.
+// Primitives that cross the antimeridian are stored twice, flagged east and west, and each copy is clipped at the
+// edge of a flat map.
+layout (location = 1) in float wrap;
+// Barycentric coordinates, except that the coordinate for an edge that isn't a province border is 1 everywhere
+layout (location = 2) in vec3 edges;
 
 out vec3 vert_pos;
+out vec3 vert_edges;
+out float gl_ClipDistance[2];
 
 layout (std140) uniform ViewProjection {
     mat4 vp;
 };
 
+// Projections as in `MapProjection`. The position is blended from one to the other.
+uniform int projection_from;
+uniform int projection_to;
+uniform float projection_blend;
+
+const int projection_globe = 0;
+const int projection_equirectangular = 1;
+const int projection_mollweide = 2;
+const int projection_robinson = 3;
+
+const float pi = 3.14159265f;
+
+// Flat maps are drawn on the z = 0 plane, facing the camera's starting position, and scaled so that the
+// equirectangular map is four units wide.
+const float map_scale = 2.0f / pi;
+
+// Robinson's table, every 5 degrees of latitude
+const float robinson_x[19] = float[](1.0000f, 0.9986f, 0.9954f, 0.9900f, 0.9822f, 0.9730f, 0.9600f, 0.9427f,
+                                     0.9216f, 0.8962f, 0.8679f, 0.8350f, 0.7986f, 0.7597f, 0.7186f, 0.6732f,
+                                     0.6213f, 0.5722f, 0.5322f);
+const float robinson_y[19] = float[](0.0000f, 0.0620f, 0.1240f, 0.1860f, 0.2480f, 0.3100f, 0.3720f, 0.4340f,
+                                     0.4958f, 0.5571f, 0.6176f, 0.6769f, 0.7346f, 0.7903f, 0.8435f, 0.8936f,
+                                     0.9394f, 0.9761f, 1.0000f);
+
+vec2 mollweide(const float lon, const float lat) {
+    // Solve 2 theta + sin(2 theta) = pi sin(lat) by Newton's method
+    float theta = lat;
+    for (int i = 0; i < 8; ++i) {
+        const float derivative = 2.0f + 2.0f * cos(2.0f * theta);
+        if (derivative < 1e-6f) {
+            break;
+        }
+        theta -= (2.0f * theta + sin(2.0f * theta) - pi * sin(lat)) / derivative;
+    }
+    return vec2(2.0f * sqrt(2.0f) / pi * lon * cos(theta), sqrt(2.0f) * sin(theta));
+}
+
+vec2 robinson(const float lon, const float lat) {
+    const float row = clamp(abs(degrees(lat)) / 5.0f, 0.0f, 18.0f);
+    const int i = min(int(row), 17);
+    const float t = row - float(i);
+    const float x = mix(robinson_x[i], robinson_x[i + 1], t);
+    const float y = mix(robinson_y[i], robinson_y[i + 1], t);
+    return vec2(0.8487f * x * lon, 1.3523f * y * sign(lat));
+}
+
+vec3 project(const int projection, const float lon, const float lat) {
+    vec2 map;
+    switch (projection) {
+    case projection_equirectangular:
+        map = vec2(lon, lat);
+        break;
+    case projection_mollweide:
+        map = mollweide(lon, lat);
+        break;
+    case projection_robinson:
+        map = robinson(lon, lat);
+        break;
+    default:
+        return pos;
+    }
+    return vec3(map * map_scale, 0.0f);
+}
+
 void main() {
     vert_pos = pos;
-    gl_Position = vp * vec4(pos, 1.0f);
+    vert_edges = edges;
+
+    // The inverse of `lon_lat_to_sphere`
+    float lon = pi - atan(pos.z, pos.x);
+    if (lon > pi) {
+        lon -= 2.0f * pi;
+    }
+    const float lat = asin(clamp(pos.y, -1.0f, 1.0f));
+
+    if (wrap > 0.0f && lon < 0.0f) {
+        lon += 2.0f * pi;
+    } else if (wrap < 0.0f && lon > 0.0f) {
+        lon -= 2.0f * pi;
+    }
+    gl_ClipDistance[0] = pi - lon;
+    gl_ClipDistance[1] = pi + lon;
+
+    const vec3 from = project(projection_from, lon, lat);
+    const vec3 to = project(projection_to, lon, lat);
+    gl_Position = vp * vec4(mix(from, to, projection_blend), 1.0f);
 }
@@ -0,0 +1,23 @@
+#version 460 core
+
+in vec2 uv;
+in float alpha;
+
+out vec4 out_color;
+
+uniform sampler2D atlas;
+
+void main() {
+    // The atlas stores distance to the outline, with the edge at 0.5. Anti-aliasing over one screen pixel keeps edges
+    // sharp at any scale.
+    const float distance = texture(atlas, uv).r;
+    const float width = fwidth(distance);
+
+    const float fill = smoothstep(0.5f - width, 0.5f + width, distance);
+    const float halo = smoothstep(0.3f - width, 0.3f + width, distance);
+    if (halo <= 0.0f) {
+        discard;
+    }
+
+    out_color = vec4(vec3(fill), halo * alpha);
+}
@@ -0,0 +1,24 @@
+#version 460 core
+
+layout (location = 0) in vec3 center;
+layout (location = 1) in vec3 right;
+layout (location = 2) in vec3 up;
+layout (location = 3) in vec4 uv_rect;
+layout (location = 4) in float opacity;
+
+out vec2 uv;
+out float alpha;
+
+layout (std140) uniform ViewProjection {
+    mat4 vp;
+};
+
+void main() {
+    // Triangle strip over the corners (-1, -1), (1, -1), (-1, 1), (1, 1)
+    const vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    uv = mix(uv_rect.xy, uv_rect.zw, corner);
+    alpha = opacity;
+
+    const vec2 offset = corner * 2.0f - 1.0f;
+    gl_Position = vp * vec4(center + offset.x * right + offset.y * up, 1.0f);
+}
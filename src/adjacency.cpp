@@ -0,0 +1,371 @@
+#include "adjacency.hpp"
+
+#include <chrono>
+#include <mutex>
+
+namespace {
+
+constexpr u32 adjacency_cache_kind = make_cache_kind("ADJC");
+constexpr u32 adjacency_cache_version = 1;
+
+struct Segment {
+    glm::dvec2 a;
+    glm::dvec2 b;
+    ProvinceId province;
+};
+
+struct CellRange {
+    i64 x0, y0, x1, y1;
+};
+
+struct Edge {
+    ProvinceId from;
+    ProvinceId to;
+    f64 length;
+};
+
+u64 pair_key(const ProvinceId a, const ProvinceId b) {
+    return u64(a) << 32 | b;
+}
+
+u64 cell_key(const i64 x, const i64 y) {
+    return u64(static_cast<u32>(x)) << 32 | static_cast<u32>(y);
+}
+
+i64 cell_coord(const f64 value, const f64 cell_size) {
+    return static_cast<i64>(std::floor(value / cell_size));
+}
+
+CellRange get_cells(const Segment& s, const f64 tolerance, const f64 cell_size) {
+    return {
+            cell_coord(std::min(s.a.x, s.b.x) - tolerance, cell_size),
+            cell_coord(std::min(s.a.y, s.b.y) - tolerance, cell_size),
+            cell_coord(std::max(s.a.x, s.b.x) + tolerance, cell_size),
+            cell_coord(std::max(s.a.y, s.b.y) + tolerance, cell_size),
+    };
+}
+
+// Length of the part of `s` that lies within `tolerance` of `t`, as an angle on the unit sphere.
+f64 shared_length(const Segment& s, const Segment& t, const f64 tolerance) {
+    const glm::dvec2 d = s.b - s.a;
+    const f64 length_sq = glm::dot(d, d);
+
+    const f64 u0 = glm::dot(t.a - s.a, d) / length_sq;
+    const f64 u1 = glm::dot(t.b - s.a, d) / length_sq;
+    const f64 lo = std::max(0.0, std::min(u0, u1));
+    const f64 hi = std::min(1.0, std::max(u0, u1));
+    if (hi <= lo) {
+        return 0.0;
+    }
+
+    // The distance from the line through `s` is linear along `t`, so it's enough to check the points of `t` at the
+    // ends of the overlapping range.
+    const f64 inv_length = 1.0 / std::sqrt(length_sq);
+    const glm::dvec2 normal = glm::dvec2(-d.y, d.x) * inv_length;
+    for (const f64 u : {lo, hi}) {
+        const glm::dvec2 p = glm::mix(t.a, t.b, (u - u0) / (u1 - u0));
+        if (std::abs(glm::dot(p - s.a, normal)) > tolerance) {
+            return 0.0;
+        }
+    }
+
+    const glm::dvec2 p0 = s.a + d * lo;
+    const glm::dvec2 p1 = s.a + d * hi;
+    return great_circle_distance(lon_lat_to_sphere(p0.x, p0.y), lon_lat_to_sphere(p1.x, p1.y));
+}
+
+u64 get_params(const AdjacencyConfig& config) {
+    u64 result;
+    memcpy(&result, &config.snap_tolerance, sizeof(result));
+    return result;
+}
+} // namespace
+
+ProvinceGraph extract_adjacency(const ProvinceGeometry& geometry, const AdjacencyConfig& config,
+                                ThreadPool& thread_pool) {
+    const auto start_time = std::chrono::steady_clock::now();
+    const f64 tolerance = config.snap_tolerance;
+    const u32 province_count = geometry.province_count();
+
+    ProvinceGraph result;
+    result.centroids.resize(province_count);
+
+    std::vector<Segment> segments;
+    f64 total_length = 0.0;
+
+    for (ProvinceId province = 0; province < province_count; ++province) {
+        glm::dvec3 centroid = {0.0, 0.0, 0.0};
+
+        for (u32 poly = geometry.province_offsets[province]; poly < geometry.province_offsets[province + 1]; ++poly) {
+            for (u32 ring = geometry.polygon_offsets[poly]; ring < geometry.polygon_offsets[poly + 1]; ++ring) {
+                const u32 begin = geometry.ring_offsets[ring];
+                const u32 end = geometry.ring_offsets[ring + 1];
+
+                for (u32 i = begin; i < end; ++i) {
+                    // Rings are usually closed already, in which case the last segment is empty and skipped.
+                    glm::dvec2 a = geometry.points[i];
+                    glm::dvec2 b = geometry.points[i + 1 < end ? i + 1 : begin];
+
+                    const glm::dvec3 a_sphere = lon_lat_to_sphere(a.x, a.y);
+                    const glm::dvec3 b_sphere = lon_lat_to_sphere(b.x, b.y);
+                    centroid += (a_sphere + b_sphere) * great_circle_distance(a_sphere, b_sphere);
+
+                    // Both sides of the antimeridian map to the same points on the sphere. A segment with one end
+                    // snapped across it is wrapped whole, so that it doesn't span the whole map in the spatial hash.
+                    for (glm::dvec2* p : {&a, &b}) {
+                        if (std::abs(p->x) >= 180.0 - tolerance) {
+                            p->x = 180.0;
+                        }
+                    }
+                    if (b.x - a.x > 180.0) {
+                        b.x -= 360.0;
+                    } else if (a.x - b.x > 180.0) {
+                        b.x += 360.0;
+                    }
+                    CHECK_F(std::abs(b.x - a.x) <= 180.0, "Boundary segment wider than 180 degrees in province {}",
+                            province);
+
+                    const glm::dvec2 d = b - a;
+                    if (glm::dot(d, d) <= 0.0) {
+                        continue;
+                    }
+
+                    segments.push_back({a, b, province});
+                    total_length += glm::length(d);
+                }
+            }
+        }
+
+        if (glm::dot(centroid, centroid) > 0.0) {
+            result.centroids[province] = glm::vec3(glm::normalize(centroid));
+        } else {
+            const glm::dvec2 p = geometry.points[geometry.ring_offsets[geometry.polygon_offsets
+                                                                               [geometry.province_offsets[province]]]];
+            result.centroids[province] = glm::vec3(lon_lat_to_sphere(p.x, p.y));
+        }
+    }
+
+    if (segments.empty()) {
+        result.offsets.assign(province_count + 1, 0);
+        return result;
+    }
+
+    // Spatial hash: each segment is put in every cell that its bounding box, grown by the tolerance, touches.
+    const f64 cell_size = std::max(4.0 * tolerance, 2.0 * total_length / static_cast<f64>(segments.size()));
+
+    std::vector<std::pair<u64, u32>> cell_entries;
+    std::mutex mutex;
+
+    thread_pool.parallel_for(segments.size(), [&](const size_t begin, const size_t end) {
+        std::vector<std::pair<u64, u32>> entries;
+        for (size_t i = begin; i < end; ++i) {
+            const CellRange cells = get_cells(segments[i], tolerance, cell_size);
+            for (i64 x = cells.x0; x <= cells.x1; ++x) {
+                for (i64 y = cells.y0; y <= cells.y1; ++y) {
+                    entries.emplace_back(cell_key(x, y), static_cast<u32>(i));
+                }
+            }
+        }
+
+        std::lock_guard lock(mutex);
+        cell_entries.insert(cell_entries.end(), entries.begin(), entries.end());
+    });
+
+    std::sort(cell_entries.begin(), cell_entries.end());
+
+    std::vector<u32> cell_segments(cell_entries.size());
+    std::unordered_map<u64, std::pair<u32, u32>> cells;
+    for (size_t i = 0; i < cell_entries.size(); ++i) {
+        cell_segments[i] = cell_entries[i].second;
+        auto [it, inserted] = cells.try_emplace(cell_entries[i].first, static_cast<u32>(i), static_cast<u32>(i));
+        ++it->second.second;
+    }
+    cell_entries = {};
+
+    // Shared length of each (province of s, province of t) pair, measured along s. Both directions are measured
+    // independently and averaged below.
+    std::vector<std::pair<u64, f64>> pair_lengths;
+
+    thread_pool.parallel_for(segments.size(), [&](const size_t begin, const size_t end) {
+        std::unordered_map<u64, f64> lengths;
+
+        for (size_t i = begin; i < end; ++i) {
+            const Segment& s = segments[i];
+            const CellRange s_cells = get_cells(s, tolerance, cell_size);
+
+            for (i64 x = s_cells.x0; x <= s_cells.x1; ++x) {
+                for (i64 y = s_cells.y0; y <= s_cells.y1; ++y) {
+                    auto it = cells.find(cell_key(x, y));
+                    if (it == cells.end()) {
+                        continue;
+                    }
+
+                    for (u32 j = it->second.first; j < it->second.second; ++j) {
+                        const Segment& t = segments[cell_segments[j]];
+                        if (t.province == s.province) {
+                            continue;
+                        }
+
+                        // Only test each pair in the first cell that both segments share.
+                        const CellRange t_cells = get_cells(t, tolerance, cell_size);
+                        if (x != std::max(s_cells.x0, t_cells.x0) || y != std::max(s_cells.y0, t_cells.y0)) {
+                            continue;
+                        }
+
+                        const f64 length = shared_length(s, t, tolerance);
+                        if (length > 0.0) {
+                            lengths[pair_key(s.province, t.province)] += length;
+                        }
+                    }
+                }
+            }
+        }
+
+        std::lock_guard lock(mutex);
+        pair_lengths.insert(pair_lengths.end(), lengths.begin(), lengths.end());
+    });
+
+    std::sort(pair_lengths.begin(), pair_lengths.end());
+
+    // Reduce the per-chunk sums into one entry per directed pair.
+    {
+        size_t out = 0;
+        for (size_t i = 0; i < pair_lengths.size(); ++i) {
+            if (out > 0 && pair_lengths[out - 1].first == pair_lengths[i].first) {
+                pair_lengths[out - 1].second += pair_lengths[i].second;
+            } else {
+                pair_lengths[out] = pair_lengths[i];
+                ++out;
+            }
+        }
+        pair_lengths.resize(out);
+    }
+
+    auto find_length = [&](const u64 key) {
+        auto it = std::lower_bound(pair_lengths.begin(), pair_lengths.end(), std::make_pair(key, 0.0));
+        return it != pair_lengths.end() && it->first == key ? it->second : -1.0;
+    };
+
+    std::vector<Edge> edges;
+    for (const auto& [key, length] : pair_lengths) {
+        const ProvinceId a = static_cast<ProvinceId>(key >> 32);
+        const ProvinceId b = static_cast<ProvinceId>(key & 0xffffffff);
+        const f64 reverse_length = find_length(pair_key(b, a));
+
+        if (a < b) {
+            const f64 shared = reverse_length >= 0.0 ? (length + reverse_length) / 2.0 : length;
+            edges.push_back({a, b, shared});
+            edges.push_back({b, a, shared});
+        } else if (reverse_length < 0.0) {
+            edges.push_back({a, b, length});
+            edges.push_back({b, a, length});
+        }
+    }
+
+    std::sort(edges.begin(), edges.end(),
+              [](const Edge& lhs, const Edge& rhs) { return pair_key(lhs.from, lhs.to) < pair_key(rhs.from, rhs.to); });
+
+    result.offsets.assign(province_count + 1, 0);
+    result.neighbors.reserve(edges.size());
+    result.border_lengths.reserve(edges.size());
+    for (const Edge& edge : edges) {
+        ++result.offsets[edge.from + 1];
+        result.neighbors.push_back(edge.to);
+        result.border_lengths.push_back(static_cast<f32>(edge.length));
+    }
+    for (u32 i = 0; i < province_count; ++i) {
+        result.offsets[i + 1] += result.offsets[i];
+    }
+
+    const f64 elapsed_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start_time).count();
+    DPRINT("Extracted province adjacency from {} segments in {:.3f} s", segments.size(), elapsed_s);
+
+    return result;
+}
+
+void ProvinceGraph::init(const ProvinceGeometry& geometry, const AdjacencyConfig& config, ThreadPool& thread_pool,
+                         const Path& source_path, const Path& cache_path) {
+    const CacheKey key = make_cache_key(source_path, get_params(config));
+    if (read_cache(cache_path, key) && province_count() == geometry.province_count() && validate()) {
+        DPRINT("Loaded province adjacency from cache");
+    } else {
+        *this = extract_adjacency(geometry, config, thread_pool);
+        CHECK_F(validate(), "Province adjacency graph is not symmetric");
+        write_cache(cache_path, key);
+    }
+
+    DEXPR(edge_count());
+}
+
+bool ProvinceGraph::read_cache(const Path& path, const CacheKey& key) {
+    BinaryReader reader;
+    if (!reader.open(path, adjacency_cache_kind, adjacency_cache_version, key)) {
+        return false;
+    }
+
+    ProvinceGraph result;
+    const bool ok = reader.read_vector(result.offsets) && reader.read_vector(result.neighbors) &&
+                    reader.read_vector(result.border_lengths) && reader.read_vector(result.centroids) &&
+                    reader.at_end();
+    if (!ok) {
+        LOG_F(WARNING, "Ignoring invalid adjacency cache {}", path.string());
+        return false;
+    }
+
+    *this = std::move(result);
+    return true;
+}
+
+void ProvinceGraph::write_cache(const Path& path, const CacheKey& key) const {
+    BinaryWriter writer(path, adjacency_cache_kind, adjacency_cache_version, key);
+    writer.write_vector(offsets);
+    writer.write_vector(neighbors);
+    writer.write_vector(border_lengths);
+    writer.write_vector(centroids);
+    writer.finish();
+}
+
+u32 ProvinceGraph::province_count() const {
+    return static_cast<u32>(offsets.size() - 1);
+}
+
+u32 ProvinceGraph::edge_count() const {
+    return static_cast<u32>(neighbors.size());
+}
+
+i64 ProvinceGraph::find_edge(const ProvinceId a, const ProvinceId b) const {
+    const auto begin = neighbors.begin() + offsets[a];
+    const auto end = neighbors.begin() + offsets[a + 1];
+    const auto it = std::lower_bound(begin, end, b);
+    if (it == end || *it != b) {
+        return -1;
+    }
+    return it - neighbors.begin();
+}
+
+bool ProvinceGraph::validate() const {
+    if (offsets.empty() || offsets.front() != 0 || offsets.back() != neighbors.size() ||
+        border_lengths.size() != neighbors.size() || centroids.size() != province_count()) {
+        return false;
+    }
+
+    for (ProvinceId a = 0; a < province_count(); ++a) {
+        if (offsets[a] > offsets[a + 1]) {
+            return false;
+        }
+
+        for (u32 edge = offsets[a]; edge < offsets[a + 1]; ++edge) {
+            const ProvinceId b = neighbors[edge];
+            if (b >= province_count() || b == a || (edge > offsets[a] && neighbors[edge - 1] >= b)) {
+                return false;
+            }
+
+            const i64 reverse = find_edge(b, a);
+            if (reverse == -1 || std::abs(border_lengths[static_cast<size_t>(reverse)] - border_lengths[edge]) > 0.0f) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "cache.hpp"
+#include "geometry.hpp"
+#include "province.hpp"
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+
+struct AdjacencyConfig {
+    // Border segments closer than this (in degrees) are treated as shared, which closes small gaps and overlaps
+    // between neighbouring polygons.
+    f64 snap_tolerance = 0.001;
+};
+
+// Province adjacency in compressed sparse row form: the neighbours of province `p` are
+// `neighbors[offsets[p]..offsets[p + 1]]`, sorted by ID. The graph is symmetric, and `border_lengths` holds the length
+// of the shared border for each edge as an angle on the unit sphere.
+struct ProvinceGraph {
+    std::vector<u32> offsets = {0};
+    std::vector<ProvinceId> neighbors;
+    std::vector<f32> border_lengths;
+
+    // Border-length-weighted centre of each province on the unit sphere.
+    std::vector<glm::vec3> centroids;
+
+    // Loads the graph from `cache_path` if it was built from the current `source_path` with the same config,
+    // otherwise extracts it from `geometry` and writes a new cache.
+    void init(const ProvinceGeometry& geometry, const AdjacencyConfig& config, ThreadPool& thread_pool,
+              const Path& source_path, const Path& cache_path);
+
+    bool read_cache(const Path& path, const CacheKey& key);
+    void write_cache(const Path& path, const CacheKey& key) const;
+
+    u32 province_count() const;
+    u32 edge_count() const;
+
+    // Returns -1 if `a` and `b` are not adjacent.
+    i64 find_edge(ProvinceId a, ProvinceId b) const;
+
+    // Checks that the offsets are consistent and every edge has a reverse edge of the same length.
+    bool validate() const;
+};
+
+ProvinceGraph extract_adjacency(const ProvinceGeometry& geometry, const AdjacencyConfig& config,
+                                ThreadPool& thread_pool);
@@ -4,6 +4,8 @@
 #include <ogrsf_frmts.h>
 #include <whereami.h>
 
+#include <ctime>
+
 namespace {
 
 constexpr i32 updates_per_s = 60;
@@ -19,53 +21,72 @@ extern "C" void glfw_error_callback(int error_code, const char* description) {
     ABORT_F("GLFW error {:#x}: {}", error_code, description);
 }
 
-extern "C" void glfw_key_callback(GLFWwindow* window, int key, int /* scancode */, int action, int /* mods */) {
-    switch (key) {
-    case GLFW_KEY_ESCAPE: {
+extern "C" void glfw_key_callback(GLFWwindow* window, int key, int /* scancode */, int action, int mods) {
+    // Quitting isn't journaled, so that it can also stop a replay.
+    if (key == GLFW_KEY_ESCAPE) {
         if (action == GLFW_PRESS) {
             glfwSetWindowShouldClose(window, true);
         }
-    } break;
+        return;
+    }
 
-    case GLFW_KEY_W: {
-        if (action == GLFW_PRESS) {
-            app->wireframe_render = !app->wireframe_render;
+    // Nor are quicksaves and quickloads: they write and read files outside the game, so a replay would overwrite the
+    // player's save, and depend on whatever it holds.
+    if (key == GLFW_KEY_F5 || key == GLFW_KEY_F9) {
+        if (action == GLFW_PRESS && !app->replay.is_open()) {
+            const Path path = app->get_save_path("quick.wss");
+            if (key == GLFW_KEY_F5) {
+                app->save_game(path);
+            } else {
+                app->load_game(path);
+            }
         }
-    } break;
+        return;
     }
-}
 
-extern "C" void glfw_cursor_pos_callback(GLFWwindow* window, double xpos, double ypos) {
-    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS) {
-        constexpr f64 factor = 0.001;
-
-        const f64 xrel = xpos - app->cursor_xpos;
-        const f64 yrel = ypos - app->cursor_ypos;
-
-        const f64 x_angle = factor * -xrel;
-        const glm::mat4 x_mat = glm::rotate(glm::mat4(1.0f), static_cast<f32>(x_angle), app->camera_up);
-
-        const f64 y_angle = factor * -yrel;
-        const glm::vec3 right = glm::normalize(glm::cross(app->camera_up, app->camera_pos - app->camera_target));
-        const glm::mat4 y_mat = glm::rotate(glm::mat4(1.0f), static_cast<f32>(y_angle), right);
+    InputEvent event;
+    event.type = InputType::key;
+    event.code = key;
+    event.action = action;
+    event.mods = mods;
+    app->queue_input(std::move(event));
+}
 
-        app->camera_pos = glm::vec3(y_mat * x_mat * glm::vec4(app->camera_pos, 1.0f));
-    }
+extern "C" void glfw_mouse_button_callback(GLFWwindow* /* window */, int button, int action, int mods) {
+    InputEvent event;
+    event.type = InputType::mouse_button;
+    event.code = button;
+    event.action = action;
+    event.mods = mods;
+    app->queue_input(std::move(event));
+}
 
-    app->cursor_xpos = xpos;
-    app->cursor_ypos = ypos;
+extern "C" void glfw_cursor_pos_callback(GLFWwindow* /* window */, double xpos, double ypos) {
+    InputEvent event;
+    event.type = InputType::cursor_pos;
+    event.x = xpos;
+    event.y = ypos;
+    app->queue_input(std::move(event));
 }
 
-extern "C" void glfw_scroll_callback(GLFWwindow* /* window */, double /* xoffset */, double yoffset) {
-    const f64 distance = yoffset * 0.1 * static_cast<f64>(glm::length(app->camera_target - app->camera_pos));
-    const glm::vec3 front = glm::normalize(app->camera_target - app->camera_pos);
-    const glm::mat4 mat = glm::translate(glm::mat4(1.0f), static_cast<f32>(distance) * front);
-    app->camera_pos = glm::vec3(mat * glm::vec4(app->camera_pos, 1.0f));
+extern "C" void glfw_scroll_callback(GLFWwindow* /* window */, double xoffset, double yoffset) {
+    InputEvent event;
+    event.type = InputType::scroll;
+    event.x = xoffset;
+    event.y = yoffset;
+    app->queue_input(std::move(event));
 }
 
 extern "C" void glfw_framebuffer_size_callback(GLFWwindow* /* window */, int width, int height) {
+    // The offscreen framebuffers follow once the size has settled, in `Renderer::update_framebuffers`.
     app->framebuffer_width = width;
     app->framebuffer_height = height;
+    app->view_dirty = true;
+}
+
+extern "C" void glfw_window_refresh_callback(GLFWwindow* /* window */) {
+    // The window was uncovered or its contents were lost.
+    app->view_dirty = true;
 }
 
 f32 srgb_to_linear(const f32 value) {
@@ -79,9 +100,9 @@ f32 srgb_to_linear(const f32 value) {
 
 extern "C" {
 
-void* app_init() {
+void* app_init(int argc, char** argv) {
     App* app = new App();
-    app->init();
+    app->init(argc, argv);
     return app;
 }
 
@@ -102,15 +123,124 @@ void app_load(void* ptr) {
 }
 
 void app_unload(void* ptr) {
-    (void)ptr;
+    App* app = get_app(ptr);
+    app->unload();
 }
 #endif
 }
 
-void App::init() {
+void Options::parse(const int argc, char** const argv) {
+    for (i32 i = 1; i < argc; ++i) {
+        if (c_str_eq(argv[i], "--bench")) {
+            CHECK_F(i + 1 < argc, "Expected a benchmark name after --bench");
+            ++i;
+            benchmarks.emplace_back(argv[i]);
+        } else if (c_str_eq(argv[i], "--seed")) {
+            CHECK_F(i + 1 < argc, "Expected a number after --seed");
+            ++i;
+            seed = std::stoull(argv[i], nullptr, 0);
+        } else if (c_str_eq(argv[i], "--hash-log")) {
+            CHECK_F(i + 1 < argc, "Expected a path after --hash-log");
+            ++i;
+            hash_log_path = argv[i];
+        } else if (c_str_eq(argv[i], "--record")) {
+            CHECK_F(i + 1 < argc, "Expected a path after --record");
+            ++i;
+            record_path = argv[i];
+        } else if (c_str_eq(argv[i], "--replay")) {
+            CHECK_F(i + 1 < argc, "Expected a path after --replay");
+            ++i;
+            replay_path = argv[i];
+        } else if (c_str_eq(argv[i], "--replay-realtime")) {
+            replay_realtime = true;
+        } else if (c_str_eq(argv[i], "--autosave-mode")) {
+            CHECK_F(i + 1 < argc, "Expected fork or thread after --autosave-mode");
+            ++i;
+            if (c_str_eq(argv[i], "fork")) {
+                autosave.mode = AutosaveMode::fork;
+            } else if (c_str_eq(argv[i], "thread")) {
+                autosave.mode = AutosaveMode::thread;
+            } else {
+                ABORT_F("Unknown autosave mode: {}", argv[i]);
+            }
+        } else if (c_str_eq(argv[i], "--autosave-interval")) {
+            CHECK_F(i + 1 < argc, "Expected a number of ticks after --autosave-interval");
+            ++i;
+            autosave.interval_ticks = std::stoull(argv[i], nullptr, 0);
+            autosave_interval_set = true;
+        } else if (c_str_eq(argv[i], "--always-render")) {
+            always_render = true;
+        } else if (c_str_eq(argv[i], "--frame-budget-ms")) {
+            CHECK_F(i + 1 < argc, "Expected a number after --frame-budget-ms");
+            ++i;
+            resolution.frame_budget_ms = std::stof(argv[i]);
+        } else if (c_str_eq(argv[i], "--fixed-resolution")) {
+            resolution.enabled = false;
+        } else if (c_str_eq(argv[i], "--borders")) {
+            CHECK_F(i + 1 < argc, "Expected lines, shaded or thick after --borders");
+            ++i;
+            if (c_str_eq(argv[i], "lines")) {
+                borders.mode = BorderMode::lines;
+            } else if (c_str_eq(argv[i], "shaded")) {
+                borders.mode = BorderMode::shaded;
+            } else if (c_str_eq(argv[i], "thick")) {
+                borders.mode = BorderMode::thick;
+            } else {
+                ABORT_F("Unknown border mode: {}", argv[i]);
+            }
+        } else if (c_str_eq(argv[i], "--border-width")) {
+            CHECK_F(i + 1 < argc, "Expected a number of pixels after --border-width");
+            ++i;
+            borders.width_px = std::stof(argv[i]);
+        } else if (c_str_eq(argv[i], "--terrain")) {
+            CHECK_F(i + 1 < argc, "Expected a path after --terrain");
+            ++i;
+            terrain_path = argv[i];
+        } else if (c_str_eq(argv[i], "--terrain-cpu-mb")) {
+            CHECK_F(i + 1 < argc, "Expected a number after --terrain-cpu-mb");
+            ++i;
+            terrain.cpu_budget_bytes = size_t(std::stoull(argv[i], nullptr, 0)) << 20;
+        } else if (c_str_eq(argv[i], "--terrain-gpu-mb")) {
+            CHECK_F(i + 1 < argc, "Expected a number after --terrain-gpu-mb");
+            ++i;
+            terrain.gpu_budget_bytes = size_t(std::stoull(argv[i], nullptr, 0)) << 20;
+        } else if (c_str_eq(argv[i], "--log-file")) {
+            CHECK_F(i + 1 < argc, "Expected a path after --log-file");
+            ++i;
+            log.file_path = argv[i];
+        } else if (c_str_eq(argv[i], "--log-full")) {
+            CHECK_F(i + 1 < argc, "Expected drop or block after --log-full");
+            ++i;
+            if (c_str_eq(argv[i], "drop")) {
+                log.full_policy = LogFullPolicy::drop;
+            } else if (c_str_eq(argv[i], "block")) {
+                log.full_policy = LogFullPolicy::block;
+            } else {
+                ABORT_F("Unknown log policy: {}", argv[i]);
+            }
+        } else if (c_str_eq(argv[i], "--log-buffer-kb")) {
+            CHECK_F(i + 1 < argc, "Expected a number after --log-buffer-kb");
+            ++i;
+            log.ring_bytes = static_cast<u32>(std::stoul(argv[i], nullptr, 0)) << 10;
+        } else {
+            ABORT_F("Unknown argument: {}", argv[i]);
+        }
+    }
+
+    CHECK_F(record_path.empty() || replay_path.empty(), "--record and --replay can't be used together");
+}
+
+void App::init(const int argc, char** const argv) {
+    init_start = std::chrono::steady_clock::now();
 
     app = this;
 
+    options.parse(argc, argv);
+
+    async_log.init(options.log);
+    async_log.start();
+    loguru::set_fatal_handler(flush_async_log);
+
     {
         const int size = wai_getExecutablePath(nullptr, 0, nullptr);
         CHECK_F(size != -1);
@@ -121,8 +251,14 @@ void App::init() {
         executable_dir_path = Path(buffer.data()).parent_path();
     }
 
-    GDALAllRegister();
+    thread_pool.init();
+
+    // Only the GPKG driver is needed for the provinces. They load on the thread pool while the window opens and
+    // shaders compile.
+    RegisterOGRGeoPackage();
+    start_loading_world();
 
+    auto phase_start = std::chrono::steady_clock::now();
     glfwSetErrorCallback(glfw_error_callback);
     CHECK_F(glfwInit());
 
@@ -135,6 +271,9 @@ void App::init() {
     const GLFWvidmode* video_mode = glfwGetVideoMode(monitor);
     CHECK_NOTNULL_F(video_mode);
 
+    const bool headless_replay = !options.replay_path.empty() && !options.replay_realtime;
+
+    glfwWindowHint(GLFW_VISIBLE, !headless_replay);
     glfwWindowHint(GLFW_RESIZABLE, true);
     glfwWindowHint(GLFW_MAXIMIZED, true);
     glfwWindowHint(GLFW_CENTER_CURSOR, false);
@@ -143,7 +282,8 @@ void App::init() {
     glfwWindowHint(GLFW_BLUE_BITS, video_mode->blueBits);
     glfwWindowHint(GLFW_REFRESH_RATE, video_mode->refreshRate);
     glfwWindowHint(GLFW_SRGB_CAPABLE, true);
-    glfwWindowHint(GLFW_SAMPLES, render_samples);
+    // Multisampling is done in an offscreen framebuffer.
+    glfwWindowHint(GLFW_SAMPLES, 0);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -154,43 +294,227 @@ void App::init() {
 
     glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
     glfwGetCursorPos(window, &cursor_xpos, &cursor_ypos);
+    log_startup_phase("Window", phase_start);
 
-    const char* const allowed_drivers_gpkg[] = {"GPKG", nullptr};
-    admin_1_fixed_ds = static_cast<GDALDataset*>(
-            GDALOpenEx(app->get_resource_path("gis/vector/admin_1_fixed.gpkg").c_str(),
-                       GDAL_OF_VECTOR | GDAL_OF_READONLY, allowed_drivers_gpkg, nullptr, nullptr));
-    CHECK_NOTNULL_F(admin_1_fixed_ds);
+    phase_start = std::chrono::steady_clock::now();
+    renderer.init();
+    log_startup_phase("GL and shaders", phase_start);
 
-    admin_1_fixed_l = admin_1_fixed_ds->GetLayerByName("admin_1_fixed");
+    if (!options.replay_path.empty()) {
+        CHECK_F(replay.open(options.replay_path), "Failed to open journal {}", options.replay_path.string());
+    }
 
-    renderer.init();
+    sim.thread_pool = &thread_pool;
+    sim.init(replay.is_open() ? replay.seed : options.seed);
+    if (!options.hash_log_path.empty()) {
+        hash_log.open(options.hash_log_path);
+        CHECK_F(bool(hash_log), "Failed to open {}", options.hash_log_path.string());
+    }
+    // A replay doesn't autosave over the player's games unless asked to.
+    AutosaveConfig autosave = options.autosave;
+    if (replay.is_open() && !options.autosave_interval_set) {
+        autosave.interval_ticks = 0;
+    }
+    autosaver.init(autosave, get_save_path("autosave.wss"));
+
+    if (!options.record_path.empty()) {
+        CHECK_F(journal.open(options.record_path, sim.seed), "Failed to open {}", options.record_path.string());
+
+        // Start the journal from the real cursor position, so that the first movement is replayed the same way.
+        InputEvent event;
+        event.type = InputType::cursor_pos;
+        event.x = cursor_xpos;
+        event.y = cursor_ypos;
+        queue_input(std::move(event));
+    }
 
+    // Starts the render thread, which draws the placeholder planet until the provinces are uploaded.
     load();
+
+    if (!options.benchmarks.empty() || headless_replay) {
+        wait_for_world();
+    }
+
+    if (!options.benchmarks.empty()) {
+        run_benchmarks();
+        glfwSetWindowShouldClose(window, true);
+    }
+
+    if (headless_replay) {
+        run_replay();
+        glfwSetWindowShouldClose(window, true);
+    }
+}
+
+void App::start_loading_world() {
+    admin_1_fixed_path = get_resource_path("gis/vector/admin_1_fixed.gpkg");
+
+    auto mesh_promise = std::make_shared<std::promise<std::shared_ptr<const PlanetMesh>>>();
+    auto graph_promise = std::make_shared<std::promise<void>>();
+    planet_mesh_future = mesh_promise->get_future();
+    province_graph_future = graph_promise->get_future();
+
+    // Provinces and their geometry first, then the adjacency graph and the planet mesh, which only depend on them, in
+    // parallel.
+    thread_pool.submit([this, mesh_promise, graph_promise] {
+        auto phase_start = std::chrono::steady_clock::now();
+        const char* const allowed_drivers_gpkg[] = {"GPKG", nullptr};
+        admin_1_fixed_ds = static_cast<GDALDataset*>(GDALOpenEx(admin_1_fixed_path.c_str(),
+                                                                GDAL_OF_VECTOR | GDAL_OF_READONLY,
+                                                                allowed_drivers_gpkg, nullptr, nullptr));
+        CHECK_NOTNULL_F(admin_1_fixed_ds);
+        admin_1_fixed_l = admin_1_fixed_ds->GetLayerByName("admin_1_fixed");
+        log_startup_phase("Open dataset", phase_start);
+
+        phase_start = std::chrono::steady_clock::now();
+        provinces.init(admin_1_fixed_l, admin_1_fixed_path, get_cache_path("admin_1_fixed.provinces"));
+        log_startup_phase("Province table", phase_start);
+
+        phase_start = std::chrono::steady_clock::now();
+        province_geometry.load_layer(admin_1_fixed_l, provinces, thread_pool);
+        log_startup_phase("Province geometry", phase_start);
+
+        thread_pool.submit([this, graph_promise] {
+            const auto graph_start = std::chrono::steady_clock::now();
+            province_graph.init(province_geometry, AdjacencyConfig(), thread_pool, admin_1_fixed_path,
+                                get_cache_path("admin_1_fixed.adjacency"));
+            pathfinder.init(province_graph, PathfinderConfig());
+            log_startup_phase("Adjacency and pathfinder", graph_start);
+            graph_promise->set_value();
+        });
+
+        phase_start = std::chrono::steady_clock::now();
+        auto mesh = std::make_shared<const PlanetMesh>(build_planet_mesh(province_geometry, options.borders.mode));
+        log_startup_phase("Planet mesh", phase_start);
+        mesh_promise->set_value(std::move(mesh));
+    });
+}
+
+void App::poll_world_loading() {
+    if (world_ready) {
+        return;
+    }
+
+    const auto is_ready = [](const auto& future) {
+        return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+
+    if (!provinces_uploaded && is_ready(planet_mesh_future)) {
+        render_commands.init_provinces(planet_mesh_future.get());
+        provinces_uploaded = true;
+        view_dirty = true;
+    }
+
+    if (provinces_uploaded && is_ready(province_graph_future)) {
+        province_graph_future.get();
+        world.add_provinces(provinces.count);
+        world_ready = true;
+        log_startup_phase("World", init_start);
+
+        // Ticks start now, rather than catching up on the time spent loading.
+        last_count = glfwGetTimerValue();
+        lag_s = 0.0;
+        replay_start_time = std::chrono::steady_clock::now();
+        sim.reset_timings();
+    }
+}
+
+void App::wait_for_world() {
+    planet_mesh_future.wait();
+    province_graph_future.wait();
+    poll_world_loading();
+}
+
+void App::log_startup_phase(const char* const name, const std::chrono::steady_clock::time_point start) const {
+    const auto now = std::chrono::steady_clock::now();
+    LOG_F(INFO, "Startup: {} took {:.1f} ms, done {:.1f} ms after start", name,
+          std::chrono::duration<f64, std::milli>(now - start).count(),
+          std::chrono::duration<f64, std::milli>(now - init_start).count());
 }
 
 void App::load() {
     app = this;
+
+    // Worker threads run code from this library, so they are stopped before a hot reload and restarted here.
+    if (thread_pool.threads.empty()) {
+        thread_pool.init();
+    }
+    if (!render_thread.thread.joinable()) {
+        render_thread.start(window, renderer);
+    }
+    if (!async_log.thread.joinable()) {
+        async_log.start();
+    }
+    loguru::set_fatal_handler(flush_async_log);
+    world.init(sim);
+
     glfwSetErrorCallback(glfw_error_callback);
     glfwSetKeyCallback(window, glfw_key_callback);
+    glfwSetMouseButtonCallback(window, glfw_mouse_button_callback);
     glfwSetCursorPosCallback(window, glfw_cursor_pos_callback);
     glfwSetScrollCallback(window, glfw_scroll_callback);
     glfwSetFramebufferSizeCallback(window, glfw_framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, glfw_window_refresh_callback);
+}
+
+void App::unload() {
+    // The autosave and render threads also run code from this library. The render thread uses the pool, so it stops
+    // first.
+    autosaver.poll(true);
+    render_thread.stop();
+    thread_pool.destroy();
+    // The world's state blocks call into this library. `load()` adds them again.
+    sim.state_blocks.clear();
+    // Last, since the other threads may have logged to it.
+    loguru::set_fatal_handler(nullptr);
+    async_log.stop();
 }
 
 void App::destroy() {
+    journal.close(sim.tick, sim.tick_hash);
+    autosaver.destroy();
+    render_thread.stop();
+    thread_pool.destroy();
+    glfwMakeContextCurrent(window);
+    renderer.terrain.destroy();
+    renderer.frame_timer.destroy();
+    renderer.scene_framebuffer.destroy();
+    renderer.resolve_framebuffer.destroy();
+    renderer.lines.destroy();
+    renderer.vertex_pool.destroy();
+    renderer.index_pool.destroy();
     glfwTerminate();
+    loguru::set_fatal_handler(nullptr);
+    async_log.destroy();
 }
 
 bool App::update() {
+    // Process input. This may sleep, so the time is measured after it.
+    if (process_events()) {
+        return true;
+    }
+
+    poll_world_loading();
+
     const u64 new_count = glfwGetTimerValue();
     const f64 elapsed_s = static_cast<f64>(new_count - last_count) / static_cast<f64>(counts_per_s);
     last_count = new_count;
-    lag_s += elapsed_s;
-
-    // Process input
-    if (process_events()) {
-        return true;
+    // The simulation waits for the world, but the camera can move around the placeholder planet meanwhile.
+    if (world_ready) {
+        lag_s += elapsed_s;
     }
+    const auto update_start = std::chrono::steady_clock::now();
+
+    // A replay takes its input from the journal instead
+    if (!replay.is_open()) {
+        for (const InputEvent& event : pending_inputs) {
+            if (journal.is_open()) {
+                journal.record(sim.tick, event);
+            }
+            apply_input(event);
+        }
+    }
+    pending_inputs.clear();
 
     // Update
     i32 updates = 0;
@@ -200,18 +524,297 @@ bool App::update() {
         ++updates;
     }
 
-    // Render
-    renderer.render();
+    if (replay.is_open() && replay.finished(sim.tick)) {
+        report_replay();
+        return true;
+    }
+
+    // Render. The render thread wakes this thread whenever it finishes a frame, so otherwise the loop can sleep until
+    // the next tick is due or input arrives.
+    if (render_thread.redraw_requested.exchange(false)) {
+        view_dirty = true;
+    }
+    if (!needs_render()) {
+        ++frames_skipped;
+    } else if (render_thread.is_ready()) {
+        render_commands.set_view(get_render_view());
+        render_commands.draw();
+        render_thread.submit(render_commands);
+        view_dirty = false;
+        drawn_sim_version = sim.version;
+        ++frames_drawn;
+    }
+    wait_s = std::max(update_s - lag_s, 0.0);
+
+    ++update_count;
+    update_busy_s += std::chrono::duration<f64>(std::chrono::steady_clock::now() - update_start).count();
+    report_cpu_usage();
 
     return false;
 }
 
 bool App::process_events() {
-    glfwPollEvents();
+    if (wait_s > 0.0) {
+        glfwWaitEventsTimeout(wait_s);
+    } else {
+        glfwPollEvents();
+    }
     return glfwWindowShouldClose(window);
 }
 
-void App::step() {}
+bool App::needs_render() const {
+    return options.always_render || view_dirty || sim.version != drawn_sim_version || render_thread.animating;
+}
+
+RenderView App::get_render_view() const {
+    RenderView view;
+    view.camera_pos = camera_pos;
+    view.camera_target = camera_target;
+    view.camera_up = camera_up;
+    view.fovy = fovy;
+    view.framebuffer_width = framebuffer_width;
+    view.framebuffer_height = framebuffer_height;
+    view.wireframe = wireframe_render;
+    return view;
+}
+
+void App::report_cpu_usage() {
+    constexpr f64 report_interval_s = 10.0;
+
+    const f64 now_s = glfwGetTime();
+    const f64 elapsed_s = now_s - usage_start_s;
+    if (elapsed_s < report_interval_s) {
+        return;
+    }
+
+    // Includes the thread pool and any other threads.
+    const f64 cpu_s = static_cast<f64>(std::clock()) / static_cast<f64>(CLOCKS_PER_SEC);
+    const RenderThreadStats render_stats = render_thread.take_stats();
+    if (usage_start_s > 0.0) {
+        // Called every update, so these go through the async sink.
+        ALOG_F(INFO, "CPU usage {:.1f}% of a core over {:.0f} s: {} frames drawn, {} idle{}",
+               100.0 * (cpu_s - usage_start_cpu_s) / elapsed_s, elapsed_s, frames_drawn, frames_skipped,
+               options.always_render ? " (--always-render)" : "");
+
+        const auto per = [](const f64 total_s, const u64 count) {
+            return count > 0 ? total_s * 1000.0 / static_cast<f64>(count) : 0.0;
+        };
+        ALOG_F(INFO, "Main thread {:.2f} ms/update; render thread {:.2f} ms/frame, {:.2f} ms of it in glfwSwapBuffers",
+               per(update_busy_s, update_count), per(render_stats.frame_s, render_stats.frames),
+               per(render_stats.swap_s, render_stats.frames));
+        ALOG_F(INFO, "GPU {:.2f} ms/frame with {} borders", per(render_stats.gpu_s, render_stats.gpu_frames),
+               get_border_mode_name(options.borders.mode));
+        if (render_stats.frames > 0) {
+            const auto frames = static_cast<f64>(render_stats.frames);
+            ALOG_F(INFO, "GL state changes per frame: {:.1f} issued, {:.1f} elided",
+                   static_cast<f64>(render_stats.gl.issued) / frames,
+                   static_cast<f64>(render_stats.gl.elided) / frames);
+        }
+    }
+
+    usage_start_s = now_s;
+    usage_start_cpu_s = cpu_s;
+    frames_drawn = 0;
+    frames_skipped = 0;
+    update_count = 0;
+    update_busy_s = 0.0;
+}
+
+void App::step() {
+    InputEvent event;
+    while (replay.pop(sim.tick, event)) {
+        apply_input(event);
+    }
+
+    sim.step();
+
+    if (hash_log.is_open()) {
+        hash_log << fmt::format("{} {:016x}\n", sim.tick, sim.tick_hash);
+    }
+
+    autosaver.update(sim);
+}
+
+void App::queue_input(InputEvent event) {
+    pending_inputs.push_back(std::move(event));
+}
+
+void App::submit_command(const i32 type, std::vector<u8> data) {
+    InputEvent event;
+    event.type = InputType::command;
+    event.code = type;
+    event.data = std::move(data);
+    queue_input(std::move(event));
+}
+
+void App::apply_input(const InputEvent& event) {
+    switch (event.type) {
+    case InputType::key: {
+        if (event.action != GLFW_PRESS) {
+            break;
+        }
+
+        switch (event.code) {
+        case GLFW_KEY_W: {
+            wireframe_render = !wireframe_render;
+        } break;
+
+        case GLFW_KEY_P: {
+            projection = static_cast<MapProjection>((static_cast<i32>(projection) + 1) %
+                                                    static_cast<i32>(MapProjection::count));
+            render_commands.set_projection(projection);
+        } break;
+
+        }
+
+        view_dirty = true;
+    } break;
+
+    case InputType::mouse_button: {
+        if (event.code == GLFW_MOUSE_BUTTON_RIGHT) {
+            rotating = event.action == GLFW_PRESS;
+        }
+    } break;
+
+    case InputType::cursor_pos: {
+        if (rotating) {
+            constexpr f64 factor = 0.001;
+
+            const f64 xrel = event.x - cursor_xpos;
+            const f64 yrel = event.y - cursor_ypos;
+
+            const f64 x_angle = factor * -xrel;
+            const glm::mat4 x_mat = glm::rotate(glm::mat4(1.0f), static_cast<f32>(x_angle), camera_up);
+
+            const f64 y_angle = factor * -yrel;
+            const glm::vec3 right = glm::normalize(glm::cross(camera_up, camera_pos - camera_target));
+            const glm::mat4 y_mat = glm::rotate(glm::mat4(1.0f), static_cast<f32>(y_angle), right);
+
+            camera_pos = glm::vec3(y_mat * x_mat * glm::vec4(camera_pos, 1.0f));
+            view_dirty = true;
+        }
+
+        cursor_xpos = event.x;
+        cursor_ypos = event.y;
+    } break;
+
+    case InputType::scroll: {
+        const f64 distance = event.y * 0.1 * static_cast<f64>(glm::length(camera_target - camera_pos));
+        const glm::vec3 front = glm::normalize(camera_target - camera_pos);
+        const glm::mat4 mat = glm::translate(glm::mat4(1.0f), static_cast<f32>(distance) * front);
+        camera_pos = glm::vec3(mat * glm::vec4(camera_pos, 1.0f));
+        view_dirty = true;
+    } break;
+
+    case InputType::command: {
+        sim.commands.push_back({event.code, event.data});
+    } break;
+
+    case InputType::end:
+        break;
+    }
+}
+
+void App::run_replay() {
+    LOG_F(INFO, "Replaying {}", options.replay_path.string());
+    while (!replay.finished(sim.tick)) {
+        step();
+    }
+    report_replay();
+}
+
+void App::report_replay() {
+    const f64 elapsed_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - replay_start_time).count();
+    LOG_F(INFO, "Replayed {} ticks in {:.3f} s ({:.0f} ticks/s)", sim.tick, elapsed_s,
+          static_cast<f64>(sim.tick) / elapsed_s);
+    sim.log_timings(sim.tick);
+
+    if (!replay.has_end) {
+        LOG_F(WARNING, "Journal has no end, so the final state can't be checked");
+    } else if (sim.tick_hash == replay.end_hash) {
+        LOG_F(INFO, "Final state hash matches the recording: {:016x}", sim.tick_hash);
+    } else {
+        LOG_F(ERROR, "Replay diverged from the recording: final state hash {:016x}, expected {:016x}", sim.tick_hash,
+              replay.end_hash);
+    }
+}
+
+void App::save_game(const Path& path) {
+    if (!world_ready) {
+        LOG_F(WARNING, "Can't save before the world has loaded");
+        return;
+    }
+
+    std::filesystem::create_directories(path.parent_path());
+
+    SaveWriter writer;
+    sim.save(writer);
+    if (writer.write(path)) {
+        LOG_F(INFO, "Saved tick {} to {}", sim.tick, path.string());
+    } else {
+        LOG_F(ERROR, "Failed to save {}", path.string());
+    }
+}
+
+void App::load_game(const Path& path) {
+    // Loading the provinces would replace a loaded game's provinces.
+    if (!world_ready) {
+        LOG_F(WARNING, "Can't load a save before the world has loaded");
+        return;
+    }
+
+    SaveFile file;
+    if (!file.open(path)) {
+        LOG_F(ERROR, "Failed to open save {}", path.string());
+        return;
+    }
+
+    if (sim.load(file)) {
+        LOG_F(INFO, "Loaded tick {} from {}", sim.tick, path.string());
+        if (journal.is_open()) {
+            LOG_F(WARNING, "Loads aren't journaled, so the recording won't replay past tick {}", sim.tick);
+        }
+    } else {
+        // The simulation may be half loaded, so start again rather than run from an inconsistent state.
+        LOG_F(ERROR, "Failed to load save {}", path.string());
+        sim.init(options.seed);
+    }
+}
+
+void App::run_benchmarks() {
+    for (const std::string& name : options.benchmarks) {
+        LOG_F(INFO, "Running benchmark: {}", name);
+        if (name == "pathfinding") {
+            bench_pathfinding(pathfinder, thread_pool);
+        } else if (name == "save") {
+            bench_save(get_cache_path("bench"), provinces.count);
+        } else if (name == "reproject") {
+            bench_reprojection(thread_pool);
+        } else if (name == "labels") {
+            bench_label_placement();
+        } else if (name == "slot_map") {
+            bench_slot_map();
+        } else if (name == "world") {
+            bench_world(thread_pool);
+        } else if (name == "scheduler") {
+            bench_scheduler(thread_pool);
+        } else if (name == "logging") {
+            bench_logging(get_cache_path("bench"));
+        } else if (name == "borders") {
+            // Drawn on the render thread, at the view the app starts with.
+            auto line_mesh =
+                    std::make_shared<const PlanetMesh>(build_planet_mesh(province_geometry, BorderMode::thick));
+            auto shaded_mesh =
+                    std::make_shared<const PlanetMesh>(build_planet_mesh(province_geometry, BorderMode::shaded));
+            render_commands.set_view(get_render_view());
+            render_commands.bench_borders(std::move(line_mesh), std::move(shaded_mesh));
+            render_thread.submit(render_commands);
+            render_thread.wait_idle();
+        } else {
+            LOG_F(ERROR, "Unknown benchmark: {}", name);
+        }
+    }
+}
 
 Path App::get_resource_path(const Path& path) {
     Path result = executable_dir_path;
@@ -220,4 +823,18 @@ Path App::get_resource_path(const Path& path) {
     return result;
 }
 
+Path App::get_cache_path(const Path& path) {
+    Path result = executable_dir_path;
+    result /= "cache";
+    result /= path;
+    return result;
+}
+
+Path App::get_save_path(const Path& path) {
+    Path result = executable_dir_path;
+    result /= "saves";
+    result /= path;
+    return result;
+}
+
 App* app = nullptr;
@@ -1,19 +1,41 @@
 #pragma once
 
+#include "adjacency.hpp"
+#include "async_log.hpp"
+#include "autosave.hpp"
 #include "filesystem.hpp"
+#include "geometry.hpp"
+#include "journal.hpp"
+#include "pathfinding.hpp"
+#include "province.hpp"
 #include "render.hpp"
+#include "render_thread.hpp"
+#include "reproject.hpp"
+#include "save.hpp"
+#include "simulation.hpp"
+#include "symbol.hpp"
+#include "thread_pool.hpp"
 #include "utility.hpp"
+#include "world.hpp"
 
 #include <GLFW/glfw3.h>
 #include <glm/trigonometric.hpp>
 #include <glm/vec3.hpp>
 #include <ogrsf_frmts.h>
 
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
 inline constexpr i32 render_samples = 8;
+inline constexpr u64 default_seed = 0x5745'5354'4152'0001;
 
 extern "C" {
 
-void* app_init();
+void* app_init(int argc, char** argv);
 void app_destroy(void* ptr);
 int app_update(void* ptr);
 
@@ -23,10 +45,64 @@ void app_unload(void* ptr);
 #endif
 }
 
+struct Options {
+    // Benchmarks to run after startup, from `--bench <name>`. The app exits once they have finished.
+    std::vector<std::string> benchmarks;
+
+    u64 seed = default_seed;
+
+    // If set, the simulation tick and state hash are written here after every tick, one per line, so that runs can
+    // be compared between machines and builds with diff.
+    Path hash_log_path;
+
+    // From `--autosave-mode fork|thread` and `--autosave-interval <ticks>`. Replays only autosave if the interval is
+    // given.
+    AutosaveConfig autosave;
+    bool autosave_interval_set = false;
+
+    // `--record <path>` writes every input to a journal. `--replay <path>` plays one back, headless and as fast as
+    // possible, or in real time with `--replay-realtime`.
+    Path record_path;
+    Path replay_path;
+    bool replay_realtime = false;
+
+    // Draw every frame, even when nothing has changed, from `--always-render`. For comparing CPU usage with idle
+    // frames skipped.
+    bool always_render = false;
+
+    // From `--frame-budget-ms <ms>`, or `--fixed-resolution` to always draw at full resolution.
+    DynamicResolutionConfig resolution;
+
+    // From `--borders lines|shaded|thick` and `--border-width <px>`.
+    BorderConfig borders;
+
+    // From `--log-file <path>`, `--log-full drop|block` and `--log-buffer-kb <n>`, for messages logged with `ALOG_F`.
+    AsyncLogConfig log;
+
+    // Raster streamed onto the globe, from `--terrain <path>`, or data/gis/raster/terrain.tif by default. Its caches
+    // are sized by `--terrain-cpu-mb <n>` and `--terrain-gpu-mb <n>`.
+    Path terrain_path;
+    TerrainConfig terrain;
+
+    void parse(int argc, char** argv);
+};
+
 struct App {
+    // First, so that it's constructed before anything interns a string. The app outlives a hot reload, so symbols stay
+    // valid across one.
+    SymbolTable symbols;
+    Options options;
+    std::chrono::steady_clock::time_point init_start;
+    AsyncLog async_log;
+
     GLFWwindow* window;
     Path executable_dir_path;
+    // Only used from the render thread once it has started.
     Renderer renderer;
+    RenderThread render_thread;
+    // Commands for the next frame
+    RenderCommandList render_commands;
+    ThreadPool thread_pool;
 
     u64 counts_per_s;
     f64 lag_s = 0.0;
@@ -35,8 +111,30 @@ struct App {
     i32 framebuffer_width;
     i32 framebuffer_height;
 
+    // While nothing visible has changed, frames aren't drawn and the loop sleeps until the next tick or input. The view
+    // is dirty after input that moves the camera or changes what is shown; simulation changes are noticed through
+    // `Simulation::version`.
+    bool view_dirty = true;
+    u64 drawn_sim_version = 0;
+    f64 wait_s = 0.0;
+
+    // Process CPU time, frames and main thread time since the last CPU usage report
+    f64 usage_start_s = 0.0;
+    f64 usage_start_cpu_s = 0.0;
+    u64 frames_drawn = 0;
+    u64 frames_skipped = 0;
+    u64 update_count = 0;
+    f64 update_busy_s = 0.0;
+
     f64 cursor_xpos;
     f64 cursor_ypos;
+    bool rotating = false;
+
+    // Inputs received since the last update. They are applied, and journaled, before the next tick.
+    std::vector<InputEvent> pending_inputs;
+    JournalWriter journal;
+    JournalReader replay;
+    std::chrono::steady_clock::time_point replay_start_time;
 
     glm::vec3 camera_pos = {0.0f, 0.0f, 4.0f};
     glm::vec3 camera_target = {0.0f, 0.0f, 0.0f};
@@ -44,23 +142,68 @@ struct App {
     f32 fovy = glm::radians(60.0f);
 
     bool wireframe_render = false;
+    MapProjection projection = MapProjection::globe;
 
+    Path admin_1_fixed_path;
     GDALDataset* admin_1_fixed_ds = nullptr;
     OGRLayer* admin_1_fixed_l = nullptr;
 
+    // Loaded on the thread pool during startup. Nothing may use them until `world_ready`.
+    ProvinceTable provinces;
+    ProvinceGeometry province_geometry;
+    ProvinceGraph province_graph;
+    Pathfinder pathfinder;
+    std::future<std::shared_ptr<const PlanetMesh>> planet_mesh_future;
+    std::future<void> province_graph_future;
+    bool provinces_uploaded = false;
+    bool world_ready = false;
+
+    Simulation sim;
+    World world;
+    std::ofstream hash_log;
+    Autosaver autosaver;
+
     i64 selected_province = -1;
 
-    void init();
+    void init(int argc, char** argv);
+    // Loads the provinces and builds everything derived from them as a graph of tasks on the thread pool.
+    void start_loading_world();
+    // Hands the planet mesh to the render thread once it's built, and sets `world_ready` once everything is loaded.
+    void poll_world_loading();
+    void wait_for_world();
+    // Logs the time a startup phase took, and when it ended relative to the start of `init`.
+    void log_startup_phase(const char* name, std::chrono::steady_clock::time_point start) const;
     void load();
+    void unload();
     void destroy();
     bool update();
 
     // Returns true if the application should exit
     bool process_events();
+    // Returns true if the next frame should be drawn.
+    bool needs_render() const;
+    RenderView get_render_view() const;
+    // Logs CPU usage, and time per update and per frame on the main and render threads, every few seconds.
+    void report_cpu_usage();
 
     void step();
 
+    void queue_input(InputEvent event);
+    void submit_command(i32 type, std::vector<u8> data);
+    void apply_input(const InputEvent& event);
+
+    // Runs a headless replay to the end.
+    void run_replay();
+    void report_replay();
+
+    void save_game(const Path& path);
+    void load_game(const Path& path);
+
+    void run_benchmarks();
+
     Path get_resource_path(const Path& path);
+    Path get_cache_path(const Path& path);
+    Path get_save_path(const Path& path);
 };
 
 extern App* app;
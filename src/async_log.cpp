@@ -0,0 +1,391 @@
+#include "async_log.hpp"
+
+#include "app.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+namespace {
+
+// How long the sink sleeps between passes over the rings
+constexpr std::chrono::milliseconds drain_interval(2);
+
+std::atomic<u64> next_instance = 1;
+
+// The ring a thread logs to. Trivially destructible: glibc won't unload a library while any thread has thread-local
+// destructors from it pending, and the main thread never exits, so hot reload would keep running the old code.
+struct ThreadRing {
+    LogRing* ring = nullptr;
+    u64 instance = 0;
+};
+
+static_assert(std::is_trivially_destructible_v<ThreadRing>);
+
+thread_local ThreadRing thread_ring;
+
+// Loguru's names, padded the same way
+const char* get_verbosity_name(const loguru::Verbosity verbosity) {
+    static constexpr std::array<const char*, 13> names = {
+            "FATL", "ERR", "WARN", "INFO", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
+    const i32 index = verbosity - loguru::Verbosity_FATAL;
+    return index >= 0 && index < static_cast<i32>(names.size()) ? names[static_cast<size_t>(index)] : "?";
+}
+
+// Moves `tail` past any filler, and copies the record there into `record`. Returns false if nothing is left before
+// `head`.
+bool peek_record(LogRing& ring, u64& tail, const u64 head, LogRecord& record) {
+    while (tail < head) {
+        const auto offset = static_cast<u32>(tail & (ring.capacity - 1));
+        const u32 to_end = ring.capacity - offset;
+        // Too little space for a header, so the producer skipped it without writing a filler.
+        if (to_end < sizeof(LogRecord)) {
+            tail += to_end;
+            continue;
+        }
+
+        std::memcpy(&record, ring.get_data() + offset, sizeof(record));
+        if (!record.format_args) {
+            tail += record.size;
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+f64 get_percentile(std::vector<f64>& samples, const f64 fraction) {
+    const auto index = std::min(static_cast<size_t>(fraction * static_cast<f64>(samples.size())), samples.size() - 1);
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(index), samples.end());
+    return samples[index];
+}
+
+// Times each call of `log` separately, in bursts of `burst` calls with a pause after each, like a tick that logs a
+// few lines and then waits for the next. A burst of 0 logs continuously.
+template <class F>
+std::vector<f64> time_log_calls(const u32 count, const u32 burst, F&& log) {
+    std::vector<f64> samples;
+    samples.reserve(count);
+    for (u32 i = 0; i < count; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        log(i);
+        samples.push_back(std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - start).count());
+        if (burst > 0 && (i + 1) % burst == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    }
+    return samples;
+}
+
+void log_percentiles(const char* const name, const char* const pattern, std::vector<f64> samples,
+                     const u64 dropped) {
+    const f64 p50 = get_percentile(samples, 0.5);
+    const f64 p99 = get_percentile(samples, 0.99);
+    const f64 p999 = get_percentile(samples, 0.999);
+    const f64 max = *std::max_element(samples.begin(), samples.end());
+    LOG_F(INFO, "{:<14} {:<6}: p50 {:7.0f} ns, p99 {:7.0f} ns, p99.9 {:7.0f} ns, max {:9.0f} ns per call, {} dropped",
+          name, pattern, p50, p99, p999, max, dropped);
+}
+} // namespace
+
+void AsyncLog::init(const AsyncLogConfig& config) {
+    CHECK_F(config.ring_bytes >= 4096 && (config.ring_bytes & (config.ring_bytes - 1)) == 0,
+            "Log buffers must be a power of two of at least 4096 bytes");
+    this->config = config;
+
+    max_verbosity = loguru::g_stderr_verbosity;
+    if (!config.file_path.empty()) {
+        file = std::fopen(config.file_path.c_str(), "w");
+        if (file) {
+            max_verbosity = std::max(max_verbosity, config.file_verbosity);
+        } else {
+            LOG_F(ERROR, "Failed to open log file {}: {}", config.file_path.string(), strerror(errno));
+        }
+    }
+}
+
+void AsyncLog::destroy() {
+    stop();
+    if (file) {
+        std::fclose(file);
+        file = nullptr;
+    }
+    std::lock_guard lock(rings_mutex);
+    rings.clear();
+}
+
+void AsyncLog::start() {
+    CHECK_F(!thread.joinable());
+    // Threads that logged before the sink was stopped register new rings.
+    instance = next_instance.fetch_add(1, std::memory_order_relaxed);
+    if (start_ns == 0) {
+        start_ns = now_ns();
+    }
+
+    running.store(true, std::memory_order_release);
+    thread = std::thread([this] { run(); });
+}
+
+void AsyncLog::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard lock(wake_mutex);
+        running.store(false, std::memory_order_release);
+    }
+    wake.notify_one();
+    thread.join();
+
+    std::lock_guard lock(drain_mutex);
+    drain();
+    std::lock_guard rings_lock(rings_mutex);
+    rings.clear();
+}
+
+void AsyncLog::flush() {
+    // If the sink thread itself is crashing, it may be part way through a drain.
+    if (std::this_thread::get_id() == thread.get_id()) {
+        return;
+    }
+
+    std::lock_guard lock(drain_mutex);
+    drain();
+}
+
+u64 AsyncLog::now_ns() {
+    return static_cast<u64>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+                    .count());
+}
+
+LogRing& AsyncLog::get_ring() {
+    if (thread_ring.instance != instance) {
+        // Thread IDs are only reused once a thread has exited, so a ring registered under this thread's ID belongs to
+        // an exited thread, and this thread takes it over. This keeps one ring per live thread without noticing exits.
+        // The sink reads the thread name while draining, so renaming waits for it.
+        std::lock_guard drain_lock(drain_mutex);
+        std::lock_guard lock(rings_mutex);
+        const std::thread::id id = std::this_thread::get_id();
+        const auto it = std::find_if(rings.begin(), rings.end(),
+                                     [&](const std::unique_ptr<LogRing>& ring) { return ring->owner == id; });
+        LogRing* ring;
+        if (it != rings.end()) {
+            ring = it->get();
+        } else {
+            ring = rings.emplace_back(std::make_unique<LogRing>()).get();
+            ring->storage = std::make_unique<u64[]>(config.ring_bytes / sizeof(u64));
+            ring->capacity = config.ring_bytes;
+            ring->owner = id;
+        }
+        loguru::get_thread_name(ring->thread_name, sizeof(ring->thread_name), false);
+
+        thread_ring.ring = ring;
+        thread_ring.instance = instance;
+    }
+    return *thread_ring.ring;
+}
+
+u8* AsyncLog::reserve(LogRing& ring, const u32 size, u64& next_head) {
+    const u64 head = ring.head.load(std::memory_order_relaxed);
+    const auto offset = static_cast<u32>(head & (ring.capacity - 1));
+    const u32 to_end = ring.capacity - offset;
+    const bool wrap = size > to_end;
+    const u32 needed = wrap ? to_end + size : size;
+
+    if (needed > ring.capacity) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    while (head + needed - ring.cached_tail > ring.capacity) {
+        ring.cached_tail = ring.tail.load(std::memory_order_acquire);
+        if (head + needed - ring.cached_tail <= ring.capacity) {
+            break;
+        }
+        if (config.full_policy == LogFullPolicy::drop || !running.load(std::memory_order_relaxed)) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        wake.notify_one();
+        std::this_thread::yield();
+    }
+
+    u8* const data = ring.get_data();
+    if (wrap && to_end >= sizeof(LogRecord)) {
+        LogRecord filler = {};
+        filler.size = to_end;
+        std::memcpy(data + offset, &filler, sizeof(filler));
+    }
+
+    next_head = head + needed;
+    return wrap ? data : data + offset;
+}
+
+void AsyncLog::run() {
+    loguru::set_thread_name("log");
+
+    std::unique_lock lock(wake_mutex);
+    while (running.load(std::memory_order_acquire)) {
+        lock.unlock();
+        {
+            std::lock_guard drain_lock(drain_mutex);
+            drain();
+        }
+        lock.lock();
+        wake.wait_for(lock, drain_interval, [&] { return !running.load(std::memory_order_acquire); });
+    }
+}
+
+void AsyncLog::drain() {
+    {
+        std::lock_guard lock(rings_mutex);
+        for (const std::unique_ptr<LogRing>& ring : rings) {
+            drain_rings.push_back(ring.get());
+        }
+    }
+
+    // Heads are read once, so a pass ends even if threads keep logging. Within a pass, records from all threads are
+    // written in time order.
+    struct Cursor {
+        LogRing* ring;
+        u64 tail;
+        u64 head;
+        LogRecord record;
+        bool has_record;
+    };
+    std::vector<Cursor> cursors;
+    cursors.reserve(drain_rings.size());
+    for (LogRing* const ring : drain_rings) {
+        Cursor cursor = {ring, ring->tail.load(std::memory_order_relaxed),
+                         ring->head.load(std::memory_order_acquire), {}, false};
+        cursor.has_record = peek_record(*cursor.ring, cursor.tail, cursor.head, cursor.record);
+        cursors.push_back(cursor);
+    }
+
+    while (true) {
+        Cursor* next = nullptr;
+        for (Cursor& cursor : cursors) {
+            if (cursor.has_record && (!next || cursor.record.time_ns < next->record.time_ns)) {
+                next = &cursor;
+            }
+        }
+        if (!next) {
+            break;
+        }
+
+        const u8* const args =
+                next->ring->get_data() + (next->tail & (next->ring->capacity - 1)) + sizeof(LogRecord);
+        write_record(*next->ring, next->record, args);
+        next->tail += next->record.size;
+        next->has_record = peek_record(*next->ring, next->tail, next->head, next->record);
+        // Released as soon as possible, for threads waiting under `LogFullPolicy::block`
+        next->ring->tail.store(next->tail, std::memory_order_release);
+    }
+
+    for (const Cursor& cursor : cursors) {
+        cursor.ring->tail.store(cursor.tail, std::memory_order_release);
+        const u64 dropped = cursor.ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            dropped_count += dropped;
+            line_buffer.clear();
+            fmt::format_to(line_buffer, "Dropped {} log messages from thread {}: its buffer was full\n", dropped,
+                           cursor.ring->thread_name);
+            stderr_buffer.append(line_buffer.data(), line_buffer.data() + line_buffer.size());
+            if (file) {
+                file_buffer.append(line_buffer.data(), line_buffer.data() + line_buffer.size());
+            }
+        }
+    }
+
+    if (stderr_buffer.size() > 0) {
+        std::fwrite(stderr_buffer.data(), 1, stderr_buffer.size(), stderr);
+        std::fflush(stderr);
+        stderr_buffer.clear();
+    }
+    if (file_buffer.size() > 0) {
+        std::fwrite(file_buffer.data(), 1, file_buffer.size(), file);
+        std::fflush(file);
+        file_buffer.clear();
+    }
+
+    drain_rings.clear();
+}
+
+void AsyncLog::write_record(const LogRing& ring, const LogRecord& record, const u8* const args) {
+    const bool to_stderr = record.verbosity <= loguru::g_stderr_verbosity;
+    const bool to_file = file && record.verbosity <= config.file_verbosity;
+    if (!to_stderr && !to_file) {
+        return;
+    }
+
+    const char* const slash = std::strrchr(record.file, '/');
+    const f64 uptime_s = static_cast<f64>(record.time_ns - start_ns) * 1e-9;
+    line_buffer.clear();
+    fmt::format_to(line_buffer, "({:8.3f}s) [{:<16}] {:>23}:{:<5} {:>4}| ", uptime_s, ring.thread_name,
+                   slash ? slash + 1 : record.file, record.line, get_verbosity_name(record.verbosity));
+    record.format_args(line_buffer, record.format, args);
+    line_buffer.push_back('\n');
+
+    if (to_stderr) {
+        stderr_buffer.append(line_buffer.data(), line_buffer.data() + line_buffer.size());
+    }
+    if (to_file) {
+        file_buffer.append(line_buffer.data(), line_buffer.data() + line_buffer.size());
+    }
+}
+
+AsyncLog& get_async_log() {
+    return app->async_log;
+}
+
+void flush_async_log(const loguru::Message&) {
+    if (app) {
+        app->async_log.flush();
+    }
+}
+
+// Messages are logged at verbosity 1, which loguru only writes to the file added here, so that neither sink writes to
+// stderr. Loguru flushes its file after every message by default.
+void bench_logging(const Path& dir_path) {
+    constexpr u32 count = 200'000;
+    constexpr u32 burst = 64;
+
+    std::filesystem::create_directories(dir_path);
+    const std::string system_name = "movement";
+
+    {
+        const std::vector<f64> timer_samples = time_log_calls(count, 0, [](u32) {});
+        log_percentiles("timer only", "flood", timer_samples, 0);
+    }
+
+    for (const u32 pattern_burst : {burst, 0u}) {
+        const char* const pattern = pattern_burst > 0 ? "bursts" : "flood";
+
+        const std::string loguru_path = (dir_path / "log_loguru.txt").string();
+        loguru::add_file(loguru_path.c_str(), loguru::Truncate, loguru::Verbosity_1);
+        const std::vector<f64> loguru_samples = time_log_calls(count, pattern_burst, [&](const u32 i) {
+            LOG_F(1, "Tick {}: {} took {:.3f} ms for {} units", i, system_name, static_cast<f64>(i) * 1e-3, i % 977);
+        });
+        loguru::remove_callback(loguru_path.c_str());
+        log_percentiles("loguru", pattern, loguru_samples, 0);
+
+        for (const LogFullPolicy policy : {LogFullPolicy::drop, LogFullPolicy::block}) {
+            AsyncLogConfig config;
+            config.full_policy = policy;
+            config.file_path = dir_path / "log_async.txt";
+            config.file_verbosity = loguru::Verbosity_1;
+
+            AsyncLog sink;
+            sink.init(config);
+            sink.start();
+            const std::vector<f64> async_samples = time_log_calls(count, pattern_burst, [&](const u32 i) {
+                sink.log(loguru::Verbosity_1, __FILE__, __LINE__, "Tick {}: {} took {:.3f} ms for {} units", i,
+                         system_name, static_cast<f64>(i) * 1e-3, i % 977);
+            });
+            sink.destroy();
+            log_percentiles(policy == LogFullPolicy::drop ? "async (drop)" : "async (block)", pattern, async_samples,
+                            sink.dropped_count);
+        }
+    }
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "utility.hpp"
+
+#include <fmt/format.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// Takes the same arguments as `LOG_F`, but only copies the arguments into a buffer belonging to the calling thread.
+// The sink thread formats and writes the message later. Use this on hot paths: per tick or per frame.
+#define ALOG_F(verbosity_name, ...) \
+    ::log_async(loguru::Verbosity_##verbosity_name, __FILE__, static_cast<u32>(__LINE__), __VA_ARGS__)
+
+enum class LogFullPolicy {
+    // Drop the message and count it. The sink reports how many were lost, and the logging thread never waits.
+    drop,
+    // Wait for the sink to make room. Nothing is lost, but a slow disk can stall the logging thread.
+    block,
+};
+
+struct AsyncLogConfig {
+    LogFullPolicy full_policy = LogFullPolicy::drop;
+    // Size of each thread's buffer. Must be a power of two.
+    u32 ring_bytes = 256 * 1024;
+    // If set, messages up to `file_verbosity` are written here. Messages up to loguru's stderr verbosity go to stderr
+    // as well.
+    Path file_path;
+    loguru::Verbosity file_verbosity = loguru::Verbosity_MAX;
+};
+
+// Formats a record's arguments, which are stored after its header.
+using LogFormatFn = void (*)(fmt::memory_buffer& out, const char* format, const u8* args);
+
+// Header of a record in a `LogRing`. Records are padded to a multiple of 8 bytes so that headers stay aligned.
+struct LogRecord {
+    // Of the whole record, including this header and the padding
+    u32 size;
+    loguru::Verbosity verbosity;
+    u32 line;
+    const char* file;
+    const char* format;
+    // Null for the filler that skips the end of the buffer when a record wouldn't fit before it
+    LogFormatFn format_args;
+    u64 time_ns;
+};
+
+static_assert(sizeof(LogRecord) % 8 == 0);
+
+// Single-producer, single-consumer buffer of records. The owning thread writes at `head` and the sink thread reads at
+// `tail`. Both only ever increase, and are taken modulo the capacity. A record never wraps: if one doesn't fit before
+// the end, the producer skips to the start.
+struct LogRing {
+    std::unique_ptr<u64[]> storage;
+    u32 capacity = 0;
+    char thread_name[24] = {};
+
+    alignas(64) std::atomic<u64> head = 0;
+    // The producer's last view of `tail`, so that it only reads the sink's cache line when the buffer looks full
+    u64 cached_tail = 0;
+
+    alignas(64) std::atomic<u64> tail = 0;
+
+    std::atomic<u64> dropped = 0;
+    // The thread that registered the ring. Another thread with the same ID takes it over once that one has exited.
+    std::thread::id owner;
+
+    u8* get_data() {
+        return reinterpret_cast<u8*>(storage.get());
+    }
+};
+
+namespace async_log_detail {
+
+template <class T>
+inline constexpr bool is_string = std::is_same_v<T, const char*> || std::is_same_v<T, char*> ||
+                                  std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+
+// Copied into the record as they are
+template <class T>
+inline constexpr bool is_copied =
+        !is_string<T> && (std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>);
+
+// How an argument is read back by the sink. Strings are copied into the record and read back as views of it.
+template <class T>
+using Stored = std::conditional_t<is_copied<std::decay_t<T>>, std::decay_t<T>, std::string_view>;
+
+// Numbers are kept as they are and strings are viewed until they are copied into the record. Anything else is
+// formatted now, since it might refer to memory that is gone by the time the sink formats the message.
+template <class T>
+auto prepare(const T& value) {
+    using D = std::decay_t<T>;
+    if constexpr (is_copied<D>) {
+        return D(value);
+    } else if constexpr (is_string<D>) {
+        return std::string_view(value);
+    } else {
+        return fmt::format("{}", value);
+    }
+}
+
+template <class T>
+u32 get_size(const T& value) {
+    if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+        return static_cast<u32>(sizeof(u32) + value.size());
+    } else {
+        return sizeof(T);
+    }
+}
+
+template <class T>
+void write_arg(u8*& cursor, const T& value) {
+    if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+        const auto length = static_cast<u32>(value.size());
+        std::memcpy(cursor, &length, sizeof(length));
+        std::memcpy(cursor + sizeof(length), value.data(), length);
+        cursor += sizeof(length) + length;
+    } else {
+        std::memcpy(cursor, &value, sizeof(T));
+        cursor += sizeof(T);
+    }
+}
+
+template <class T>
+T read_arg(const u8*& cursor) {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        u32 length;
+        std::memcpy(&length, cursor, sizeof(length));
+        const std::string_view str(reinterpret_cast<const char*>(cursor + sizeof(length)), length);
+        cursor += sizeof(length) + length;
+        return str;
+    } else {
+        T value;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+}
+
+template <class... Stored>
+void format_args(fmt::memory_buffer& out, const char* const format, const u8* cursor) {
+    // Elements of a braced list are evaluated in order, so the arguments are read in the order they were written.
+    const std::tuple<Stored...> values{read_arg<Stored>(cursor)...};
+    std::apply([&](const auto&... args) { fmt::format_to(out, format, args...); }, values);
+    static_cast<void>(cursor);
+}
+} // namespace async_log_detail
+
+// Logging sink that keeps formatting and I/O off the threads that log. Each thread gets its own `LogRing` the first
+// time it logs, so logging takes no lock. A background thread drains the rings every few milliseconds, merging them
+// in time order, and writes to stderr and the log file.
+//
+// Records refer to format strings and code in this library, so the sink is stopped and drained before a hot reload.
+// While stopped, messages go straight to loguru.
+struct AsyncLog {
+    AsyncLogConfig config;
+    // Distinguishes sinks and each run of a sink, so that a thread that logged before registers a new ring
+    u64 instance = 0;
+    std::atomic<bool> running = false;
+    // Messages above this are dropped before anything is copied.
+    loguru::Verbosity max_verbosity = loguru::Verbosity_OFF;
+    u64 start_ns = 0;
+    // Messages lost to full buffers under `LogFullPolicy::drop`
+    u64 dropped_count = 0;
+
+    // Taken after `drain_mutex` when both are needed
+    std::mutex rings_mutex;
+    std::vector<std::unique_ptr<LogRing>> rings;
+
+    // Held while draining, so that a crashing thread can flush without racing the sink thread.
+    std::mutex drain_mutex;
+    std::vector<LogRing*> drain_rings;
+    std::FILE* file = nullptr;
+    fmt::memory_buffer line_buffer;
+    fmt::memory_buffer stderr_buffer;
+    fmt::memory_buffer file_buffer;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::thread thread;
+
+    void init(const AsyncLogConfig& config);
+    // Writes everything logged so far and closes the log file.
+    void destroy();
+
+    void start();
+    // Writes everything logged so far, stops the sink thread and frees the rings. Threads that logged must not be
+    // logging at the same time; they get new rings after the next `start()`.
+    void stop();
+    // Writes everything logged so far from the calling thread. Used when crashing, since the sink thread won't get
+    // another chance.
+    void flush();
+
+    template <class... Args>
+    void log(const loguru::Verbosity verbosity, const char* const file, const u32 line, const char* const format,
+             const Args&... args) {
+        if (verbosity > max_verbosity) {
+            return;
+        }
+        if (!running.load(std::memory_order_acquire)) {
+            loguru::log(verbosity, file, line, format, args...);
+            return;
+        }
+
+        const auto prepared = std::make_tuple(async_log_detail::prepare(args)...);
+        const u32 args_size = std::apply(
+                [](const auto&... values) { return (0u + ... + async_log_detail::get_size(values)); }, prepared);
+        const u32 size = (static_cast<u32>(sizeof(LogRecord)) + args_size + 7u) & ~7u;
+
+        LogRing& ring = get_ring();
+        u64 next_head;
+        u8* const data = reserve(ring, size, next_head);
+        if (!data) {
+            return;
+        }
+
+        LogRecord record;
+        record.size = size;
+        record.verbosity = verbosity;
+        record.line = line;
+        record.file = file;
+        record.format = format;
+        record.format_args = &async_log_detail::format_args<async_log_detail::Stored<Args>...>;
+        record.time_ns = now_ns();
+        std::memcpy(data, &record, sizeof(record));
+        u8* cursor = data + sizeof(record);
+        std::apply([&](const auto&... values) { (async_log_detail::write_arg(cursor, values), ...); }, prepared);
+        ring.head.store(next_head, std::memory_order_release);
+    }
+
+    static u64 now_ns();
+
+private:
+    LogRing& get_ring();
+    // Returns where to write a record of `size` bytes, and sets `next_head` to publish it with, or returns null if it
+    // was dropped.
+    u8* reserve(LogRing& ring, u32 size, u64& next_head);
+    void run();
+    // Called with `drain_mutex` held.
+    void drain();
+    void write_record(const LogRing& ring, const LogRecord& record, const u8* args);
+};
+
+// `app->async_log`
+AsyncLog& get_async_log();
+// For `loguru::set_fatal_handler`, so that messages still in the buffers are written before `CHECK_F` or `ABORT_F`
+// aborts.
+void flush_async_log(const loguru::Message& message);
+
+template <class... Args>
+void log_async(const loguru::Verbosity verbosity, const char* const file, const u32 line, const char* const format,
+               const Args&... args) {
+    get_async_log().log(verbosity, file, line, format, args...);
+}
+
+// Compares the cost of a log call on the logging thread, with loguru writing synchronously and through the sink.
+void bench_logging(const Path& dir_path);
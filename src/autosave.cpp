@@ -0,0 +1,182 @@
+#include "autosave.hpp"
+
+#include "async_log.hpp"
+#include "save.hpp"
+#include "simulation.hpp"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+namespace {
+
+// Memory that the calling process doesn't share with any other, in bytes. In a forked child this is the memory
+// copied on write, by either process, since the fork, plus anything the child allocated itself.
+u64 read_private_bytes() {
+    const int fd = open("/proc/self/smaps_rollup", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+
+    char buffer[4096];
+    const ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (size <= 0) {
+        return 0;
+    }
+    buffer[size] = '\0';
+
+    u64 result_kb = 0;
+    for (const char* key : {"Private_Clean:", "Private_Dirty:"}) {
+        const char* const line = strstr(buffer, key);
+        if (line != nullptr) {
+            result_kb += strtoull(line + strlen(key), nullptr, 10);
+        }
+    }
+    return result_kb * 1024;
+}
+
+f64 to_mb(const u64 bytes) {
+    return static_cast<f64>(bytes) / (1024.0 * 1024.0);
+}
+} // namespace
+
+void Autosaver::init(const AutosaveConfig& config, const Path& path) {
+    this->config = config;
+    this->path = path;
+}
+
+void Autosaver::destroy() {
+    poll(true);
+}
+
+void Autosaver::update(const Simulation& sim) {
+    poll();
+
+    if (config.interval_ticks > 0 && sim.tick % config.interval_ticks == 0) {
+        if (in_progress()) {
+            ALOG_F(WARNING, "Skipping autosave of tick {}: the autosave of tick {} is still running", sim.tick,
+                   start_tick);
+        } else {
+            start(sim);
+        }
+    }
+}
+
+bool Autosaver::start(const Simulation& sim) {
+    if (in_progress()) {
+        return false;
+    }
+
+    std::filesystem::create_directories(path.parent_path());
+    start_time = std::chrono::steady_clock::now();
+    start_tick = sim.tick;
+
+    switch (config.mode) {
+    case AutosaveMode::fork:
+        return start_fork(sim);
+    case AutosaveMode::thread:
+        return start_thread(sim);
+    }
+    return false;
+}
+
+bool Autosaver::start_fork(const Simulation& sim) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        LOG_F(ERROR, "Autosave failed: pipe2: {}", strerror(errno));
+        return false;
+    }
+
+    const pid_t pid = fork();
+    if (pid == -1) {
+        LOG_F(ERROR, "Autosave failed: fork: {}", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        // Only this thread exists in the child, and other threads may have held locks at the fork, so don't log or
+        // touch the thread pool, GL or GDAL. Exit without running destructors or atexit handlers, which belong to the
+        // parent.
+        close(fds[0]);
+
+        SaveWriter writer;
+        sim.save(writer);
+        const bool succeeded = writer.write(path);
+
+        const u64 overhead_bytes = read_private_bytes();
+        const bool reported = write(fds[1], &overhead_bytes, sizeof(overhead_bytes)) == sizeof(overhead_bytes);
+        _exit(succeeded && reported ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    child = pid;
+    result_fd = fds[0];
+    return true;
+}
+
+bool Autosaver::start_thread(const Simulation& sim) {
+    // The copy is the only part that runs on the main thread, and is as fast as memcpy.
+    auto writer = std::make_unique<SaveWriter>();
+    sim.save(*writer);
+    writer->copy_data();
+
+    snapshot_bytes = 0;
+    for (const SaveWriter::Block& block : writer->blocks) {
+        snapshot_bytes += block.size;
+    }
+
+    thread_done.store(false, std::memory_order_relaxed);
+    thread = std::thread([this, writer = std::move(writer)] {
+        thread_succeeded = writer->write(path);
+        thread_done.store(true, std::memory_order_release);
+    });
+    return true;
+}
+
+void Autosaver::poll(const bool block) {
+    if (child != -1) {
+        int status;
+        const pid_t result = waitpid(child, &status, block ? 0 : WNOHANG);
+        if (result == 0) {
+            return;
+        }
+
+        bool succeeded = false;
+        u64 overhead_bytes = 0;
+        if (result == child) {
+            succeeded = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS &&
+                        read(result_fd, &overhead_bytes, sizeof(overhead_bytes)) == sizeof(overhead_bytes);
+        } else {
+            LOG_F(ERROR, "Autosave: waitpid: {}", strerror(errno));
+        }
+
+        close(result_fd);
+        child = -1;
+        result_fd = -1;
+        finish(succeeded, overhead_bytes);
+    }
+
+    if (thread.joinable() && (block || thread_done.load(std::memory_order_acquire))) {
+        thread.join();
+        finish(thread_succeeded, snapshot_bytes);
+    }
+}
+
+bool Autosaver::in_progress() const {
+    return child != -1 || thread.joinable();
+}
+
+void Autosaver::finish(const bool succeeded, const u64 overhead_bytes) {
+    const f64 duration_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start_time).count();
+    if (succeeded) {
+        ALOG_F(INFO, "Autosaved tick {} to {} in {:.3f} s ({}, {:.1f} MiB memory overhead)", start_tick, path.string(),
+               duration_s, config.mode == AutosaveMode::fork ? "fork" : "thread", to_mb(overhead_bytes));
+    } else {
+        ALOG_F(ERROR, "Autosave of tick {} to {} failed after {:.3f} s", start_tick, path.string(), duration_s);
+    }
+}
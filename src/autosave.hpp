@@ -0,0 +1,68 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "utility.hpp"
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+struct Simulation;
+
+enum class AutosaveMode {
+    // Fork at a tick boundary and write the save from the child, which sees a copy-on-write snapshot of the whole
+    // process. Costs one fork on the main thread, however large the world is.
+    fork,
+    // Copy the saved state on the main thread and write it from a worker thread. Use this when the process holds
+    // state that is unsafe to fork with.
+    thread,
+};
+
+struct AutosaveConfig {
+    AutosaveMode mode = AutosaveMode::fork;
+    // Ticks between autosaves. 0 disables autosaving.
+    u64 interval_ticks = 60 * 60 * 5;
+};
+
+// Writes saves in the background. At most one autosave is in flight; a tick that falls due while the previous one is
+// still running is skipped.
+struct Autosaver {
+    AutosaveConfig config;
+    Path path;
+
+    // Fork mode
+    pid_t child = -1;
+    // The child reports the memory it didn't share with the parent through this pipe.
+    int result_fd = -1;
+
+    // Thread mode
+    std::thread thread;
+    std::atomic<bool> thread_done = false;
+    bool thread_succeeded = false;
+    u64 snapshot_bytes = 0;
+
+    std::chrono::steady_clock::time_point start_time;
+    u64 start_tick = 0;
+
+    void init(const AutosaveConfig& config, const Path& path);
+    // Waits for any autosave in flight.
+    void destroy();
+
+    // Call once per tick, after `Simulation::step()`.
+    void update(const Simulation& sim);
+
+    // Starts an autosave of the current state. Returns false if one is already in flight or it couldn't be started.
+    bool start(const Simulation& sim);
+
+    // Reaps a finished autosave without blocking, or waits for it if `block` is set.
+    void poll(bool block = false);
+
+    bool in_progress() const;
+
+private:
+    bool start_fork(const Simulation& sim);
+    bool start_thread(const Simulation& sim);
+    void finish(bool succeeded, u64 overhead_bytes);
+};
@@ -0,0 +1,233 @@
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+
+namespace {
+
+f64 to_mb(const u64 bytes) {
+    return static_cast<f64>(bytes) / (1024.0 * 1024.0);
+}
+
+// Smallest order whose block holds `count` elements
+u32 get_order(const u32 count, const u32 min_elements) {
+    u32 order = 0;
+    while (u64(min_elements) << order < count) {
+        ++order;
+    }
+    return order;
+}
+
+// Node value for a node of `order` after one of its children changed
+u8 combine(const std::vector<u8>& tree, const size_t node, const u32 order) {
+    const u8 left = tree[2 * node + 1];
+    const u8 right = tree[2 * node + 2];
+    // Both children entirely free, so the node's whole block is
+    if (left == order && right == order) {
+        return static_cast<u8>(order + 1);
+    }
+    return std::max(left, right);
+}
+} // namespace
+
+void BufferPool::init(const u32 stride, const u32 min_elements, const u32 block_order) {
+    CHECK_F(blocks.empty());
+    CHECK_F(stride > 0 && min_elements > 0);
+    this->stride = stride;
+    this->min_elements = min_elements;
+    this->block_order = block_order;
+}
+
+void BufferPool::destroy() {
+    for (const PendingFrees& pending : fenced_frees) {
+        glDeleteSync(pending.fence);
+    }
+    for (const Block& block : blocks) {
+        glDeleteBuffers(1, &block.buffer);
+    }
+    *this = BufferPool();
+}
+
+BufferRange BufferPool::allocate(const u32 count) {
+    BufferRange range;
+    if (count == 0) {
+        return range;
+    }
+
+    const u32 order = get_order(count, min_elements);
+    bool allocated = false;
+    for (u32 i = 0; i < blocks.size() && !allocated; ++i) {
+        allocated = allocate_in(i, order, range);
+    }
+    if (!allocated) {
+        allocated = allocate_in(add_block(std::max(order, block_order)), order, range);
+        CHECK_F(allocated);
+    }
+
+    range.count = count;
+    ++range_count;
+    allocated_elements += u64(min_elements) << order;
+    requested_elements += count;
+    return range;
+}
+
+void BufferPool::free(const BufferRange range) {
+    if (range) {
+        unfenced_frees.push_back(range);
+    }
+}
+
+void BufferPool::upload(const BufferRange& range, const void* const data) {
+    if (!range) {
+        return;
+    }
+    glNamedBufferSubData(get_buffer(range), static_cast<GLintptr>(get_bytes(range.offset)),
+                         static_cast<GLsizeiptr>(get_bytes(range.count)), data);
+}
+
+void BufferPool::update() {
+    if (!unfenced_frees.empty()) {
+        fenced_frees.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), std::move(unfenced_frees)});
+        unfenced_frees.clear();
+    }
+
+    // Fences signal in order, so the first unsignalled one ends the search.
+    while (!fenced_frees.empty()) {
+        PendingFrees& pending = fenced_frees.front();
+        const GLenum status = glClientWaitSync(pending.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+
+        glDeleteSync(pending.fence);
+        for (const BufferRange& range : pending.ranges) {
+            release(range);
+        }
+        fenced_frees.pop_front();
+    }
+}
+
+u32 BufferPool::get_buffer(const BufferRange& range) const {
+    return blocks.at(range.block).buffer;
+}
+
+BufferPoolStats BufferPool::get_stats() const {
+    BufferPoolStats stats;
+    stats.blocks = static_cast<u32>(blocks.size());
+    stats.ranges = range_count;
+    stats.allocated_bytes = get_bytes(allocated_elements);
+    stats.requested_bytes = get_bytes(requested_elements);
+
+    for (const Block& block : blocks) {
+        stats.capacity_bytes += get_bytes(u64(min_elements) << block.order);
+        if (block.tree[0] != 0) {
+            stats.largest_free_bytes =
+                    std::max(stats.largest_free_bytes, get_bytes(u64(min_elements) << (block.tree[0] - 1)));
+        }
+    }
+
+    for (const PendingFrees& pending : fenced_frees) {
+        for (const BufferRange& range : pending.ranges) {
+            stats.pending_free_bytes += get_bytes(u64(min_elements) << range.order);
+        }
+    }
+    for (const BufferRange& range : unfenced_frees) {
+        stats.pending_free_bytes += get_bytes(u64(min_elements) << range.order);
+    }
+
+    stats.free_bytes = stats.capacity_bytes - stats.allocated_bytes;
+    return stats;
+}
+
+// Internal fragmentation is the space lost to rounding ranges up to a power of two, external fragmentation the part of
+// the free space that isn't in the largest free block.
+void BufferPool::log_report(const char* const name) const {
+    const BufferPoolStats stats = get_stats();
+    const f64 internal = stats.allocated_bytes == 0 ? 0.0
+                                                    : 1.0 - static_cast<f64>(stats.requested_bytes) /
+                                                                    static_cast<f64>(stats.allocated_bytes);
+    const f64 external = stats.free_bytes == 0 ? 0.0
+                                               : 1.0 - static_cast<f64>(stats.largest_free_bytes) /
+                                                               static_cast<f64>(stats.free_bytes);
+    LOG_F(INFO,
+          "{} buffer pool: {} ranges in {} buffers, {:.1f} of {:.1f} MiB used ({:.1f} MiB requested), "
+          "{:.1f} MiB waiting on fences, fragmentation {:.0f}% internal, {:.0f}% external",
+          name, stats.ranges, stats.blocks, to_mb(stats.allocated_bytes), to_mb(stats.capacity_bytes),
+          to_mb(stats.requested_bytes), to_mb(stats.pending_free_bytes), internal * 100.0, external * 100.0);
+}
+
+bool BufferPool::allocate_in(const u32 block_index, const u32 order, BufferRange& range) {
+    Block& block = blocks[block_index];
+    std::vector<u8>& tree = block.tree;
+    if (tree[0] < order + 1) {
+        return false;
+    }
+
+    // Descend towards a free block of exactly `order`, preferring the left so that allocations pack together.
+    size_t node = 0;
+    u32 node_order = block.order;
+    while (node_order > order) {
+        const size_t left = 2 * node + 1;
+        node = tree[left] >= order + 1 ? left : left + 1;
+        --node_order;
+    }
+    tree[node] = 0;
+
+    const size_t depth_start = (size_t(1) << (block.order - order)) - 1;
+    range.block = block_index;
+    range.offset = static_cast<u32>(((node - depth_start) << order) * min_elements);
+    range.order = order;
+
+    while (node != 0) {
+        node = (node - 1) / 2;
+        ++node_order;
+        tree[node] = combine(tree, node, node_order);
+    }
+    return true;
+}
+
+void BufferPool::release(const BufferRange& range) {
+    Block& block = blocks.at(range.block);
+    std::vector<u8>& tree = block.tree;
+
+    const size_t depth_start = (size_t(1) << (block.order - range.order)) - 1;
+    size_t node = depth_start + (range.offset / min_elements >> range.order);
+    CHECK_F(tree[node] == 0, "Freeing a range that isn't allocated");
+    tree[node] = static_cast<u8>(range.order + 1);
+
+    u32 order = range.order;
+    while (node != 0) {
+        node = (node - 1) / 2;
+        ++order;
+        tree[node] = combine(tree, node, order);
+    }
+
+    --range_count;
+    allocated_elements -= u64(min_elements) << range.order;
+    requested_elements -= range.count;
+}
+
+u32 BufferPool::add_block(const u32 order) {
+    Block block;
+    block.order = order;
+    block.tree.resize((size_t(2) << order) - 1);
+    // Every node starts as a free block of its depth's order.
+    for (u32 depth = 0; depth <= order; ++depth) {
+        const size_t start = (size_t(1) << depth) - 1;
+        std::fill(block.tree.begin() + static_cast<std::ptrdiff_t>(start),
+                  block.tree.begin() + static_cast<std::ptrdiff_t>(2 * start + 1), static_cast<u8>(order - depth + 1));
+    }
+
+    // Immutable storage, so the driver never has to handle a reallocation. Contents change with `glBufferSubData`.
+    glCreateBuffers(1, &block.buffer);
+    glNamedBufferStorage(block.buffer, static_cast<GLsizeiptr>(get_bytes(u64(min_elements) << order)), nullptr,
+                         GL_DYNAMIC_STORAGE_BIT);
+
+    blocks.push_back(std::move(block));
+    LOG_F(INFO, "New {:.1f} MiB buffer in pool with {} byte elements", to_mb(get_bytes(u64(min_elements) << order)),
+          stride);
+    return static_cast<u32>(blocks.size() - 1);
+}
+
+u64 BufferPool::get_bytes(const u64 elements) const {
+    return elements * stride;
+}
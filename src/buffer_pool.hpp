@@ -0,0 +1,95 @@
+#pragma once
+
+#include "utility.hpp"
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <vector>
+
+// Elements allocated from a `BufferPool`. `offset` and `count` are in elements, so `offset` can be used directly as a
+// draw's base vertex or first index.
+struct BufferRange {
+    u32 block = 0;
+    u32 offset = 0;
+    u32 count = 0;
+    // Size of the buddy block holding the range, as a power of two of `BufferPool::min_elements`
+    u32 order = 0;
+
+    explicit operator bool() const {
+        return count != 0;
+    }
+};
+
+struct BufferPoolStats {
+    u32 blocks = 0;
+    u32 ranges = 0;
+    u64 capacity_bytes = 0;
+    // Bytes of buddy blocks in use, including their rounding up
+    u64 allocated_bytes = 0;
+    // Bytes asked for
+    u64 requested_bytes = 0;
+    u64 free_bytes = 0;
+    // The biggest range that could be allocated without a new buffer
+    u64 largest_free_bytes = 0;
+    // Freed, but possibly still read by the GPU
+    u64 pending_free_bytes = 0;
+};
+
+// Sub-allocates ranges of fixed-size elements from a few large immutable buffers, so that many meshes share buffers
+// and changing one never reallocates a buffer. Each buffer is split by a buddy allocator: a tree over power-of-two
+// blocks where every node stores the order of the largest free block below it, so allocating and freeing are
+// O(log n). A freed range is only reused once a fence shows that the frames which might draw from it have finished.
+struct BufferPool {
+    struct Block {
+        u32 buffer = 0;
+        u32 order = 0;
+        // Complete binary tree of `2 << order` - 1 nodes. Each holds 1 + the order of the largest free block below it,
+        // or 0 if everything below it is allocated.
+        std::vector<u8> tree;
+    };
+
+    struct PendingFrees {
+        GLsync fence;
+        std::vector<BufferRange> ranges;
+    };
+
+    u32 stride = 0;
+    // Smallest allocation, in elements
+    u32 min_elements = 0;
+    // Order of new buffers. A buffer is bigger if it's the only way to fit an allocation.
+    u32 block_order = 0;
+
+    std::vector<Block> blocks;
+    // Freed since the last `update()`
+    std::vector<BufferRange> unfenced_frees;
+    // Oldest first
+    std::deque<PendingFrees> fenced_frees;
+
+    u32 range_count = 0;
+    u64 allocated_elements = 0;
+    u64 requested_elements = 0;
+
+    // Buffers hold `min_elements << block_order` elements of `stride` bytes.
+    void init(u32 stride, u32 min_elements, u32 block_order);
+    void destroy();
+
+    // Returns a null range if `count` is 0.
+    BufferRange allocate(u32 count);
+    // The range may be reused once the GPU has finished with every command issued before the next `update()`.
+    void free(BufferRange range);
+    // Uploads `range.count` elements to `range`.
+    void upload(const BufferRange& range, const void* data);
+    // Fences the frees since the last call, and releases those whose fences have signalled. Called once a frame.
+    void update();
+
+    u32 get_buffer(const BufferRange& range) const;
+    BufferPoolStats get_stats() const;
+    void log_report(const char* name) const;
+
+private:
+    bool allocate_in(u32 block_index, u32 order, BufferRange& range);
+    void release(const BufferRange& range);
+    u32 add_block(u32 order);
+    u64 get_bytes(u64 elements) const;
+};
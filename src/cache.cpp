@@ -0,0 +1,97 @@
+#include "cache.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr u32 cache_magic = make_cache_kind("WSCF");
+
+struct CacheHeader {
+    u32 magic;
+    u32 kind;
+    u32 version;
+    u32 padding;
+    CacheKey key;
+};
+} // namespace
+
+CacheKey make_cache_key(const Path& source_path, const u64 params) {
+    CacheKey result;
+    result.source_size = fs::file_size(source_path);
+    result.source_time = fs::last_write_time(source_path).time_since_epoch().count();
+    result.params = params;
+    return result;
+}
+
+BinaryWriter::BinaryWriter(const Path& path, const u32 kind, const u32 version, const CacheKey& key) : path(path) {
+    fs::create_directories(path.parent_path());
+    temp_path = path;
+    temp_path += ".tmp";
+    stream.open(temp_path, std::ios::binary | std::ios::trunc);
+    CHECK_F(bool(stream), "Failed to open cache file {}", temp_path.string());
+
+    const CacheHeader header = {
+            .magic = cache_magic,
+            .kind = kind,
+            .version = version,
+            .padding = 0,
+            .key = key,
+    };
+    write(header);
+}
+
+void BinaryWriter::write_bytes(const void* const data, const size_t size) {
+    stream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+}
+
+void BinaryWriter::write_string(const std::string& str) {
+    write<u64>(str.size());
+    write_bytes(str.data(), str.size());
+}
+
+bool BinaryWriter::finish() {
+    stream.close();
+    if (!stream) {
+        LOG_F(WARNING, "Failed to write cache file {}", temp_path.string());
+        return false;
+    }
+
+    std::error_code error;
+    fs::rename(temp_path, path, error);
+    if (error) {
+        LOG_F(WARNING, "Failed to replace cache file {}: {}", path.string(), error.message());
+        return false;
+    }
+    return true;
+}
+
+bool BinaryReader::open(const Path& path, const u32 kind, const u32 version, const CacheKey& key) {
+    stream.open(path, std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+
+    CacheHeader header;
+    if (!read(header)) {
+        return false;
+    }
+    return header.magic == cache_magic && header.kind == kind && header.version == version && header.key == key;
+}
+
+bool BinaryReader::read_bytes(void* const data, const size_t size) {
+    stream.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+    return bool(stream);
+}
+
+bool BinaryReader::read_string(std::string& str) {
+    u64 size;
+    if (!read(size) || size > max_vector_bytes) {
+        return false;
+    }
+    str.resize(size);
+    return read_bytes(str.data(), str.size());
+}
+
+bool BinaryReader::at_end() {
+    return stream.peek() == std::ifstream::traits_type::eof();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "utility.hpp"
+
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Identifies the source data a cache file was built from. A cache file is only used if its key matches the current
+// source file exactly, so editing a dataset (or changing a build parameter hashed into `params`) rebuilds everything
+// derived from it.
+struct CacheKey {
+    u64 source_size = 0;
+    i64 source_time = 0;
+    u64 params = 0;
+
+    bool operator==(const CacheKey& other) const {
+        return source_size == other.source_size && source_time == other.source_time && params == other.params;
+    }
+
+    bool operator!=(const CacheKey& other) const {
+        return !(*this == other);
+    }
+};
+
+CacheKey make_cache_key(const Path& source_path, u64 params = 0);
+
+// Writes a cache file. Data is written to a temporary file which replaces `path` in `finish()`, so a crash part way
+// through never leaves a truncated cache behind.
+struct BinaryWriter {
+    Path path;
+    Path temp_path;
+    std::ofstream stream;
+
+    BinaryWriter(const Path& path, u32 kind, u32 version, const CacheKey& key);
+
+    void write_bytes(const void* data, size_t size);
+
+    template <class T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write_bytes(&value, sizeof(T));
+    }
+
+    template <class T, class A>
+    void write_vector(const std::vector<T, A>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write<u64>(values.size());
+        write_bytes(values.data(), values.size() * sizeof(T));
+    }
+
+    void write_string(const std::string& str);
+
+    bool finish();
+};
+
+// Reads a cache file written by `BinaryWriter`. All reads return false once the stream fails, so callers can read a
+// whole file and check the result once at the end.
+struct BinaryReader {
+    std::ifstream stream;
+
+    // Returns false if the file is missing or was written for a different kind, version or key.
+    bool open(const Path& path, u32 kind, u32 version, const CacheKey& key);
+
+    bool read_bytes(void* data, size_t size);
+
+    template <class T>
+    bool read(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return read_bytes(&value, sizeof(T));
+    }
+
+    template <class T, class A>
+    bool read_vector(std::vector<T, A>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        u64 size;
+        if (!read(size) || size > max_vector_bytes / sizeof(T)) {
+            return false;
+        }
+        values.resize(size);
+        return read_bytes(values.data(), values.size() * sizeof(T));
+    }
+
+    bool read_string(std::string& str);
+
+    // Returns true if the whole file has been consumed.
+    bool at_end();
+
+private:
+    static constexpr u64 max_vector_bytes = u64(1) << 34;
+};
+
+inline constexpr u32 make_cache_kind(const char (&tag)[5]) {
+    return static_cast<u32>(tag[0]) | static_cast<u32>(tag[1]) << 8 | static_cast<u32>(tag[2]) << 16 |
+           static_cast<u32>(tag[3]) << 24;
+}
@@ -0,0 +1,173 @@
+#include "compress.hpp"
+
+#include <vector>
+
+namespace {
+
+constexpr size_t min_match = 4;
+constexpr size_t max_offset = 65535;
+constexpr u32 hash_bits = 14;
+
+// The last literals of a block are never part of a match, which keeps the match search away from the end.
+constexpr size_t end_literals = 5;
+constexpr size_t min_compress_size = 13;
+
+u32 read_u32(const u8* const data) {
+    u32 result;
+    memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+u32 hash_u32(const u32 value) {
+    return (value * 2654435761u) >> (32 - hash_bits);
+}
+
+u8* write_length(u8* dst, size_t length) {
+    while (length >= 255) {
+        *dst++ = 255;
+        length -= 255;
+    }
+    *dst++ = static_cast<u8>(length);
+    return dst;
+}
+
+u8* write_sequence(u8* dst, const u8* const literals, const size_t literal_count, const size_t offset,
+                   const size_t match_length) {
+    const size_t match_code = match_length > 0 ? match_length - min_match : 0;
+    *dst++ = static_cast<u8>(std::min<size_t>(literal_count, 15) << 4 | std::min<size_t>(match_code, 15));
+    if (literal_count >= 15) {
+        dst = write_length(dst, literal_count - 15);
+    }
+
+    memcpy(dst, literals, literal_count);
+    dst += literal_count;
+
+    if (match_length > 0) {
+        *dst++ = static_cast<u8>(offset);
+        *dst++ = static_cast<u8>(offset >> 8);
+        if (match_code >= 15) {
+            dst = write_length(dst, match_code - 15);
+        }
+    }
+    return dst;
+}
+
+bool read_length(const u8*& src, const u8* const src_end, size_t& length) {
+    while (true) {
+        if (src == src_end) {
+            return false;
+        }
+        const u8 byte = *src++;
+        length += byte;
+        if (byte != 255) {
+            return true;
+        }
+    }
+}
+} // namespace
+
+size_t lz_compress_bound(const size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t lz_decompress_bound(const size_t size) {
+    return 255 * size + 16;
+}
+
+size_t lz_compress(const u8* const src, const size_t size, u8* const dst) {
+    u8* out = dst;
+    size_t anchor = 0;
+
+    if (size >= min_compress_size) {
+        std::vector<u32> table(size_t(1) << hash_bits, 0);
+        const size_t match_limit = size - end_literals;
+        const size_t search_limit = size - min_compress_size + 1;
+
+        size_t pos = 0;
+        u32 misses = 0;
+        while (pos < search_limit) {
+            const u32 sequence = read_u32(src + pos);
+            const u32 hash = hash_u32(sequence);
+            const size_t candidate = table[hash];
+            table[hash] = static_cast<u32>(pos + 1);
+
+            if (candidate == 0 || pos - (candidate - 1) > max_offset || read_u32(src + candidate - 1) != sequence) {
+                // Skip ahead faster through data that doesn't compress.
+                pos += 1 + (misses >> 6);
+                ++misses;
+                continue;
+            }
+            misses = 0;
+
+            const size_t ref = candidate - 1;
+            size_t length = min_match;
+            while (pos + length < match_limit && src[ref + length] == src[pos + length]) {
+                ++length;
+            }
+
+            out = write_sequence(out, src + anchor, pos - anchor, pos - ref, length);
+            pos += length;
+            anchor = pos;
+        }
+    }
+
+    out = write_sequence(out, src + anchor, size - anchor, 0, 0);
+    return static_cast<size_t>(out - dst);
+}
+
+bool lz_decompress(const u8* src, const size_t size, u8* const dst, const size_t dst_size) {
+    const u8* const src_end = src + size;
+    u8* out = dst;
+    u8* const out_end = dst + dst_size;
+
+    while (src < src_end) {
+        const u8 token = *src++;
+
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !read_length(src, src_end, literal_count)) {
+            return false;
+        }
+        if (literal_count > static_cast<size_t>(src_end - src) ||
+            literal_count > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+        memcpy(out, src, literal_count);
+        src += literal_count;
+        out += literal_count;
+
+        if (src == src_end) {
+            break;
+        }
+
+        if (src_end - src < 2) {
+            return false;
+        }
+        const size_t offset = size_t(src[0]) | size_t(src[1]) << 8;
+        src += 2;
+
+        size_t length = token & 15;
+        if (length == 15 && !read_length(src, src_end, length)) {
+            return false;
+        }
+        length += min_match;
+
+        if (offset == 0 || offset > static_cast<size_t>(out - dst) || length > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+
+        // Matches may overlap their own output, so copy forwards, in 8-byte steps when the offset allows it.
+        const u8* match = out - offset;
+        size_t i = 0;
+        if (offset >= 8) {
+            for (; i + 8 <= length; i += 8) {
+                memcpy(out + i, match + i, 8);
+            }
+        }
+        for (; i < length; ++i) {
+            out[i] = match[i];
+        }
+        out += length;
+    }
+
+    return out == out_end;
+}
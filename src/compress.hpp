@@ -0,0 +1,20 @@
+#pragma once
+
+#include "utility.hpp"
+
+// Byte-oriented LZ77 codec in the style of LZ4: a sequence of tokens, each made of a run of literals followed by a
+// match of at least 4 bytes within the previous 64 KiB. It favours speed over ratio, which suits large columns of
+// mostly repetitive game state.
+
+// Largest possible output of `lz_compress()` for `size` input bytes.
+size_t lz_compress_bound(size_t size);
+
+// Largest possible output of `lz_decompress()` for `size` input bytes, for rejecting corrupt sizes before allocating.
+// Each byte extending a match's length adds at most 255 bytes of output.
+size_t lz_decompress_bound(size_t size);
+
+// Returns the number of bytes written to `dst`, which must hold `lz_compress_bound(size)` bytes.
+size_t lz_compress(const u8* src, size_t size, u8* dst);
+
+// Returns false if `src` is corrupt or doesn't decompress to exactly `dst_size` bytes.
+bool lz_decompress(const u8* src, size_t size, u8* dst, size_t dst_size);
@@ -1,5 +1,10 @@
 #include "filesystem.hpp"
 
+#include "utility.hpp"
+
+#include <fstream>
+#include <sstream>
+
 std::string read_file(const Path& path) {
     std::ifstream stream(path);
     CHECK_F(bool(stream));
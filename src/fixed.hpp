@@ -0,0 +1,125 @@
+#pragma once
+
+#include "utility.hpp"
+
+// Signed 32.32 fixed-point number for simulation state. Unlike floating point, every operation gives bit-identical
+// results on every machine, compiler and optimisation level, which lockstep multiplayer and replays depend on.
+// Products and quotients go through 128-bit intermediates. Products round towards negative infinity and quotients
+// towards zero. Overflow wraps around rather than being undefined, so it is at least the same everywhere.
+struct Fixed {
+    static constexpr i32 fraction_bits = 32;
+    static constexpr i64 one_raw = i64(1) << fraction_bits;
+
+    i64 raw = 0;
+
+    static constexpr Fixed from_raw(const i64 raw) {
+        Fixed result;
+        result.raw = raw;
+        return result;
+    }
+
+    static constexpr Fixed from_int(const i64 value) {
+        return from_raw(static_cast<i64>(static_cast<u64>(value) << fraction_bits));
+    }
+
+    static constexpr Fixed from_ratio(const i64 numerator, const i64 denominator) {
+        return from_raw(static_cast<i64>(static_cast<__int128>(numerator) * one_raw / denominator));
+    }
+
+    // For display and rendering only. The result must never flow back into simulation state.
+    f64 to_f64() const {
+        return static_cast<f64>(raw) / static_cast<f64>(one_raw);
+    }
+
+    constexpr i64 floor() const {
+        return raw >> fraction_bits;
+    }
+
+    constexpr Fixed operator-() const {
+        return from_raw(static_cast<i64>(0 - static_cast<u64>(raw)));
+    }
+
+    constexpr Fixed operator+(const Fixed other) const {
+        return from_raw(static_cast<i64>(static_cast<u64>(raw) + static_cast<u64>(other.raw)));
+    }
+
+    constexpr Fixed operator-(const Fixed other) const {
+        return from_raw(static_cast<i64>(static_cast<u64>(raw) - static_cast<u64>(other.raw)));
+    }
+
+    constexpr Fixed operator*(const Fixed other) const {
+        return from_raw(static_cast<i64>((static_cast<__int128>(raw) * other.raw) >> fraction_bits));
+    }
+
+    constexpr Fixed operator/(const Fixed other) const {
+        return from_raw(static_cast<i64>(static_cast<__int128>(raw) * one_raw / other.raw));
+    }
+
+    constexpr Fixed& operator+=(const Fixed other) {
+        return *this = *this + other;
+    }
+
+    constexpr Fixed& operator-=(const Fixed other) {
+        return *this = *this - other;
+    }
+
+    constexpr Fixed& operator*=(const Fixed other) {
+        return *this = *this * other;
+    }
+
+    constexpr Fixed& operator/=(const Fixed other) {
+        return *this = *this / other;
+    }
+
+    constexpr bool operator==(const Fixed other) const {
+        return raw == other.raw;
+    }
+
+    constexpr bool operator!=(const Fixed other) const {
+        return raw != other.raw;
+    }
+
+    constexpr bool operator<(const Fixed other) const {
+        return raw < other.raw;
+    }
+
+    constexpr bool operator<=(const Fixed other) const {
+        return raw <= other.raw;
+    }
+
+    constexpr bool operator>(const Fixed other) const {
+        return raw > other.raw;
+    }
+
+    constexpr bool operator>=(const Fixed other) const {
+        return raw >= other.raw;
+    }
+};
+
+static_assert(sizeof(Fixed) == sizeof(i64));
+
+constexpr Fixed abs(const Fixed value) {
+    return value.raw < 0 ? -value : value;
+}
+
+// Square root by integer Newton iteration on the raw value, so it is as deterministic as the other operations.
+constexpr Fixed sqrt(const Fixed value) {
+    if (value.raw <= 0) {
+        return Fixed();
+    }
+
+    // sqrt(raw / 2^32) * 2^32 == sqrt(raw * 2^32)
+    const unsigned __int128 n = static_cast<unsigned __int128>(value.raw) << Fixed::fraction_bits;
+    const u64 high = static_cast<u64>(n >> 64);
+    const u64 low = static_cast<u64>(n);
+    const i32 bits = high != 0 ? 128 - __builtin_clzll(high) : 64 - __builtin_clzll(low);
+
+    // Start above the root and iterate downwards.
+    unsigned __int128 x = static_cast<unsigned __int128>(1) << ((bits + 1) / 2);
+    unsigned __int128 y = (x + n / x) / 2;
+    while (y < x) {
+        x = y;
+        y = (x + n / x) / 2;
+    }
+    return Fixed::from_raw(static_cast<i64>(x));
+}
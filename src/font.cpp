@@ -0,0 +1,626 @@
+#include "font.hpp"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace {
+
+constexpr u32 font_cache_kind = make_cache_kind("FONT");
+constexpr u32 font_cache_version = 1;
+
+// Inclusive ranges of the code points in the atlas: ASCII, Latin-1, Latin Extended-A, dashes and quotes. Bump
+// `charset_version` when changing them.
+constexpr u32 charset[][2] = {{0x20, 0x7e}, {0xa0, 0x17f}, {0x2013, 0x2014}, {0x2018, 0x201e}};
+constexpr u32 charset_version = 1;
+
+constexpr u32 max_composite_depth = 8;
+constexpr u32 curve_segments = 6;
+
+u64 get_params() {
+    return u64(FontAtlas::em_size) | u64(FontAtlas::sdf_range) << 8 | u64(charset_version) << 16 |
+           u64(FontAtlas::width) << 32;
+}
+
+struct FontReader {
+    const std::vector<u8>& data;
+
+    u8 u8_at(const u32 offset) const {
+        return offset < data.size() ? data[offset] : 0;
+    }
+
+    u16 u16_at(const u32 offset) const {
+        return static_cast<u16>(u8_at(offset) << 8 | u8_at(offset + 1));
+    }
+
+    i16 i16_at(const u32 offset) const {
+        return static_cast<i16>(u16_at(offset));
+    }
+
+    u32 u32_at(const u32 offset) const {
+        return u32(u16_at(offset)) << 16 | u16_at(offset + 2);
+    }
+
+    // 2.14 fixed point, used for component scales.
+    f32 f2dot14_at(const u32 offset) const {
+        return static_cast<f32>(i16_at(offset)) / 16384.0f;
+    }
+
+    u32 find_table(const char* const tag) const {
+        const u32 table_count = u16_at(4);
+        for (u32 i = 0; i < table_count; ++i) {
+            const u32 record = 12 + 16 * i;
+            if (record + 16 <= data.size() && memcmp(data.data() + record, tag, 4) == 0) {
+                return u32_at(record + 8);
+            }
+        }
+        return 0;
+    }
+};
+
+void append_quadratic(GlyphOutline& outline, const glm::vec2& p0, const glm::vec2& control, const glm::vec2& p1) {
+    for (u32 i = 1; i <= curve_segments; ++i) {
+        const f32 t = static_cast<f32>(i) / curve_segments;
+        const f32 u = 1.0f - t;
+        outline.points.push_back(u * u * p0 + 2.0f * u * t * control + t * t * p1);
+    }
+}
+
+// Signed distance from `p` to the outline, positive inside, using the nonzero winding rule.
+f32 signed_distance(const GlyphOutline& outline, const glm::vec2& p) {
+    f32 min_distance_sq = INFINITY;
+    i32 winding = 0;
+
+    for (size_t contour = 0; contour + 1 < outline.contour_offsets.size(); ++contour) {
+        const u32 begin = outline.contour_offsets[contour];
+        const u32 end = outline.contour_offsets[contour + 1];
+        for (u32 i = begin; i < end; ++i) {
+            const glm::vec2 a = outline.points[i];
+            const glm::vec2 b = outline.points[i + 1 < end ? i + 1 : begin];
+
+            const glm::vec2 ab = b - a;
+            const f32 length_sq = glm::dot(ab, ab);
+            const f32 t = length_sq > 0.0f ? std::clamp(glm::dot(p - a, ab) / length_sq, 0.0f, 1.0f) : 0.0f;
+            const glm::vec2 d = p - (a + t * ab);
+            min_distance_sq = std::min(min_distance_sq, glm::dot(d, d));
+
+            if ((a.y <= p.y) != (b.y <= p.y)) {
+                const f32 x = a.x + (p.y - a.y) / (b.y - a.y) * (b.x - a.x);
+                if (x > p.x) {
+                    winding += b.y > a.y ? 1 : -1;
+                }
+            }
+        }
+    }
+
+    const f32 distance = std::sqrt(min_distance_sq);
+    return winding != 0 ? distance : -distance;
+}
+} // namespace
+
+bool TrueTypeFont::load(const Path& path) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    if (data.size() < 12) {
+        return false;
+    }
+
+    const FontReader reader{data};
+    const u32 version = reader.u32_at(0);
+    if (version != 0x00010000 && version != 0x74727565) { // "true"
+        return false;
+    }
+
+    const u32 head = reader.find_table("head");
+    const u32 hhea = reader.find_table("hhea");
+    const u32 maxp = reader.find_table("maxp");
+    cmap = reader.find_table("cmap");
+    loca = reader.find_table("loca");
+    glyf = reader.find_table("glyf");
+    hmtx = reader.find_table("hmtx");
+    if (head == 0 || hhea == 0 || maxp == 0 || cmap == 0 || loca == 0 || glyf == 0 || hmtx == 0) {
+        return false;
+    }
+
+    units_per_em = reader.u16_at(head + 18);
+    long_loca = reader.i16_at(head + 50) != 0;
+    ascender = reader.i16_at(hhea + 4);
+    descender = reader.i16_at(hhea + 6);
+    h_metric_count = reader.u16_at(hhea + 34);
+    glyph_count = reader.u16_at(maxp + 4);
+
+    // Prefer a full Unicode table (format 12), then a BMP one (format 4).
+    const u32 encoding_count = reader.u16_at(cmap + 2);
+    u32 best_table = 0;
+    for (u32 i = 0; i < encoding_count; ++i) {
+        const u32 record = cmap + 4 + 8 * i;
+        const u32 platform = reader.u16_at(record);
+        const u32 encoding = reader.u16_at(record + 2);
+        const u32 table = cmap + reader.u32_at(record + 4);
+        const u32 format = reader.u16_at(table);
+
+        const bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+        if (unicode && (format == 12 || (format == 4 && cmap_format != 12))) {
+            best_table = table;
+            cmap_format = format;
+        }
+    }
+    cmap = best_table;
+
+    return cmap != 0 && units_per_em > 0 && h_metric_count > 0;
+}
+
+u32 TrueTypeFont::get_glyph_index(const u32 codepoint) const {
+    const FontReader reader{data};
+
+    if (cmap_format == 12) {
+        const u32 group_count = reader.u32_at(cmap + 12);
+        for (u32 i = 0; i < group_count; ++i) {
+            const u32 group = cmap + 16 + 12 * i;
+            const u32 start = reader.u32_at(group);
+            const u32 end = reader.u32_at(group + 4);
+            if (codepoint >= start && codepoint <= end) {
+                return reader.u32_at(group + 8) + (codepoint - start);
+            }
+        }
+        return 0;
+    }
+
+    if (codepoint > 0xffff) {
+        return 0;
+    }
+
+    const u32 segment_count = reader.u16_at(cmap + 6) / 2;
+    const u32 end_codes = cmap + 14;
+    const u32 start_codes = end_codes + 2 * segment_count + 2;
+    const u32 deltas = start_codes + 2 * segment_count;
+    const u32 range_offsets = deltas + 2 * segment_count;
+
+    for (u32 i = 0; i < segment_count; ++i) {
+        if (codepoint > reader.u16_at(end_codes + 2 * i)) {
+            continue;
+        }
+
+        const u32 start = reader.u16_at(start_codes + 2 * i);
+        if (codepoint < start) {
+            return 0;
+        }
+
+        const u32 delta = reader.u16_at(deltas + 2 * i);
+        const u32 range_offset = reader.u16_at(range_offsets + 2 * i);
+        if (range_offset == 0) {
+            return (codepoint + delta) & 0xffff;
+        }
+
+        const u32 glyph = reader.u16_at(range_offsets + 2 * i + range_offset + 2 * (codepoint - start));
+        return glyph != 0 ? (glyph + delta) & 0xffff : 0;
+    }
+    return 0;
+}
+
+u32 TrueTypeFont::get_advance(const u32 glyph) const {
+    const FontReader reader{data};
+    return reader.u16_at(hmtx + 4 * std::min(glyph, h_metric_count - 1));
+}
+
+void TrueTypeFont::get_outline(const u32 glyph, GlyphOutline& outline) const {
+    outline.points.clear();
+    outline.contour_offsets = {0};
+
+    const f32 identity[6] = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+    append_outline(glyph, identity, outline, 0);
+}
+
+void TrueTypeFont::append_outline(const u32 glyph, const f32 transform[6], GlyphOutline& outline,
+                                  const u32 depth) const {
+    if (glyph >= glyph_count || depth > max_composite_depth) {
+        return;
+    }
+
+    const FontReader reader{data};
+    const u32 begin = long_loca ? reader.u32_at(loca + 4 * glyph) : 2 * u32(reader.u16_at(loca + 2 * glyph));
+    const u32 end = long_loca ? reader.u32_at(loca + 4 * glyph + 4) : 2 * u32(reader.u16_at(loca + 2 * glyph + 2));
+    if (end <= begin) {
+        return;
+    }
+
+    const u32 offset = glyf + begin;
+    const i32 contour_count = reader.i16_at(offset);
+
+    if (contour_count < 0) {
+        // Composite glyph: each component is another glyph with an affine transform.
+        constexpr u16 args_are_words = 0x1;
+        constexpr u16 args_are_xy = 0x2;
+        constexpr u16 have_scale = 0x8;
+        constexpr u16 more_components = 0x20;
+        constexpr u16 have_xy_scale = 0x40;
+        constexpr u16 have_2x2 = 0x80;
+
+        u32 p = offset + 10;
+        u16 flags;
+        do {
+            flags = reader.u16_at(p);
+            const u32 component = reader.u16_at(p + 2);
+            p += 4;
+
+            f32 arg1;
+            f32 arg2;
+            if (flags & args_are_words) {
+                arg1 = reader.i16_at(p);
+                arg2 = reader.i16_at(p + 2);
+                p += 4;
+            } else {
+                arg1 = static_cast<i8>(reader.u8_at(p));
+                arg2 = static_cast<i8>(reader.u8_at(p + 1));
+                p += 2;
+            }
+
+            f32 child[6] = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+            if (flags & have_scale) {
+                child[0] = child[3] = reader.f2dot14_at(p);
+                p += 2;
+            } else if (flags & have_xy_scale) {
+                child[0] = reader.f2dot14_at(p);
+                child[3] = reader.f2dot14_at(p + 2);
+                p += 4;
+            } else if (flags & have_2x2) {
+                child[0] = reader.f2dot14_at(p);
+                child[1] = reader.f2dot14_at(p + 2);
+                child[2] = reader.f2dot14_at(p + 4);
+                child[3] = reader.f2dot14_at(p + 6);
+                p += 8;
+            }
+
+            // Components positioned by matching points are rare in Latin fonts, and are placed unshifted.
+            if (flags & args_are_xy) {
+                child[4] = arg1;
+                child[5] = arg2;
+            }
+
+            const f32* const t = transform;
+            const f32 combined[6] = {
+                    t[0] * child[0] + t[2] * child[1],        t[1] * child[0] + t[3] * child[1],
+                    t[0] * child[2] + t[2] * child[3],        t[1] * child[2] + t[3] * child[3],
+                    t[0] * child[4] + t[2] * child[5] + t[4], t[1] * child[4] + t[3] * child[5] + t[5],
+            };
+            append_outline(component, combined, outline, depth + 1);
+        } while (flags & more_components);
+        return;
+    }
+
+    // Simple glyph: contour end points, instructions, then run-length encoded flags and delta-encoded coordinates.
+    constexpr u8 on_curve = 0x1;
+    constexpr u8 x_short = 0x2;
+    constexpr u8 y_short = 0x4;
+    constexpr u8 repeat = 0x8;
+    constexpr u8 x_same_or_positive = 0x10;
+    constexpr u8 y_same_or_positive = 0x20;
+
+    const u32 end_points = offset + 10;
+    const u32 contours = static_cast<u32>(contour_count);
+    if (contours == 0) {
+        return;
+    }
+    const u32 point_count = u32(reader.u16_at(end_points + 2 * (contours - 1))) + 1;
+    u32 p = end_points + 2 * contours;
+    p += 2u + reader.u16_at(p);
+
+    std::vector<u8> flags(point_count);
+    for (u32 i = 0; i < point_count;) {
+        const u8 flag = reader.u8_at(p++);
+        flags[i++] = flag;
+        if (flag & repeat) {
+            for (u32 count = reader.u8_at(p++); count > 0 && i < point_count; --count) {
+                flags[i++] = flag;
+            }
+        }
+    }
+
+    std::vector<glm::vec2> points(point_count);
+    i32 x = 0;
+    for (u32 i = 0; i < point_count; ++i) {
+        if (flags[i] & x_short) {
+            const i32 dx = reader.u8_at(p++);
+            x += flags[i] & x_same_or_positive ? dx : -dx;
+        } else if (!(flags[i] & x_same_or_positive)) {
+            x += reader.i16_at(p);
+            p += 2;
+        }
+        points[i].x = static_cast<f32>(x);
+    }
+    i32 y = 0;
+    for (u32 i = 0; i < point_count; ++i) {
+        if (flags[i] & y_short) {
+            const i32 dy = reader.u8_at(p++);
+            y += flags[i] & y_same_or_positive ? dy : -dy;
+        } else if (!(flags[i] & y_same_or_positive)) {
+            y += reader.i16_at(p);
+            p += 2;
+        }
+        points[i].y = static_cast<f32>(y);
+    }
+
+    for (glm::vec2& point : points) {
+        point = {transform[0] * point.x + transform[2] * point.y + transform[4],
+                 transform[1] * point.x + transform[3] * point.y + transform[5]};
+    }
+
+    // Consecutive off-curve points have an implied on-curve point half way between them.
+    u32 first = 0;
+    for (u32 contour = 0; contour < contours; ++contour) {
+        const u32 last = std::min<u32>(reader.u16_at(end_points + 2 * contour), point_count - 1);
+        if (last < first) {
+            break;
+        }
+        const u32 size = last - first + 1;
+
+        u32 start = 0;
+        while (start < size && !(flags[first + start] & on_curve)) {
+            ++start;
+        }
+
+        glm::vec2 start_point;
+        if (start < size) {
+            start_point = points[first + start];
+        } else {
+            start_point = 0.5f * (points[first] + points[first + (size > 1 ? 1 : 0)]);
+        }
+
+        outline.points.push_back(start_point);
+        glm::vec2 previous = start_point;
+        bool has_control = false;
+        glm::vec2 control;
+
+        for (u32 i = 1; i <= size; ++i) {
+            const u32 index = first + (start + i) % size;
+            const glm::vec2 point = points[index];
+            const bool on = flags[index] & on_curve;
+
+            if (on) {
+                if (has_control) {
+                    append_quadratic(outline, previous, control, point);
+                } else {
+                    outline.points.push_back(point);
+                }
+                previous = point;
+                has_control = false;
+            } else if (has_control) {
+                const glm::vec2 middle = 0.5f * (control + point);
+                append_quadratic(outline, previous, control, middle);
+                previous = middle;
+                control = point;
+            } else {
+                control = point;
+                has_control = true;
+            }
+        }
+        if (has_control) {
+            append_quadratic(outline, previous, control, start_point);
+        }
+
+        // The contour is closed implicitly, so drop the repeated start point.
+        outline.points.pop_back();
+        outline.contour_offsets.push_back(static_cast<u32>(outline.points.size()));
+        first = last + 1;
+    }
+}
+
+bool FontAtlas::init(const Path& font_path, const Path& cache_path, ThreadPool& thread_pool) {
+    if (!std::filesystem::exists(font_path)) {
+        LOG_F(WARNING, "Font not found: {}", font_path.string());
+        return false;
+    }
+
+    const CacheKey key = make_cache_key(font_path, get_params());
+    if (read_cache(cache_path, key)) {
+        DPRINT("Loaded font atlas from cache");
+    } else {
+        if (!build(font_path, thread_pool)) {
+            LOG_F(WARNING, "Failed to load font: {}", font_path.string());
+            return false;
+        }
+        write_cache(cache_path, key);
+    }
+
+    glyph_indices.clear();
+    for (u32 i = 0; i < glyphs.size(); ++i) {
+        glyph_indices.emplace(glyphs[i].codepoint, i);
+    }
+    return glyph_indices.count('?') != 0;
+}
+
+bool FontAtlas::build(const Path& font_path, ThreadPool& thread_pool) {
+    TrueTypeFont font;
+    if (!font.load(font_path)) {
+        return false;
+    }
+
+    const f32 units_to_em = 1.0f / static_cast<f32>(font.units_per_em);
+    const f32 units_to_px = static_cast<f32>(em_size) * units_to_em;
+    ascender = static_cast<f32>(font.ascender) * units_to_em;
+    descender = static_cast<f32>(font.descender) * units_to_em;
+
+    glyphs.clear();
+    std::vector<GlyphOutline> outlines;
+    // Pixel bounds of each glyph's distance field, before packing.
+    std::vector<glm::ivec2> origins;
+
+    for (const auto& range : charset) {
+        for (u32 codepoint = range[0]; codepoint <= range[1]; ++codepoint) {
+            const u32 index = font.get_glyph_index(codepoint);
+            if (index == 0 && codepoint != '?') {
+                continue;
+            }
+
+            GlyphOutline outline;
+            font.get_outline(index, outline);
+            for (glm::vec2& point : outline.points) {
+                point *= units_to_px;
+            }
+
+            Glyph glyph = {};
+            glyph.codepoint = codepoint;
+            glyph.advance = static_cast<f32>(font.get_advance(index)) * units_to_em;
+
+            glm::ivec2 origin = {0, 0};
+            if (!outline.points.empty()) {
+                glm::vec2 min = outline.points[0];
+                glm::vec2 max = outline.points[0];
+                for (const glm::vec2& point : outline.points) {
+                    min = glm::min(min, point);
+                    max = glm::max(max, point);
+                }
+
+                const i32 range_px = sdf_range;
+                origin = {static_cast<i32>(std::floor(min.x)) - range_px, static_cast<i32>(std::floor(min.y)) - range_px};
+                const glm::ivec2 end = {static_cast<i32>(std::ceil(max.x)) + range_px,
+                                        static_cast<i32>(std::ceil(max.y)) + range_px};
+                glyph.atlas_width = static_cast<u16>(end.x - origin.x);
+                glyph.atlas_height = static_cast<u16>(end.y - origin.y);
+
+                glyph.left = static_cast<f32>(origin.x) / em_size;
+                glyph.bottom = static_cast<f32>(origin.y) / em_size;
+                glyph.right = static_cast<f32>(end.x) / em_size;
+                glyph.top = static_cast<f32>(end.y) / em_size;
+            }
+
+            glyphs.push_back(glyph);
+            outlines.push_back(std::move(outline));
+            origins.push_back(origin);
+        }
+    }
+
+    // Shelf packing, tallest first, with a texel of padding so that bilinear filtering never reads a neighbour.
+    std::vector<u32> order(glyphs.size());
+    for (u32 i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+              [&](const u32 a, const u32 b) { return glyphs[a].atlas_height > glyphs[b].atlas_height; });
+
+    u32 x = 0;
+    u32 shelf_y = 0;
+    u32 shelf_height = 0;
+    for (const u32 i : order) {
+        Glyph& glyph = glyphs[i];
+        if (glyph.atlas_width == 0) {
+            continue;
+        }
+        CHECK_F(glyph.atlas_width + 1u <= width, "Glyph too large for the font atlas");
+
+        if (x + glyph.atlas_width + 1 > width) {
+            shelf_y += shelf_height;
+            x = 0;
+            shelf_height = 0;
+        }
+        glyph.atlas_x = static_cast<u16>(x + 1);
+        glyph.atlas_y = static_cast<u16>(shelf_y + 1);
+        x += glyph.atlas_width + 1u;
+        shelf_height = std::max<u32>(shelf_height, glyph.atlas_height + 1u);
+    }
+    height = (shelf_y + shelf_height + 1 + 15) / 16 * 16;
+    CHECK_F(height <= 0xffff);
+
+    // Glyphs occupy disjoint rectangles, so they can be rendered in parallel.
+    pixels.assign(size_t(width) * height, 0);
+    thread_pool.parallel_for(glyphs.size(), 1, [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const Glyph& glyph = glyphs[i];
+            for (u32 row = 0; row < glyph.atlas_height; ++row) {
+                u8* const dst = &pixels[(size_t(glyph.atlas_y) + row) * width + glyph.atlas_x];
+                for (u32 column = 0; column < glyph.atlas_width; ++column) {
+                    const glm::vec2 p = {static_cast<f32>(origins[i].x) + static_cast<f32>(column) + 0.5f,
+                                         static_cast<f32>(origins[i].y) + static_cast<f32>(row) + 0.5f};
+                    const f32 distance = signed_distance(outlines[i], p);
+                    const f32 value = 127.5f + distance / static_cast<f32>(sdf_range) * 127.5f;
+                    dst[column] = static_cast<u8>(std::clamp(value, 0.0f, 255.0f));
+                }
+            }
+        }
+    });
+
+    LOG_F(INFO, "Built {}x{} font atlas with {} glyphs", width, height, glyphs.size());
+    return true;
+}
+
+bool FontAtlas::read_cache(const Path& path, const CacheKey& key) {
+    BinaryReader reader;
+    if (!reader.open(path, font_cache_kind, font_cache_version, key)) {
+        return false;
+    }
+
+    const bool ok = reader.read(height) && reader.read(ascender) && reader.read(descender) &&
+                    reader.read_vector(glyphs) && reader.read_vector(pixels) && reader.at_end() &&
+                    pixels.size() == size_t(width) * height;
+    if (!ok) {
+        LOG_F(WARNING, "Ignoring invalid font atlas cache {}", path.string());
+    }
+    return ok;
+}
+
+void FontAtlas::write_cache(const Path& path, const CacheKey& key) const {
+    BinaryWriter writer(path, font_cache_kind, font_cache_version, key);
+    writer.write(height);
+    writer.write(ascender);
+    writer.write(descender);
+    writer.write_vector(glyphs);
+    writer.write_vector(pixels);
+    if (!writer.finish()) {
+        LOG_F(WARNING, "Failed to write font atlas cache {}", path.string());
+    }
+}
+
+const Glyph& FontAtlas::get_glyph(const u32 codepoint) const {
+    auto it = glyph_indices.find(codepoint);
+    if (it == glyph_indices.end()) {
+        it = glyph_indices.find('?');
+    }
+    return glyphs[it->second];
+}
+
+f32 FontAtlas::measure(const char* text) const {
+    f32 result = 0.0f;
+    while (*text != '\0') {
+        result += get_glyph(decode_utf8(text)).advance;
+    }
+    return result;
+}
+
+u32 decode_utf8(const char*& str) {
+    constexpr u32 replacement = 0xfffd;
+
+    const u8 lead = static_cast<u8>(*str++);
+    if (lead < 0x80) {
+        return lead;
+    }
+
+    u32 length;
+    u32 result;
+    if ((lead & 0xe0) == 0xc0) {
+        length = 1;
+        result = lead & 0x1fu;
+    } else if ((lead & 0xf0) == 0xe0) {
+        length = 2;
+        result = lead & 0x0fu;
+    } else if ((lead & 0xf8) == 0xf0) {
+        length = 3;
+        result = lead & 0x07u;
+    } else {
+        return replacement;
+    }
+
+    for (u32 i = 0; i < length; ++i) {
+        const u8 byte = static_cast<u8>(*str);
+        if ((byte & 0xc0) != 0x80) {
+            return replacement;
+        }
+        result = result << 6 | (byte & 0x3fu);
+        ++str;
+    }
+    return result;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "cache.hpp"
+#include "filesystem.hpp"
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
+#include <glm/vec2.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+// Outline of a glyph as closed polylines in font units, with quadratic curves already flattened.
+struct GlyphOutline {
+    std::vector<glm::vec2> points;
+    std::vector<u32> contour_offsets = {0};
+};
+
+// Minimal TrueType reader: enough of `cmap`, `head`, `hhea`, `hmtx`, `loca` and `glyf` to get outlines and advances.
+// Hinting, kerning and CFF outlines are not supported.
+struct TrueTypeFont {
+    std::vector<u8> data;
+
+    u32 units_per_em = 0;
+    i32 ascender = 0;
+    i32 descender = 0;
+    u32 glyph_count = 0;
+
+    // Returns false if the file is missing or isn't a TrueType font.
+    bool load(const Path& path);
+
+    // Returns 0, the missing glyph, if the font has no glyph for `codepoint`.
+    u32 get_glyph_index(u32 codepoint) const;
+
+    u32 get_advance(u32 glyph) const;
+    void get_outline(u32 glyph, GlyphOutline& outline) const;
+
+private:
+    u32 cmap = 0;
+    u32 cmap_format = 0;
+    u32 loca = 0;
+    u32 glyf = 0;
+    u32 hmtx = 0;
+    u32 h_metric_count = 0;
+    bool long_loca = false;
+
+    void append_outline(u32 glyph, const f32 transform[6], GlyphOutline& outline, u32 depth) const;
+};
+
+// Where a glyph is in the atlas and how to place it, in ems relative to the pen position on the baseline.
+struct Glyph {
+    u32 codepoint;
+    f32 advance;
+    f32 left;
+    f32 bottom;
+    f32 right;
+    f32 top;
+    // Atlas rectangle in texels.
+    u16 atlas_x;
+    u16 atlas_y;
+    u16 atlas_width;
+    u16 atlas_height;
+};
+
+// Single-channel signed distance field atlas of a fixed character set. Texel values map distances of
+// `-sdf_range..sdf_range` atlas pixels from the outline to 0..255, with the outline at 128, so text stays sharp at any
+// scale with a simple threshold in the fragment shader.
+struct FontAtlas {
+    static constexpr u32 em_size = 48;
+    static constexpr u32 sdf_range = 6;
+    static constexpr u32 width = 1024;
+
+    u32 height = 0;
+    std::vector<u8> pixels;
+
+    f32 ascender = 0.0f;
+    f32 descender = 0.0f;
+    std::vector<Glyph> glyphs;
+    std::unordered_map<u32, u32> glyph_indices;
+
+    // Loads the atlas from `cache_path` if it was built from the current `font_path`, otherwise builds it from the font
+    // and writes a new cache. Returns false if there is no usable font.
+    bool init(const Path& font_path, const Path& cache_path, ThreadPool& thread_pool);
+
+    bool build(const Path& font_path, ThreadPool& thread_pool);
+    bool read_cache(const Path& path, const CacheKey& key);
+    void write_cache(const Path& path, const CacheKey& key) const;
+
+    // Falls back to '?' for characters outside the atlas.
+    const Glyph& get_glyph(u32 codepoint) const;
+
+    // Width of `text` in ems.
+    f32 measure(const char* text) const;
+};
+
+// Decodes the next code point of a UTF-8 string and advances `str` past it. Invalid bytes decode as U+FFFD.
+u32 decode_utf8(const char*& str);
@@ -0,0 +1,65 @@
+#include "geometry.hpp"
+
+#include "reproject.hpp"
+
+void ProvinceGeometry::load_layer(OGRLayer* const layer, const ProvinceTable& provinces,
+                                  ThreadPool& thread_pool) {
+    *this = ProvinceGeometry();
+
+    ProvinceId province = 0;
+    for (auto& feature : layer) {
+        CHECK_F(feature->GetGeomFieldCount() == 1);
+        CHECK_F(provinces.get_province(feature->GetFID()) == province);
+        ++province;
+
+        OGRGeometry* geom = feature->GetGeometryRef();
+        CHECK_F(geom->getGeometryType() == wkbMultiPolygon);
+
+        OGRMultiPolygon* multi_poly = geom->toMultiPolygon();
+        CHECK_F(multi_poly->getNumGeometries() > 0);
+
+        for (auto& poly : multi_poly) {
+            CHECK_NOTNULL_F(poly->getExteriorRing());
+
+            for (auto& ring : poly) {
+                CHECK_F(ring->getNumPoints() > 0);
+
+                for (auto& point : ring) {
+                    CHECK_F(!point.Is3D());
+                    points.push_back({point.getX(), point.getY()});
+                }
+                ring_offsets.push_back(static_cast<u32>(points.size()));
+            }
+            polygon_offsets.push_back(ring_count());
+        }
+        province_offsets.push_back(polygon_count());
+    }
+
+    CHECK_F(province_count() == provinces.count);
+
+    Reprojector reprojector;
+    if (reprojector.init(layer->GetSpatialRef(), thread_pool)) {
+        CHECK_F(reprojector.transform(points, thread_pool) == 0);
+        reprojector.destroy();
+    }
+
+    for (const glm::dvec2& point : points) {
+        CHECK_F(point.y >= -90 && point.y <= 90);
+        CHECK_F(point.x >= -180 && point.x <= 180);
+    }
+
+    DEXPR(points.size());
+    DEXPR(polygon_count());
+}
+
+u32 ProvinceGeometry::province_count() const {
+    return static_cast<u32>(province_offsets.size() - 1);
+}
+
+u32 ProvinceGeometry::polygon_count() const {
+    return static_cast<u32>(polygon_offsets.size() - 1);
+}
+
+u32 ProvinceGeometry::ring_count() const {
+    return static_cast<u32>(ring_offsets.size() - 1);
+}
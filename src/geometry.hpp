@@ -0,0 +1,52 @@
+#pragma once
+
+#include "province.hpp"
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <ogrsf_frmts.h>
+
+#include <vector>
+
+// Position on the unit sphere for a longitude and latitude in degrees. This is the projection used by the planet mesh.
+inline glm::dvec3 lon_lat_to_sphere(const f64 longitude, const f64 latitude) {
+    const f64 azimuth = glm::radians(-longitude + 180);
+    const f64 inclination = glm::radians(-latitude + 90);
+    return {std::sin(inclination) * std::cos(azimuth), std::cos(inclination),
+            std::sin(inclination) * std::sin(azimuth)};
+}
+
+// Longitude and latitude in degrees of a point on the unit sphere. The inverse of `lon_lat_to_sphere`.
+inline glm::dvec2 sphere_to_lon_lat(const glm::dvec3& point) {
+    f64 longitude = 180.0 - glm::degrees(std::atan2(point.z, point.x));
+    if (longitude > 180.0) {
+        longitude -= 360.0;
+    }
+    return {longitude, glm::degrees(std::asin(std::clamp(point.y, -1.0, 1.0)))};
+}
+
+// Angle between two unit vectors, i.e. the great-circle distance on the unit sphere.
+inline f64 great_circle_distance(const glm::dvec3& a, const glm::dvec3& b) {
+    return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+}
+
+// Outlines of every province as longitude/latitude points in degrees, stored as flat arrays. Each array of offsets has
+// one more entry than the number of elements it describes; the first ring of each polygon is its exterior ring.
+struct ProvinceGeometry {
+    std::vector<glm::dvec2> points;
+    std::vector<u32> ring_offsets = {0};
+    std::vector<u32> polygon_offsets = {0};
+    std::vector<u32> province_offsets = {0};
+
+    // Provinces are read in the same order as `ProvinceTable`. Layers in any CRS other than WGS 84 longitude/latitude
+    // are reprojected to it.
+    void load_layer(OGRLayer* layer, const ProvinceTable& provinces, ThreadPool& thread_pool);
+
+    u32 province_count() const;
+    u32 polygon_count() const;
+    u32 ring_count() const;
+};
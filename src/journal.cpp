@@ -0,0 +1,244 @@
+#include "journal.hpp"
+
+namespace {
+
+constexpr u32 journal_magic = 0x4e4a5357; // "WSJN"
+constexpr u32 journal_version = 1;
+
+// The buffer is written out when it grows past this, so a crash loses at most this much of the journal.
+constexpr size_t flush_size = 4096;
+
+void write_varint(std::vector<u8>& buffer, u64 value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<u8>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<u8>(value));
+}
+
+// Zigzag encoding keeps small negative values, like GLFW_KEY_UNKNOWN, short.
+void write_varint_signed(std::vector<u8>& buffer, const i32 value) {
+    write_varint(buffer, static_cast<u32>(value) << 1 ^ static_cast<u32>(value >> 31));
+}
+
+template <class T>
+void write_raw(std::vector<u8>& buffer, const T& value) {
+    const size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+struct ByteReader {
+    const std::vector<u8>& data;
+    size_t& pos;
+    bool ok = true;
+
+    u64 varint() {
+        u64 result = 0;
+        for (u32 shift = 0; shift < 64; shift += 7) {
+            if (pos == data.size()) {
+                break;
+            }
+            const u8 byte = data[pos++];
+            result |= u64(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return result;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    i32 varint_signed() {
+        const u32 value = static_cast<u32>(varint());
+        return static_cast<i32>(value >> 1 ^ (0u - (value & 1)));
+    }
+
+    template <class T>
+    T raw() {
+        T result = {};
+        if (data.size() - pos < sizeof(T)) {
+            ok = false;
+            return result;
+        }
+        memcpy(&result, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return result;
+    }
+};
+} // namespace
+
+bool JournalWriter::open(const Path& path, const u64 seed) {
+    stream.open(path, std::ios::binary | std::ios::trunc);
+    if (!stream) {
+        return false;
+    }
+
+    buffer.clear();
+    last_tick = 0;
+    write_raw(buffer, journal_magic);
+    write_raw(buffer, journal_version);
+    write_raw(buffer, seed);
+    flush();
+    return true;
+}
+
+bool JournalWriter::is_open() const {
+    return stream.is_open();
+}
+
+void JournalWriter::record(const u64 tick, const InputEvent& event) {
+    CHECK_F(tick >= last_tick);
+    write_varint(buffer, tick - last_tick);
+    last_tick = tick;
+    buffer.push_back(static_cast<u8>(event.type));
+
+    switch (event.type) {
+    case InputType::key:
+    case InputType::mouse_button:
+        write_varint_signed(buffer, event.code);
+        write_varint_signed(buffer, event.action);
+        write_varint_signed(buffer, event.mods);
+        break;
+
+    case InputType::cursor_pos:
+    case InputType::scroll:
+        write_raw(buffer, event.x);
+        write_raw(buffer, event.y);
+        break;
+
+    case InputType::command:
+        write_varint_signed(buffer, event.code);
+        write_varint(buffer, event.data.size());
+        buffer.insert(buffer.end(), event.data.begin(), event.data.end());
+        break;
+
+    case InputType::end:
+        ABORT_F("End events are written by close()");
+    }
+
+    if (buffer.size() >= flush_size) {
+        flush();
+    }
+}
+
+void JournalWriter::close(const u64 tick, const u64 tick_hash) {
+    if (!is_open()) {
+        return;
+    }
+
+    write_varint(buffer, tick - last_tick);
+    buffer.push_back(static_cast<u8>(InputType::end));
+    write_raw(buffer, tick_hash);
+    flush();
+    stream.close();
+}
+
+void JournalWriter::flush() {
+    stream.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    stream.flush();
+    buffer.clear();
+}
+
+bool JournalReader::open(const Path& path) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+
+    pos = 0;
+    ByteReader reader{data, pos};
+    const u32 magic = reader.raw<u32>();
+    const u32 version = reader.raw<u32>();
+    seed = reader.raw<u64>();
+    if (!reader.ok || magic != journal_magic || version != journal_version) {
+        data.clear();
+        return false;
+    }
+
+    next_tick = 0;
+    has_end = false;
+    read_next();
+    return true;
+}
+
+bool JournalReader::is_open() const {
+    return !data.empty();
+}
+
+bool JournalReader::pop(const u64 tick, InputEvent& event) {
+    if (!has_next || next_tick > tick) {
+        return false;
+    }
+
+    event = std::move(next_event);
+    read_next();
+    return true;
+}
+
+bool JournalReader::finished(const u64 tick) const {
+    return !has_next && (!has_end || tick >= end_tick);
+}
+
+void JournalReader::read_next() {
+    has_next = false;
+    if (pos == data.size()) {
+        return;
+    }
+
+    ByteReader reader{data, pos};
+    const u64 tick = next_tick + reader.varint();
+    const InputType type = static_cast<InputType>(reader.raw<u8>());
+
+    InputEvent event;
+    event.type = type;
+    switch (type) {
+    case InputType::key:
+    case InputType::mouse_button:
+        event.code = reader.varint_signed();
+        event.action = reader.varint_signed();
+        event.mods = reader.varint_signed();
+        break;
+
+    case InputType::cursor_pos:
+    case InputType::scroll:
+        event.x = reader.raw<f64>();
+        event.y = reader.raw<f64>();
+        break;
+
+    case InputType::command: {
+        event.code = reader.varint_signed();
+        const u64 size = reader.varint();
+        if (!reader.ok || size > data.size() - pos) {
+            reader.ok = false;
+            break;
+        }
+        const auto begin = data.begin() + static_cast<std::ptrdiff_t>(pos);
+        event.data.assign(begin, begin + static_cast<std::ptrdiff_t>(size));
+        pos += size;
+    } break;
+
+    case InputType::end:
+        end_hash = reader.raw<u64>();
+        if (reader.ok) {
+            has_end = true;
+            end_tick = tick;
+        }
+        return;
+
+    default:
+        reader.ok = false;
+        break;
+    }
+
+    if (!reader.ok) {
+        LOG_F(WARNING, "Journal is truncated or corrupt after tick {}", next_tick);
+        pos = data.size();
+        return;
+    }
+
+    has_next = true;
+    next_tick = tick;
+    next_event = std::move(event);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "utility.hpp"
+
+#include <fstream>
+#include <vector>
+
+// A journal records every input to the app with the tick it was applied before, so that replaying it from the same
+// seed reproduces the session exactly.
+//
+// The file is a header followed by a stream of events. Each event is a varint tick delta since the previous event, a
+// type byte and a type-specific payload. An `end` event with the final tick and tick hash closes the journal; a
+// journal cut short by a crash is still replayable up to its last complete event.
+
+enum class InputType : u8 {
+    key,
+    mouse_button,
+    cursor_pos,
+    scroll,
+    // A simulation command, with an opaque payload.
+    command,
+    end,
+};
+
+struct InputEvent {
+    InputType type = InputType::key;
+    // key: key, action and mods. mouse_button: button, action and mods. command: type in `code`.
+    i32 code = 0;
+    i32 action = 0;
+    i32 mods = 0;
+    // cursor_pos: position. scroll: offsets.
+    f64 x = 0.0;
+    f64 y = 0.0;
+    std::vector<u8> data;
+};
+
+struct JournalWriter {
+    std::ofstream stream;
+    std::vector<u8> buffer;
+    u64 last_tick = 0;
+
+    bool open(const Path& path, u64 seed);
+    bool is_open() const;
+
+    void record(u64 tick, const InputEvent& event);
+
+    // Writes the end event and closes the file.
+    void close(u64 tick, u64 tick_hash);
+
+private:
+    void flush();
+};
+
+struct JournalReader {
+    std::vector<u8> data;
+    size_t pos = 0;
+    u64 seed = 0;
+
+    // The next event, read ahead so that its tick is known.
+    bool has_next = false;
+    u64 next_tick = 0;
+    InputEvent next_event;
+
+    bool has_end = false;
+    u64 end_tick = 0;
+    u64 end_hash = 0;
+
+    // Returns false if the file is missing or isn't a journal.
+    bool open(const Path& path);
+    bool is_open() const;
+
+    // Pops the next event if it is to be applied before `tick`. Returns false once all events for `tick` are done.
+    bool pop(u64 tick, InputEvent& event);
+
+    // True once every event has been applied and the recording's last tick has been reached.
+    bool finished(u64 tick) const;
+
+private:
+    void read_next();
+};
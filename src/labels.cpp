@@ -0,0 +1,231 @@
+#include "labels.hpp"
+
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+#include <glm/vector_relational.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+void LabelPlacer::init(const std::vector<Label>& labels, const LabelPlacementConfig& config) {
+    this->config = config;
+
+    priority_order.resize(labels.size());
+    for (u32 i = 0; i < priority_order.size(); ++i) {
+        priority_order[i] = i;
+    }
+    std::stable_sort(priority_order.begin(), priority_order.end(),
+                     [&](const u32 a, const u32 b) { return labels[a].priority > labels[b].priority; });
+
+    placed.assign(labels.size(), 0);
+    opacity.assign(labels.size(), 0.0f);
+    solved = false;
+    last_update = std::chrono::steady_clock::now();
+}
+
+bool LabelPlacer::update(const std::vector<Label>& labels, const LabelView& view) {
+    const auto now = std::chrono::steady_clock::now();
+    // Nothing is drawn while the app is idle, so a long gap is treated as a single frame.
+    const f32 elapsed_s = std::min(std::chrono::duration<f32>(now - last_update).count(), 0.1f);
+    last_update = now;
+    return update(labels, view, elapsed_s);
+}
+
+bool LabelPlacer::update(const std::vector<Label>& labels, const LabelView& view, const f32 elapsed_s) {
+    const bool solving = needs_solve(view);
+    if (solving) {
+        solve(labels, view);
+    }
+
+    const f32 step = config.fade_s > 0.0f ? elapsed_s / config.fade_s : 1.0f;
+    fading_count = 0;
+    for (size_t i = 0; i < opacity.size(); ++i) {
+        const f32 target = placed[i] ? 1.0f : 0.0f;
+        const f32 difference = target - opacity[i];
+        if (std::abs(difference) > step) {
+            opacity[i] += std::copysign(step, difference);
+            ++fading_count;
+        } else {
+            opacity[i] = target;
+        }
+    }
+
+    return solving;
+}
+
+bool LabelPlacer::needs_solve(const LabelView& view) const {
+    if (!solved || glm::any(glm::notEqual(view.viewport, solved_view.viewport))) {
+        return true;
+    }
+
+    const f32 old_distance = glm::length(solved_view.camera_pos);
+    const f32 new_distance = glm::length(view.camera_pos);
+    if (std::abs(std::log(new_distance / old_distance)) > config.resolve_zoom ||
+        std::abs(std::log(view.focal_pixels / solved_view.focal_pixels)) > config.resolve_zoom) {
+        return true;
+    }
+
+    // How far the surface under the camera has moved on screen.
+    const f32 angle = std::atan2(glm::length(glm::cross(view.camera_pos, solved_view.camera_pos)),
+                                 glm::dot(view.camera_pos, solved_view.camera_pos));
+    const f32 altitude = std::max(new_distance - 1.0f, 1e-3f);
+    return angle / altitude * view.focal_pixels > config.resolve_pixels;
+}
+
+void LabelPlacer::solve(const std::vector<Label>& labels, const LabelView& view) {
+    const auto start_time = std::chrono::steady_clock::now();
+
+    grid_width = std::max(1u, static_cast<u32>(std::ceil(static_cast<f32>(view.viewport.x) / config.cell_size)));
+    grid_height = std::max(1u, static_cast<u32>(std::ceil(static_cast<f32>(view.viewport.y) / config.cell_size)));
+    cells.resize(size_t(grid_width) * grid_height);
+    for (std::vector<u32>& cell : cells) {
+        cell.clear();
+    }
+    rects.clear();
+
+    // Labels already showing are placed first, so they keep their place unless they have left the screen or changed
+    // size too much, and a new label never pushes out one that is showing.
+    std::vector<u8> next_placed(labels.size(), 0);
+    for (const bool showing : {true, false}) {
+        for (const u32 i : priority_order) {
+            if (bool(placed[i]) != showing) {
+                continue;
+            }
+
+            glm::vec4 rect;
+            if (get_rect(labels[i], view, rect) && try_place(rect)) {
+                next_placed[i] = 1;
+            }
+        }
+    }
+    placed = std::move(next_placed);
+
+    solved = true;
+    solved_view = view;
+    ++solve_count;
+    last_solve_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+bool LabelPlacer::get_rect(const Label& label, const LabelView& view, glm::vec4& rect) const {
+    // Facing away on the far side of the planet
+    const glm::vec3 to_camera = view.camera_pos - label.position;
+    if (glm::dot(label.position, to_camera) <= 0.0f) {
+        return false;
+    }
+
+    const f32 pixels = label.em_height / glm::length(to_camera) * view.focal_pixels;
+    if (pixels < label.min_pixels || pixels > label.max_pixels) {
+        return false;
+    }
+
+    rect = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+    for (const glm::vec3& point : {label.start, label.position, label.end}) {
+        const glm::vec4 clip = view.view_projection * glm::vec4(point, 1.0f);
+        if (clip.w <= 0.0f) {
+            return false;
+        }
+        const glm::vec2 screen = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * glm::vec2(view.viewport);
+        rect = {glm::min(glm::vec2(rect), screen), glm::max(glm::vec2(rect.z, rect.w), screen)};
+    }
+
+    // Glyph centres are half a line from the top and bottom of the text.
+    const f32 margin = 0.6f * pixels + config.padding;
+    rect += glm::vec4(-margin, -margin, margin, margin);
+
+    return rect.z > 0.0f && rect.w > 0.0f && rect.x < static_cast<f32>(view.viewport.x) &&
+           rect.y < static_cast<f32>(view.viewport.y);
+}
+
+bool LabelPlacer::try_place(const glm::vec4& rect) {
+    const auto to_cell = [&](const f32 value, const u32 size) {
+        return static_cast<u32>(std::clamp(value / config.cell_size, 0.0f, static_cast<f32>(size - 1)));
+    };
+    const u32 x0 = to_cell(rect.x, grid_width);
+    const u32 y0 = to_cell(rect.y, grid_height);
+    const u32 x1 = to_cell(rect.z, grid_width);
+    const u32 y1 = to_cell(rect.w, grid_height);
+
+    for (u32 y = y0; y <= y1; ++y) {
+        for (u32 x = x0; x <= x1; ++x) {
+            for (const u32 other : cells[size_t(y) * grid_width + x]) {
+                const glm::vec4& o = rects[other];
+                if (rect.x < o.z && o.x < rect.z && rect.y < o.w && o.y < rect.w) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    const u32 index = static_cast<u32>(rects.size());
+    rects.push_back(rect);
+    for (u32 y = y0; y <= y1; ++y) {
+        for (u32 x = x0; x <= x1; ++x) {
+            cells[size_t(y) * grid_width + x].push_back(index);
+        }
+    }
+    return true;
+}
+
+void bench_label_placement() {
+    constexpr glm::ivec2 viewport = {1920, 1080};
+    constexpr f32 aspect = static_cast<f32>(viewport.x) / static_cast<f32>(viewport.y);
+    constexpr f32 fovy = glm::radians(60.0f);
+    constexpr u32 solves = 100;
+
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<f32> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<f32> size(0.01f, 0.04f);
+
+    for (const u32 label_count : {1000u, 2000u, 5000u, 10000u, 20000u, 50000u}) {
+        std::vector<Label> labels(label_count);
+        for (Label& label : labels) {
+            glm::vec3 p;
+            do {
+                p = {unit(rng), unit(rng), unit(rng)};
+            } while (glm::length(p) > 1.0f || glm::length(p) < 0.1f);
+            label.position = glm::normalize(p);
+
+            // A straight label about five ems long
+            label.em_height = size(rng);
+            const glm::vec3 east = glm::normalize(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), label.position));
+            label.start = label.position - 2.5f * label.em_height * east;
+            label.end = label.position + 2.5f * label.em_height * east;
+            label.min_pixels = 8.0f;
+            label.max_pixels = 200.0f;
+            label.priority = label.em_height;
+        }
+
+        LabelPlacer placer;
+        placer.init(labels);
+
+        // Orbit the camera, so that every frame moves past the threshold and solves.
+        f64 total_s = 0.0;
+        u32 visible = 0;
+        for (u32 i = 0; i < solves; ++i) {
+            const f32 angle = 0.05f * static_cast<f32>(i);
+            LabelView view;
+            view.camera_pos = glm::vec3(3.0f * std::sin(angle), 0.5f, 3.0f * std::cos(angle));
+            view.viewport = viewport;
+            view.focal_pixels = static_cast<f32>(viewport.y) / (2.0f * std::tan(0.5f * fovy));
+            view.view_projection = glm::perspective(fovy, aspect, 0.01f, 1000.0f) *
+                                   glm::lookAt(view.camera_pos, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+            CHECK_F(placer.update(labels, view, 1.0f / 60.0f));
+            total_s += placer.last_solve_s;
+        }
+        for (const u8 p : placer.placed) {
+            visible += p;
+        }
+
+        // A frame under the threshold only advances the fades.
+        const auto start = std::chrono::steady_clock::now();
+        placer.update(labels, placer.solved_view, 1.0f / 60.0f);
+        const f64 fade_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+        LOG_F(INFO, "Label placement: {} labels, {} placed, {:.3f} ms per solve, {:.3f} ms per frame without solving",
+              label_count, visible, total_s * 1000.0 / solves, fade_s * 1000.0);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "utility.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// A label laid out along a curve on the planet's surface. Its glyphs are placed once, in world space, so each frame
+// only decides which labels to draw.
+struct Label {
+    std::string text;
+    // Middle of the label, and the centres of its first and last glyphs.
+    glm::vec3 position;
+    glm::vec3 start;
+    glm::vec3 end;
+    // Height of an em, in world units.
+    f32 em_height;
+    // The label is only drawn while an em is between these heights on screen.
+    f32 min_pixels;
+    f32 max_pixels;
+    // Higher priority labels are placed first, and win collisions.
+    f32 priority;
+    u32 first_glyph;
+    u32 glyph_count;
+};
+
+struct LabelView {
+    glm::mat4 view_projection;
+    glm::vec3 camera_pos;
+    // Size of the screen in pixels
+    glm::ivec2 viewport;
+    // Screen pixels per world unit at a distance of one.
+    f32 focal_pixels;
+};
+
+struct LabelPlacementConfig {
+    // Size of the screen-space collision grid cells, in pixels.
+    f32 cell_size = 64.0f;
+    // Space kept clear around each label, in pixels.
+    f32 padding = 4.0f;
+    // Placement is only solved again once the camera has moved the surface under it by this many pixels, or zoomed
+    // by this fraction.
+    f32 resolve_pixels = 8.0f;
+    f32 resolve_zoom = 0.05f;
+    f32 fade_s = 0.25f;
+};
+
+// Chooses which labels to show. Labels are placed greedily in priority order into a uniform screen-space grid, so a
+// solve is close to linear in the number of candidate labels. Labels that are already showing are placed before the
+// rest, and the result is kept until the camera moves past a threshold, so labels don't flicker as the view changes.
+// Labels fade in and out as they are placed and dropped.
+struct LabelPlacer {
+    LabelPlacementConfig config;
+
+    // Label indices, highest priority first.
+    std::vector<u32> priority_order;
+    std::vector<u8> placed;
+    std::vector<f32> opacity;
+    // Labels still fading in or out after the last update.
+    u32 fading_count = 0;
+
+    u32 grid_width = 0;
+    u32 grid_height = 0;
+    std::vector<std::vector<u32>> cells;
+    std::vector<glm::vec4> rects;
+
+    bool solved = false;
+    LabelView solved_view;
+    std::chrono::steady_clock::time_point last_update;
+
+    u64 solve_count = 0;
+    f64 last_solve_s = 0.0;
+
+    void init(const std::vector<Label>& labels, const LabelPlacementConfig& config = LabelPlacementConfig());
+
+    // Solves placement again if the view has changed enough, then advances the fades. Returns true if it solved.
+    bool update(const std::vector<Label>& labels, const LabelView& view);
+    bool update(const std::vector<Label>& labels, const LabelView& view, f32 elapsed_s);
+
+    bool needs_solve(const LabelView& view) const;
+    void solve(const std::vector<Label>& labels, const LabelView& view);
+
+private:
+    // Screen rectangle of a label as (min x, min y, max x, max y), or false if it shouldn't be shown at all.
+    bool get_rect(const Label& label, const LabelView& view, glm::vec4& rect) const;
+    bool try_place(const glm::vec4& rect);
+};
+
+// Logs placement time for increasing numbers of synthetic labels.
+void bench_label_placement();
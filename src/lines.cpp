@@ -0,0 +1,130 @@
+#include "lines.hpp"
+
+#include "app.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Bindings of the shader storage blocks in lines.vert
+constexpr u32 segment_binding = 0;
+constexpr u32 style_binding = 1;
+
+// A class's style as read by lines.vert, with the zoom already applied to the width scale
+struct GPULineStyle {
+    f32 width_scale;
+    f32 opacity;
+    u32 first;
+    u32 count;
+};
+
+// Limit on how much lines thicken as the camera approaches the surface
+constexpr f32 max_zoom_scale = 4.0f;
+
+u32 pack_unorm8(const f32 value) {
+    return static_cast<u32>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+} // namespace
+
+void add_polyline(std::vector<LineSegment>& segments, const std::vector<glm::vec3>& points, const f32 width_px,
+                  const u32 color, const bool closed) {
+    if (points.size() < 2) {
+        return;
+    }
+
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+        segments.push_back({points[i], width_px, points[i + 1], color});
+    }
+    if (closed) {
+        segments.push_back({points.back(), width_px, points.front(), color});
+    }
+}
+
+u32 pack_color(const f32 r, const f32 g, const f32 b, const f32 a) {
+    return pack_unorm8(r) | pack_unorm8(g) << 8 | pack_unorm8(b) << 16 | pack_unorm8(a) << 24;
+}
+
+void LineRenderer::init(Renderer& renderer) {
+    const ShaderHandle vert = renderer.add_shader("lines.vert", GL_VERTEX_SHADER);
+    const ShaderHandle frag = renderer.add_shader("lines.frag", GL_FRAGMENT_SHADER);
+    program = renderer.add_shader_program(vert, frag);
+    renderer.shader_programs.get(program).bind_uniform_block(renderer.view_projection_ubo);
+
+    // Instances read everything from the storage buffers, so the VAO has no attributes. Core profile still needs one
+    // bound to draw.
+    glCreateVertexArrays(1, &vao);
+    glCreateBuffers(1, &segment_buffer);
+    glCreateBuffers(1, &style_buffer);
+    glNamedBufferData(style_buffer, sizeof(GPULineStyle) * line_class_count, nullptr, GL_STREAM_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, segment_binding, segment_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, style_binding, style_buffer);
+
+    styles[static_cast<u32>(LineClass::borders)].zoom_exponent = 0.5f;
+    styles[static_cast<u32>(LineClass::rivers)].zoom_exponent = 0.75f;
+    styles[static_cast<u32>(LineClass::routes)].width_scale = 2.0f;
+}
+
+void LineRenderer::destroy() {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &segment_buffer);
+    glDeleteBuffers(1, &style_buffer);
+    *this = LineRenderer();
+}
+
+void LineRenderer::set_segments(const LineClass line_class, std::vector<LineSegment> class_segments) {
+    segments[static_cast<u32>(line_class)] = std::move(class_segments);
+    dirty = true;
+}
+
+void LineRenderer::render(const glm::vec3& camera_pos, const glm::vec2& viewport, const f32 pixel_scale,
+                          RenderQueue& queue) {
+    if (dirty) {
+        // Classes are stored one after the other, so each is drawn from its own range of instances.
+        size_t total = 0;
+        for (u32 i = 0; i < line_class_count; ++i) {
+            first[i] = static_cast<u32>(total);
+            count[i] = static_cast<u32>(segments[i].size());
+            total += segments[i].size();
+        }
+
+        glNamedBufferData(segment_buffer, static_cast<GLsizeiptr>(total * sizeof(LineSegment)), nullptr,
+                          GL_STATIC_DRAW);
+        for (u32 i = 0; i < line_class_count; ++i) {
+            glNamedBufferSubData(segment_buffer, static_cast<GLintptr>(first[i] * sizeof(LineSegment)),
+                                 static_cast<GLsizeiptr>(count[i] * sizeof(LineSegment)), segments[i].data());
+        }
+        dirty = false;
+    }
+
+    const f32 altitude = std::max(glm::length(camera_pos) - 1.0f, 1e-3f);
+    std::array<GPULineStyle, line_class_count> gpu_styles;
+    for (u32 i = 0; i < line_class_count; ++i) {
+        const LineStyle& style = styles[i];
+        const f32 zoom_scale = std::min(std::pow(1.0f / altitude, style.zoom_exponent), max_zoom_scale);
+        gpu_styles[i] = {style.width_scale * zoom_scale * pixel_scale, style.opacity, first[i], count[i]};
+    }
+    glNamedBufferSubData(style_buffer, 0, sizeof(gpu_styles), gpu_styles.data());
+
+    ShaderProgram& shader_program = app->renderer.shader_programs.get(program);
+    shader_program.set_uniform_vec2(Keyword::viewport, viewport);
+
+    for (u32 i = 0; i < line_class_count; ++i) {
+        if (count[i] == 0) {
+            continue;
+        }
+
+        // Lines are drawn over the planet, and tested against its depth so that the far side is hidden, but don't
+        // write depth, so that overlapping segments blend.
+        DrawItem item;
+        item.program = shader_program.id;
+        item.vao = vao;
+        item.primitive = GL_TRIANGLE_STRIP;
+        item.indexed = false;
+        item.count = 4;
+        item.instances = static_cast<i32>(count[i]);
+        item.base_instance = first[i];
+        item.depth_mask = false;
+        queue.push(RenderPass::overlay, item);
+    }
+}
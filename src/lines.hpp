@@ -0,0 +1,76 @@
+#pragma once
+
+#include "slot_map.hpp"
+#include "utility.hpp"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <vector>
+
+struct RenderQueue;
+struct Renderer;
+struct ShaderProgram;
+
+// One segment of a polyline, as stored in the segment buffer. Must match lines.vert.
+struct LineSegment {
+    glm::vec3 a;
+    // In window pixels, before the class's scale
+    f32 width_px;
+    glm::vec3 b;
+    // RGBA, 8 bits each, with red in the lowest byte
+    u32 color;
+};
+
+static_assert(sizeof(LineSegment) == 32);
+
+// Each class is drawn with one instanced draw call and its own `LineStyle`.
+enum class LineClass : u8 {
+    borders,
+    rivers,
+    routes,
+    count,
+};
+
+constexpr u32 line_class_count = static_cast<u32>(LineClass::count);
+
+struct LineStyle {
+    f32 width_scale = 1.0f;
+    // Widths are multiplied by (1 / altitude) ^ `zoom_exponent`, with the altitude in planet radii, so lines thicken
+    // as the camera gets closer.
+    f32 zoom_exponent = 0.0f;
+    f32 opacity = 1.0f;
+};
+
+// Appends a segment for each pair of consecutive points, and one back to the start if `closed`.
+void add_polyline(std::vector<LineSegment>& segments, const std::vector<glm::vec3>& points, f32 width_px, u32 color,
+                  bool closed);
+
+u32 pack_color(f32 r, f32 g, f32 b, f32 a);
+
+// Draws polylines on the globe as screen-space quads. Every segment is an instance reading its endpoints from a
+// storage buffer, and the vertex shader expands it into a quad around them. The fragment shader computes the distance
+// to the segment, which gives anti-aliased edges and round caps, and round joins where segments meet.
+struct LineRenderer {
+    u32 vao = 0;
+    u32 segment_buffer = 0;
+    u32 style_buffer = 0;
+    Handle<ShaderProgram> program;
+
+    std::array<std::vector<LineSegment>, line_class_count> segments;
+    std::array<LineStyle, line_class_count> styles;
+    // Segments changed since the last upload
+    bool dirty = false;
+    // Position of each class's segments in `segment_buffer`
+    std::array<u32, line_class_count> first = {};
+    std::array<u32, line_class_count> count = {};
+
+    void init(Renderer& renderer);
+    void destroy();
+
+    void set_segments(LineClass line_class, std::vector<LineSegment> class_segments);
+    // Queues a draw per class with any segments. `viewport` is the size of the render target, and `pixel_scale` its
+    // pixels per window pixel.
+    void render(const glm::vec3& camera_pos, const glm::vec2& viewport, f32 pixel_scale, RenderQueue& queue);
+};
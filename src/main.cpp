@@ -18,7 +18,7 @@ int main(int argc, char** argv) {
 #ifdef HOT_RELOAD
     const char* const lib_name = "libwhite_star_lib.so";
 
-    using AppInitFn = void* (*)();
+    using AppInitFn = void* (*)(int, char**);
     using AppDestroyFn = void (*)(void*);
     using AppUpdateFn = int (*)(void*);
     using AppLoadFn = void (*)(void*);
@@ -57,7 +57,7 @@ int main(int argc, char** argv) {
     load_app_lib();
 #endif
 
-    void* ptr = app_init();
+    void* ptr = app_init(argc, argv);
     DEFER([&] { app_destroy(ptr); });
 
     while (true) {
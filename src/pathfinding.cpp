@@ -0,0 +1,370 @@
+#include "pathfinding.hpp"
+
+#include "geometry.hpp"
+
+#include <chrono>
+#include <limits>
+#include <random>
+
+namespace {
+
+constexpr f32 infinity = std::numeric_limits<f32>::infinity();
+
+using HeapEntry = std::pair<f32, ProvinceId>;
+
+u64 query_key(const RouteQuery query) {
+    return u64(query.from) << 32 | query.to;
+}
+
+void heap_push(std::vector<HeapEntry>& heap, const HeapEntry entry) {
+    heap.push_back(entry);
+    std::push_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+}
+
+HeapEntry heap_pop(std::vector<HeapEntry>& heap) {
+    std::pop_heap(heap.begin(), heap.end(), std::greater<HeapEntry>());
+    const HeapEntry result = heap.back();
+    heap.pop_back();
+    return result;
+}
+} // namespace
+
+// Per-search scratch space. Entries are only valid where `stamps` matches the current search, so nothing has to be
+// cleared between searches.
+struct Pathfinder::SearchState {
+    std::vector<f32> costs;
+    std::vector<ProvinceId> parents;
+    std::vector<u32> stamps;
+    std::vector<u8> closed;
+    std::vector<HeapEntry> heap;
+    u32 stamp = 0;
+
+    explicit SearchState(const u32 province_count)
+            : costs(province_count), parents(province_count), stamps(province_count, 0), closed(province_count) {}
+
+    void begin() {
+        ++stamp;
+        if (stamp == 0) {
+            std::fill(stamps.begin(), stamps.end(), 0);
+            stamp = 1;
+        }
+        heap.clear();
+    }
+
+    bool visited(const ProvinceId province) const {
+        return stamps[province] == stamp;
+    }
+
+    void visit(const ProvinceId province, const f32 cost, const ProvinceId parent) {
+        stamps[province] = stamp;
+        costs[province] = cost;
+        parents[province] = parent;
+        closed[province] = false;
+    }
+};
+
+bool RouteCache::get(const RouteQuery query, Route& route) {
+    std::lock_guard lock(mutex);
+    auto it = index.find(query_key(query));
+    if (it == index.end()) {
+        return false;
+    }
+
+    entries.splice(entries.begin(), entries, it->second);
+    route = it->second->second;
+    return true;
+}
+
+void RouteCache::put(const RouteQuery query, const Route& route) {
+    if (capacity == 0) {
+        return;
+    }
+
+    std::lock_guard lock(mutex);
+    const u64 key = query_key(query);
+    auto it = index.find(key);
+    if (it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        it->second->second = route;
+        return;
+    }
+
+    if (entries.size() >= capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+    entries.emplace_front(key, route);
+    index.emplace(key, entries.begin());
+}
+
+void RouteCache::clear() {
+    std::lock_guard lock(mutex);
+    entries.clear();
+    index.clear();
+}
+
+Pathfinder::Pathfinder() = default;
+Pathfinder::~Pathfinder() = default;
+
+void Pathfinder::init(const ProvinceGraph& graph, const PathfinderConfig& config) {
+    this->graph = &graph;
+    const u32 province_count = graph.province_count();
+
+    base_costs.resize(graph.edge_count());
+    for (ProvinceId a = 0; a < province_count; ++a) {
+        for (u32 edge = graph.offsets[a]; edge < graph.offsets[a + 1]; ++edge) {
+            const ProvinceId b = graph.neighbors[edge];
+            base_costs[edge] = static_cast<f32>(
+                    great_circle_distance(glm::dvec3(graph.centroids[a]), glm::dvec3(graph.centroids[b])));
+        }
+    }
+    edge_costs = base_costs;
+
+    {
+        std::lock_guard lock(cache.mutex);
+        cache.capacity = config.cache_capacity;
+    }
+    cache.clear();
+
+    // Pick landmarks by farthest-point sampling: each new landmark is the reachable province farthest from all the
+    // previous ones. This spreads them around the edges of the map, where ALT bounds are tightest.
+    landmarks.clear();
+    landmark_distances.clear();
+    if (province_count == 0) {
+        return;
+    }
+
+    const u32 landmark_count = std::min(config.landmark_count, province_count);
+    std::vector<f32> min_distances(province_count, infinity);
+    std::vector<f32> distances(province_count);
+
+    shortest_distances(0, distances.data());
+    ProvinceId next = 0;
+    for (ProvinceId p = 0; p < province_count; ++p) {
+        if (distances[p] < infinity && distances[p] > distances[next]) {
+            next = p;
+        }
+    }
+
+    for (u32 i = 0; i < landmark_count; ++i) {
+        landmarks.push_back(next);
+        landmark_distances.resize(size_t(i + 1) * province_count);
+        f32* const landmark_row = landmark_distances.data() + size_t(i) * province_count;
+        shortest_distances(next, landmark_row);
+
+        f32 farthest = 0.0f;
+        for (ProvinceId p = 0; p < province_count; ++p) {
+            if (landmark_row[p] < infinity) {
+                min_distances[p] = std::min(min_distances[p], landmark_row[p]);
+                if (min_distances[p] > farthest) {
+                    farthest = min_distances[p];
+                    next = p;
+                }
+            }
+        }
+
+        if (farthest <= 0.0f) {
+            break;
+        }
+    }
+
+    DEXPR(landmarks.size());
+}
+
+void Pathfinder::set_cost_multiplier(const ProvinceId a, const ProvinceId b, const f32 multiplier) {
+    CHECK_F(multiplier >= 1.0f);
+
+    const i64 forward = graph->find_edge(a, b);
+    const i64 backward = graph->find_edge(b, a);
+    CHECK_F(forward != -1 && backward != -1);
+
+    for (const i64 edge : {forward, backward}) {
+        edge_costs[static_cast<size_t>(edge)] = base_costs[static_cast<size_t>(edge)] * multiplier;
+    }
+    cache.clear();
+}
+
+Route Pathfinder::find_route(const RouteQuery query) {
+    Route result;
+    if (cache.get(query, result)) {
+        return result;
+    }
+
+    std::unique_ptr<SearchState> state = acquire_state();
+    result = search(*state, query);
+    release_state(std::move(state));
+
+    cache.put(query, result);
+    return result;
+}
+
+void Pathfinder::find_routes(const std::vector<RouteQuery>& queries, std::vector<Route>& routes,
+                             ThreadPool& thread_pool) {
+    routes.resize(queries.size());
+    thread_pool.parallel_for(queries.size(), [&](const size_t begin, const size_t end) {
+        std::unique_ptr<SearchState> state;
+
+        for (size_t i = begin; i < end; ++i) {
+            if (cache.get(queries[i], routes[i])) {
+                continue;
+            }
+
+            if (!state) {
+                state = acquire_state();
+            }
+            routes[i] = search(*state, queries[i]);
+            cache.put(queries[i], routes[i]);
+        }
+
+        if (state) {
+            release_state(std::move(state));
+        }
+    });
+}
+
+f32 Pathfinder::heuristic(const ProvinceId province, const ProvinceId goal) const {
+    f32 result = static_cast<f32>(
+            great_circle_distance(glm::dvec3(graph->centroids[province]), glm::dvec3(graph->centroids[goal])));
+
+    const size_t province_count = graph->province_count();
+    for (size_t i = 0; i < landmarks.size(); ++i) {
+        const f32 to_province = landmark_distances[i * province_count + province];
+        const f32 to_goal = landmark_distances[i * province_count + goal];
+        if (to_province < infinity && to_goal < infinity) {
+            result = std::max(result, std::abs(to_goal - to_province));
+        }
+    }
+
+    return result;
+}
+
+Route Pathfinder::search(SearchState& state, const RouteQuery query) const {
+    Route result;
+
+    state.begin();
+    state.visit(query.from, 0.0f, query.from);
+    heap_push(state.heap, {heuristic(query.from, query.to), query.from});
+
+    while (!state.heap.empty()) {
+        const ProvinceId province = heap_pop(state.heap).second;
+        if (state.closed[province]) {
+            continue;
+        }
+        state.closed[province] = true;
+
+        if (province == query.to) {
+            result.cost = state.costs[province];
+            for (ProvinceId p = province; p != query.from; p = state.parents[p]) {
+                result.provinces.push_back(p);
+            }
+            result.provinces.push_back(query.from);
+            std::reverse(result.provinces.begin(), result.provinces.end());
+            break;
+        }
+
+        for (u32 edge = graph->offsets[province]; edge < graph->offsets[province + 1]; ++edge) {
+            const ProvinceId neighbor = graph->neighbors[edge];
+            const f32 cost = state.costs[province] + edge_costs[edge];
+
+            if (!state.visited(neighbor) || (!state.closed[neighbor] && cost < state.costs[neighbor])) {
+                state.visit(neighbor, cost, province);
+                heap_push(state.heap, {cost + heuristic(neighbor, query.to), neighbor});
+            }
+        }
+    }
+
+    return result;
+}
+
+// Dijkstra with base costs, used for landmark distances.
+void Pathfinder::shortest_distances(const ProvinceId source, f32* const distances) const {
+    std::fill(distances, distances + graph->province_count(), infinity);
+    std::vector<HeapEntry> heap;
+
+    distances[source] = 0.0f;
+    heap_push(heap, {0.0f, source});
+
+    while (!heap.empty()) {
+        const auto [distance, province] = heap_pop(heap);
+        if (distance > distances[province]) {
+            continue;
+        }
+
+        for (u32 edge = graph->offsets[province]; edge < graph->offsets[province + 1]; ++edge) {
+            const ProvinceId neighbor = graph->neighbors[edge];
+            const f32 neighbor_distance = distance + base_costs[edge];
+            if (neighbor_distance < distances[neighbor]) {
+                distances[neighbor] = neighbor_distance;
+                heap_push(heap, {neighbor_distance, neighbor});
+            }
+        }
+    }
+}
+
+std::unique_ptr<Pathfinder::SearchState> Pathfinder::acquire_state() {
+    {
+        std::lock_guard lock(states_mutex);
+        if (!free_states.empty()) {
+            std::unique_ptr<SearchState> result = std::move(free_states.back());
+            free_states.pop_back();
+            return result;
+        }
+    }
+    return std::make_unique<SearchState>(graph->province_count());
+}
+
+void Pathfinder::release_state(std::unique_ptr<SearchState> state) {
+    std::lock_guard lock(states_mutex);
+    free_states.push_back(std::move(state));
+}
+
+void bench_pathfinding(Pathfinder& pathfinder, ThreadPool& thread_pool) {
+    constexpr u32 query_count = 10000;
+
+    const u32 province_count = pathfinder.graph->province_count();
+    CHECK_F(province_count > 0);
+
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<ProvinceId> dist(0, province_count - 1);
+    std::vector<RouteQuery> queries(query_count);
+    for (RouteQuery& query : queries) {
+        query = {dist(rng), dist(rng)};
+    }
+
+    std::vector<Route> routes;
+    auto measure = [&](const std::string& name, const size_t count, auto&& fn) {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const f64 elapsed_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+        LOG_F(INFO, "Pathfinding ({}): {:.0f} queries/s", name, static_cast<f64>(count) / elapsed_s);
+    };
+
+    pathfinder.cache.clear();
+    measure("1 thread", queries.size(), [&] {
+        for (const RouteQuery& query : queries) {
+            pathfinder.find_route(query);
+        }
+    });
+
+    pathfinder.cache.clear();
+    measure(fmt::format("{} threads", thread_pool.size()), queries.size(),
+            [&] { pathfinder.find_routes(queries, routes, thread_pool); });
+
+    const size_t hot_count = std::min<size_t>(queries.size(), pathfinder.cache.capacity);
+    const std::vector<RouteQuery> hot_queries(queries.begin(),
+                                              queries.begin() + static_cast<std::ptrdiff_t>(hot_count));
+    std::vector<Route> hot_routes;
+    pathfinder.find_routes(hot_queries, hot_routes, thread_pool);
+    measure("cached", hot_queries.size(), [&] { pathfinder.find_routes(hot_queries, hot_routes, thread_pool); });
+
+    size_t found = 0;
+    size_t total_length = 0;
+    for (const Route& route : routes) {
+        if (!route.provinces.empty()) {
+            ++found;
+            total_length += route.provinces.size();
+        }
+    }
+    LOG_F(INFO, "Pathfinding: {} of {} queries reachable, {:.1f} provinces per route", found, query_count,
+          found > 0 ? static_cast<f64>(total_length) / static_cast<f64>(found) : 0.0);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "adjacency.hpp"
+#include "province.hpp"
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct RouteQuery {
+    ProvinceId from;
+    ProvinceId to;
+};
+
+struct Route {
+    // Includes both ends. Empty if there is no route.
+    std::vector<ProvinceId> provinces;
+    f32 cost = 0.0f;
+};
+
+// LRU cache of recent routes. Any change to edge costs clears it.
+struct RouteCache {
+    using Entry = std::pair<u64, Route>;
+
+    u32 capacity = 0;
+    std::list<Entry> entries;
+    std::unordered_map<u64, std::list<Entry>::iterator> index;
+    std::mutex mutex;
+
+    bool get(RouteQuery query, Route& route);
+    void put(RouteQuery query, const Route& route);
+    void clear();
+};
+
+struct PathfinderConfig {
+    u32 landmark_count = 16;
+    u32 cache_capacity = 4096;
+};
+
+// A* over the province graph. The heuristic is the larger of the great-circle distance between province centroids and
+// the ALT (A*, landmarks, triangle inequality) bound. Every edge costs at least the great-circle distance between the
+// centroids it connects, and landmark distances are computed with those minimum costs, so both bounds stay admissible
+// however costs are raised later.
+struct Pathfinder {
+    struct SearchState;
+
+    const ProvinceGraph* graph = nullptr;
+
+    std::vector<f32> base_costs;
+    std::vector<f32> edge_costs;
+
+    std::vector<ProvinceId> landmarks;
+    // Distance from each landmark to each province, landmark-major.
+    std::vector<f32> landmark_distances;
+
+    RouteCache cache;
+
+    std::mutex states_mutex;
+    std::vector<std::unique_ptr<SearchState>> free_states;
+
+    Pathfinder();
+    ~Pathfinder();
+
+    void init(const ProvinceGraph& graph, const PathfinderConfig& config);
+
+    // Sets the cost of travelling between two adjacent provinces, in both directions, as a multiple (at least 1) of
+    // the distance between their centroids. Must not be called while routes are being found.
+    void set_cost_multiplier(ProvinceId a, ProvinceId b, f32 multiplier);
+
+    Route find_route(RouteQuery query);
+
+    // Finds every route in `queries` across the thread pool.
+    void find_routes(const std::vector<RouteQuery>& queries, std::vector<Route>& routes, ThreadPool& thread_pool);
+
+    f32 heuristic(ProvinceId province, ProvinceId goal) const;
+
+private:
+    Route search(SearchState& state, RouteQuery query) const;
+    void shortest_distances(ProvinceId source, f32* distances) const;
+
+    std::unique_ptr<SearchState> acquire_state();
+    void release_state(std::unique_ptr<SearchState> state);
+};
+
+// Logs the throughput of random route queries, batched across the thread pool and one at a time.
+void bench_pathfinding(Pathfinder& pathfinder, ThreadPool& thread_pool);
@@ -0,0 +1,303 @@
+#include "province.hpp"
+
+namespace {
+
+constexpr u32 province_cache_kind = make_cache_kind("PROV");
+constexpr u32 province_cache_version = 1;
+} // namespace
+
+// The empty string is the null symbol, which doesn't need the symbol table.
+StringPool::StringPool() {
+    symbols.push_back(Symbol());
+    ids.emplace(Symbol(), 0);
+}
+
+u32 StringPool::intern(const char* const str) {
+    const Symbol symbol = ::intern(str);
+    const auto [it, inserted] = ids.emplace(symbol, size());
+    if (inserted) {
+        symbols.push_back(symbol);
+    }
+    return it->second;
+}
+
+const char* StringPool::get(const u32 id) const {
+    return get_name(symbols.at(id));
+}
+
+Symbol StringPool::get_symbol(const u32 id) const {
+    return symbols.at(id);
+}
+
+u32 StringPool::size() const {
+    return static_cast<u32>(symbols.size());
+}
+
+bool StringPool::read(BinaryReader& reader) {
+    std::vector<char> chars;
+    std::vector<u32> offsets;
+    if (!reader.read_vector(chars) || !reader.read_vector(offsets) || offsets.empty() || offsets[0] != 0 ||
+        chars.empty() || chars.back() != '\0') {
+        return false;
+    }
+
+    *this = StringPool();
+    for (size_t i = 1; i < offsets.size(); ++i) {
+        if (offsets[i] <= offsets[i - 1] || offsets[i] >= chars.size() || intern(chars.data() + offsets[i]) != i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StringPool::write(BinaryWriter& writer) const {
+    std::vector<char> chars;
+    std::vector<u32> offsets;
+    for (const Symbol symbol : symbols) {
+        const char* const str = get_name(symbol);
+        offsets.push_back(static_cast<u32>(chars.size()));
+        chars.insert(chars.end(), str, str + strlen(str) + 1);
+    }
+    writer.write_vector(chars);
+    writer.write_vector(offsets);
+}
+
+void ProvinceTable::init(OGRLayer* const layer, const Path& source_path, const Path& cache_path) {
+    const CacheKey key = make_cache_key(source_path);
+    if (read_cache(cache_path, key)) {
+        DPRINT("Loaded province table from cache");
+    } else {
+        load_layer(layer);
+        write_cache(cache_path, key);
+    }
+
+    DEXPR(count);
+    DEXPR(columns.size());
+    DEXPR(strings.size());
+}
+
+void ProvinceTable::load_layer(OGRLayer* const layer) {
+    *this = ProvinceTable();
+
+    OGRFeatureDefn* const defn = layer->GetLayerDefn();
+    const i32 field_count = defn->GetFieldCount();
+
+    for (i32 i = 0; i < field_count; ++i) {
+        const OGRFieldDefn* const field = defn->GetFieldDefn(i);
+
+        ProvinceColumn column;
+        column.name = intern(field->GetNameRef());
+
+        switch (field->GetType()) {
+        case OFTInteger:
+            column.type = ColumnType::int32;
+            column.values = AlignedVector<i32>();
+            break;
+
+        case OFTInteger64:
+            column.type = ColumnType::int64;
+            column.values = AlignedVector<i64>();
+            break;
+
+        case OFTReal:
+            column.type = ColumnType::real;
+            column.values = AlignedVector<f64>();
+            break;
+
+        default:
+            // Dates, lists etc. are kept in their string form.
+            column.type = ColumnType::string;
+            column.values = AlignedVector<u32>();
+            break;
+        }
+
+        column_indices.emplace(column.name, static_cast<u32>(columns.size()));
+        columns.push_back(std::move(column));
+    }
+
+    for (auto& feature : layer) {
+        const ProvinceId id = count;
+        ++count;
+
+        fids.push_back(feature->GetFID());
+        CHECK_F(fid_to_id.emplace(feature->GetFID(), id).second);
+
+        for (i32 i = 0; i < field_count; ++i) {
+            ProvinceColumn& column = columns[static_cast<size_t>(i)];
+            const bool is_set = feature->IsFieldSetAndNotNull(i);
+
+            switch (column.type) {
+            case ColumnType::int32:
+                column.get<i32>().push_back(is_set ? feature->GetFieldAsInteger(i) : 0);
+                break;
+
+            case ColumnType::int64:
+                column.get<i64>().push_back(is_set ? feature->GetFieldAsInteger64(i) : 0);
+                break;
+
+            case ColumnType::real:
+                column.get<f64>().push_back(is_set ? feature->GetFieldAsDouble(i) : 0.0);
+                break;
+
+            case ColumnType::string:
+                column.get<u32>().push_back(is_set ? strings.intern(feature->GetFieldAsString(i)) : 0);
+                break;
+            }
+        }
+    }
+}
+
+bool ProvinceTable::read_cache(const Path& path, const CacheKey& key) {
+    BinaryReader reader;
+    if (!reader.open(path, province_cache_kind, province_cache_version, key)) {
+        return false;
+    }
+
+    ProvinceTable result;
+    u32 column_count;
+    bool ok = reader.read(result.count) && reader.read_vector(result.fids) && result.strings.read(reader) &&
+              reader.read(column_count);
+
+    for (u32 i = 0; ok && i < column_count; ++i) {
+        ProvinceColumn column;
+        std::string name;
+        ok = reader.read_string(name) && reader.read(column.type);
+        if (!ok) {
+            break;
+        }
+        column.name = intern(name);
+
+        switch (column.type) {
+        case ColumnType::int32:
+            column.values = AlignedVector<i32>();
+            break;
+
+        case ColumnType::int64:
+            column.values = AlignedVector<i64>();
+            break;
+
+        case ColumnType::real:
+            column.values = AlignedVector<f64>();
+            break;
+
+        case ColumnType::string:
+            column.values = AlignedVector<u32>();
+            break;
+
+        default:
+            return false;
+        }
+
+        ok = std::visit([&](auto& values) { return reader.read_vector(values); }, column.values);
+
+        result.column_indices.emplace(column.name, i);
+        result.columns.push_back(std::move(column));
+    }
+
+    if (!ok || !reader.at_end() || !result.validate()) {
+        LOG_F(WARNING, "Ignoring invalid province cache {}", path.string());
+        return false;
+    }
+
+    for (ProvinceId id = 0; id < result.count; ++id) {
+        if (!result.fid_to_id.emplace(result.fids[id], id).second) {
+            LOG_F(WARNING, "Ignoring invalid province cache {}", path.string());
+            return false;
+        }
+    }
+
+    *this = std::move(result);
+    return true;
+}
+
+void ProvinceTable::write_cache(const Path& path, const CacheKey& key) const {
+    BinaryWriter writer(path, province_cache_kind, province_cache_version, key);
+    writer.write(count);
+    writer.write_vector(fids);
+    strings.write(writer);
+
+    writer.write(static_cast<u32>(columns.size()));
+    for (const ProvinceColumn& column : columns) {
+        writer.write_string(get_name(column.name));
+        writer.write(column.type);
+        std::visit([&](const auto& values) { writer.write_vector(values); }, column.values);
+    }
+
+    writer.finish();
+}
+
+bool ProvinceTable::validate() const {
+    if (fids.size() != count) {
+        return false;
+    }
+
+    for (const ProvinceColumn& column : columns) {
+        if (std::visit([&](const auto& values) { return values.size() != count; }, column.values)) {
+            return false;
+        }
+        if (column.type == ColumnType::string) {
+            for (const u32 id : column.get<u32>()) {
+                if (id >= strings.size()) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+i64 ProvinceTable::find_column(const Symbol name) const {
+    auto it = column_indices.find(name);
+    if (it == column_indices.end()) {
+        return -1;
+    }
+    return it->second;
+}
+
+const ProvinceColumn& ProvinceTable::get_column(const Symbol name) const {
+    const i64 index = find_column(name);
+    CHECK_F(index != -1, "No province column named {}", get_name(name));
+    return columns[static_cast<size_t>(index)];
+}
+
+ProvinceId ProvinceTable::get_province(const i64 fid) const {
+    return fid_to_id.at(fid);
+}
+
+i64 ProvinceTable::get_int(const u32 column, const ProvinceId province) const {
+    const ProvinceColumn& c = columns.at(column);
+    switch (c.type) {
+    case ColumnType::int32:
+        return c.get<i32>()[province];
+
+    case ColumnType::int64:
+        return c.get<i64>()[province];
+
+    default:
+        ABORT_F("Province column {} is not an integer column", get_name(c.name));
+    }
+}
+
+f64 ProvinceTable::get_real(const u32 column, const ProvinceId province) const {
+    const ProvinceColumn& c = columns.at(column);
+    switch (c.type) {
+    case ColumnType::int32:
+        return c.get<i32>()[province];
+
+    case ColumnType::int64:
+        return static_cast<f64>(c.get<i64>()[province]);
+
+    case ColumnType::real:
+        return c.get<f64>()[province];
+
+    default:
+        ABORT_F("Province column {} is not a numeric column", get_name(c.name));
+    }
+}
+
+const char* ProvinceTable::get_string(const u32 column, const ProvinceId province) const {
+    const ProvinceColumn& c = columns.at(column);
+    CHECK_F(c.type == ColumnType::string, "Province column {} is not a string column", get_name(c.name));
+    return strings.get(c.get<u32>()[province]);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "cache.hpp"
+#include "filesystem.hpp"
+#include "symbol.hpp"
+#include "utility.hpp"
+
+#include <ogrsf_frmts.h>
+
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+// Dense province index. Provinces are numbered in `OGRLayer` iteration order, which is also the order in which
+// `Renderer::init` builds the planet mesh, so the same ID addresses both the simulation and the render side.
+using ProvinceId = u32;
+
+// The distinct strings of a table, numbered in the order they were added so that the numbers can be cached. Each is
+// interned as a `Symbol`, so returned names stay valid. ID 0 is always the empty string, which is also used for null
+// fields.
+struct StringPool {
+    std::vector<Symbol> symbols;
+    std::unordered_map<Symbol, u32, SymbolHash> ids;
+
+    StringPool();
+
+    u32 intern(const char* str);
+
+    const char* get(u32 id) const;
+    Symbol get_symbol(u32 id) const;
+
+    u32 size() const;
+
+    // Cached as the characters of every string, each followed by a null, then the offset of each string.
+    bool read(BinaryReader& reader);
+    void write(BinaryWriter& writer) const;
+};
+
+enum class ColumnType : u8 {
+    int32,
+    int64,
+    real,
+    string,
+};
+
+// One attribute of every province, stored contiguously. String columns hold `StringPool` IDs.
+struct ProvinceColumn {
+    Symbol name;
+    ColumnType type;
+    std::variant<AlignedVector<i32>, AlignedVector<i64>, AlignedVector<f64>, AlignedVector<u32>> values;
+
+    template <class T>
+    const AlignedVector<T>& get() const {
+        return std::get<AlignedVector<T>>(values);
+    }
+
+    template <class T>
+    AlignedVector<T>& get() {
+        return std::get<AlignedVector<T>>(values);
+    }
+};
+
+// Struct-of-arrays table of province attributes, built once from the layer's field definitions so that nothing has to
+// query OGR while the game is running.
+struct ProvinceTable {
+    u32 count = 0;
+    AlignedVector<i64> fids;
+    std::unordered_map<i64, ProvinceId> fid_to_id;
+
+    StringPool strings;
+    std::vector<ProvinceColumn> columns;
+    std::unordered_map<Symbol, u32, SymbolHash> column_indices;
+
+    // Loads the table from `cache_path` if it was built from the current `source_path`, otherwise reads `layer` and
+    // writes a new cache.
+    void init(OGRLayer* layer, const Path& source_path, const Path& cache_path);
+
+    void load_layer(OGRLayer* layer);
+    bool read_cache(const Path& path, const CacheKey& key);
+    void write_cache(const Path& path, const CacheKey& key) const;
+    // Returns true if every column has a value for each province and string columns only hold IDs in `strings`.
+    bool validate() const;
+
+    // Returns -1 if there is no column with the given name.
+    i64 find_column(Symbol name) const;
+    const ProvinceColumn& get_column(Symbol name) const;
+
+    ProvinceId get_province(i64 fid) const;
+
+    i64 get_int(u32 column, ProvinceId province) const;
+    f64 get_real(u32 column, ProvinceId province) const;
+    const char* get_string(u32 column, ProvinceId province) const;
+};
@@ -1,6 +1,7 @@
 #include "render.hpp"
 
 #include "app.hpp"
+#include "geometry.hpp"
 
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
@@ -9,12 +10,159 @@
 #include <mapbox/earcut.hpp>
 #include <meshoptimizer.h>
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <sstream>
-#include <unordered_set>
+#include <unordered_map>
 
 namespace fs = std::filesystem;
 
+namespace {
+
+constexpr f32 projection_transition_s = 1.0f;
+
+// Vertices within this many degrees of the antimeridian are treated as on it.
+constexpr f64 antimeridian_tolerance = 1e-6;
+
+// Stores primitives that cross the antimeridian twice, with every vertex flagged east in one copy and west in the
+// other. Flat projections move the flagged vertices a whole turn so that each copy is contiguous, then clip it at the
+// map's edge. `primitive_flags`, if not null, has a value per primitive, which is copied along with it.
+void split_antimeridian(std::vector<glm::vec3>& vertices, std::vector<f64>& longitudes, std::vector<f32>& wraps,
+                        std::vector<u32>& indices, const u32 primitive_size,
+                        std::vector<u8>* const primitive_flags = nullptr) {
+    std::vector<u32> result;
+    result.reserve(indices.size());
+    std::vector<u8> result_flags;
+
+    for (size_t i = 0; i < indices.size(); i += primitive_size) {
+        f64 min_longitude = INFINITY;
+        f64 max_longitude = -INFINITY;
+        for (size_t j = i; j < i + primitive_size; ++j) {
+            min_longitude = std::min(min_longitude, longitudes[indices[j]]);
+            max_longitude = std::max(max_longitude, longitudes[indices[j]]);
+        }
+
+        const u8 flags = primitive_flags ? (*primitive_flags)[i / primitive_size] : 0;
+        if (max_longitude - min_longitude <= 180.0) {
+            result.insert(result.end(), indices.begin() + static_cast<std::ptrdiff_t>(i),
+                          indices.begin() + static_cast<std::ptrdiff_t>(i + primitive_size));
+            result_flags.push_back(flags);
+            continue;
+        }
+
+        for (const f32 wrap : {1.0f, -1.0f}) {
+            result_flags.push_back(flags);
+            for (size_t j = i; j < i + primitive_size; ++j) {
+                const glm::vec3 vertex = vertices[indices[j]];
+                const f64 longitude = longitudes[indices[j]];
+                result.push_back(static_cast<u32>(vertices.size()));
+                vertices.push_back(vertex);
+                longitudes.push_back(longitude);
+                wraps.push_back(wrap);
+            }
+        }
+    }
+
+    indices = std::move(result);
+    if (primitive_flags) {
+        *primitive_flags = std::move(result_flags);
+    }
+}
+
+// Bits of an edge's endpoints, lowest first, so that the edge has the same key in both provinces it separates
+using EdgeKey = std::array<u32, 6>;
+
+struct EdgeKeyHash {
+    size_t operator()(const EdgeKey& key) const {
+        size_t result = 0;
+        for (const u32 bits : key) {
+            hash_combine(result, bits);
+        }
+        return result;
+    }
+};
+
+EdgeKey make_edge_key(const glm::vec3& a, const glm::vec3& b) {
+    std::array<u32, 3> a_bits;
+    std::array<u32, 3> b_bits;
+    std::memcpy(a_bits.data(), &a, sizeof(a_bits));
+    std::memcpy(b_bits.data(), &b, sizeof(b_bits));
+    if (b_bits < a_bits) {
+        std::swap(a_bits, b_bits);
+    }
+    return {a_bits[0], a_bits[1], a_bits[2], b_bits[0], b_bits[1], b_bits[2]};
+}
+
+// A segment for each edge of every ring. Edges between two provinces are only included once and are full width;
+// edges of only one province, which are mostly coasts, are half width.
+std::vector<LineSegment> build_border_segments(const std::vector<glm::vec3>& vertices,
+                                               const std::vector<u32>& vertex_rings) {
+    std::vector<LineSegment> segments;
+    std::unordered_map<EdgeKey, u32, EdgeKeyHash> edge_segments;
+    const u32 color = pack_color(0.0f, 0.0f, 0.0f, 1.0f);
+
+    const auto add_edge = [&](const u32 a, const u32 b) {
+        const glm::vec3& va = vertices[a];
+        const glm::vec3& vb = vertices[b];
+        const EdgeKey key = make_edge_key(va, vb);
+        // Repeated points
+        if (std::equal(key.begin(), key.begin() + 3, key.begin() + 3)) {
+            return;
+        }
+
+        const auto [it, inserted] = edge_segments.emplace(key, static_cast<u32>(segments.size()));
+        if (inserted) {
+            segments.push_back({va, 0.5f, vb, color});
+        } else {
+            segments[it->second].width_px = 1.0f;
+        }
+    };
+
+    u32 ring_start = 0;
+    for (u32 i = 0; i < vertex_rings.size(); ++i) {
+        const bool ring_ends = i + 1 == vertex_rings.size() || vertex_rings[i + 1] != vertex_rings[i];
+        if (!ring_ends) {
+            add_edge(i, i + 1);
+        } else {
+            // Closed rings end with their first point, which makes this edge empty.
+            add_edge(i, ring_start);
+            ring_start = i + 1;
+        }
+    }
+
+    return segments;
+}
+} // namespace
+
+const char* get_projection_name(const MapProjection projection) {
+    switch (projection) {
+    case MapProjection::globe:
+        return "globe";
+    case MapProjection::equirectangular:
+        return "equirectangular";
+    case MapProjection::mollweide:
+        return "Mollweide";
+    case MapProjection::robinson:
+        return "Robinson";
+    case MapProjection::count:
+        break;
+    }
+    ABORT_F("Invalid projection");
+}
+
+const char* get_border_mode_name(const BorderMode mode) {
+    switch (mode) {
+    case BorderMode::lines:
+        return "line";
+    case BorderMode::shaded:
+        return "shaded";
+    case BorderMode::thick:
+        return "thick";
+    }
+    ABORT_F("Invalid border mode");
+}
+
 GLBuffer::GLBuffer(const GLenum type, const GLenum usage) : type(type), usage(usage) {
     glGenBuffers(1, &id);
     bind();
@@ -24,20 +172,20 @@ void GLBuffer::bind() {
     glBindBuffer(type, id);
 }
 
+// Uploads go through the buffer's name rather than a binding point, so they can't change the element buffer of
+// whichever VAO the state cache left bound.
 void GLBuffer::buffer_data(const void* const data, const GLsizeiptr size) {
     CHECK_F(usage != GL_STATIC_DRAW);
-    bind();
     if (this->size < size) {
-        glBufferData(type, size, data, usage);
+        glNamedBufferData(id, size, data, usage);
         this->size = size;
     } else {
-        glBufferSubData(type, 0, size, data);
+        glNamedBufferSubData(id, 0, size, data);
     }
 }
 
 void GLBuffer::buffer_data_realloc(const void* const data, const GLsizeiptr size) {
-    bind();
-    glBufferData(type, size, data, usage);
+    glNamedBufferData(id, size, data, usage);
     this->size = size;
 }
 
@@ -61,7 +209,7 @@ void ElementBufferObject::buffer_elements_realloc(const void* const data, const
     this->count = count;
 }
 
-UniformBufferObject::UniformBufferObject(const char* const name, const u32 binding, const GLenum usage)
+UniformBufferObject::UniformBufferObject(const Symbol name, const u32 binding, const GLenum usage)
         : GLBuffer(GL_UNIFORM_BUFFER, usage), name(name), binding(binding) {
 
     glBindBufferBase(GL_UNIFORM_BUFFER, binding, id);
@@ -109,6 +257,7 @@ ShaderProgram::ShaderProgram(const Shader& vertex_shader, const Shader& fragment
 }
 
 void ShaderProgram::load() {
+    locations.clear();
     glLinkProgram(id);
     i32 success;
     glGetProgramiv(id, GL_LINK_STATUS, &success);
@@ -121,46 +270,50 @@ void ShaderProgram::load() {
     }
 }
 
-i32 ShaderProgram::get_location(const char* const name) {
-    i32 result = glGetUniformLocation(id, name);
+i32 ShaderProgram::get_location(const Symbol name) {
+    for (const auto& [symbol, location] : locations) {
+        if (symbol == name) {
+            return location;
+        }
+    }
+
+    const i32 result = glGetUniformLocation(id, get_name(name));
     CHECK_F(result != -1);
+    locations.emplace_back(name, result);
     return result;
 }
 
-void ShaderProgram::use() {
-    glUseProgram(id);
+// Uniforms are set through the program's name, so setting one doesn't change the program in use.
+void ShaderProgram::set_uniform_mat4(const Symbol name, const f32* const data) {
+    glProgramUniformMatrix4fv(id, get_location(name), 1, false, data);
 }
 
-void ShaderProgram::set_uniform_mat4(const char* const name, const f32* const data) {
-    use();
-    glUniformMatrix4fv(get_location(name), 1, false, data);
+void ShaderProgram::set_uniform_f32(const Symbol name, const f32 value) {
+    glProgramUniform1f(id, get_location(name), value);
 }
 
-void ShaderProgram::set_uniform_f32(const char* const name, const f32 value) {
-    use();
-    glUniform1f(get_location(name), value);
+void ShaderProgram::set_uniform_i32(const Symbol name, const i32 value) {
+    glProgramUniform1i(id, get_location(name), value);
 }
 
-void ShaderProgram::set_uniform_i32(const char* const name, const i32 value) {
-    use();
-    glUniform1i(get_location(name), value);
+void ShaderProgram::set_uniform_bool(const Symbol name, const bool value) {
+    set_uniform_i32(name, value);
 }
 
-void ShaderProgram::set_uniform_bool(const char* const name, const bool value) {
-    set_uniform_i32(name, value);
+void ShaderProgram::set_uniform_vec2(const Symbol name, const glm::vec2& data) {
+    glProgramUniform2fv(id, get_location(name), 1, glm::value_ptr(data));
 }
 
-void ShaderProgram::set_uniform_vec3(const char* const name, const f32* const data) {
-    use();
-    glUniform3fv(get_location(name), 1, data);
+void ShaderProgram::set_uniform_vec3(const Symbol name, const f32* const data) {
+    glProgramUniform3fv(id, get_location(name), 1, data);
 }
 
-void ShaderProgram::set_uniform_vec3(const char* name, const glm::vec3& data) {
+void ShaderProgram::set_uniform_vec3(const Symbol name, const glm::vec3& data) {
     set_uniform_vec3(name, glm::value_ptr(data));
 }
 
 void ShaderProgram::bind_uniform_block(const UniformBufferObject& ubo) {
-    const u32 index = glGetUniformBlockIndex(id, ubo.name);
+    const u32 index = glGetUniformBlockIndex(id, get_name(ubo.name));
     glUniformBlockBinding(id, index, ubo.binding);
 }
 
@@ -168,18 +321,19 @@ void Framebuffer::bind_default() {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-Framebuffer::Framebuffer(const u32 width, const u32 height) : width(width), height(height) {
+Framebuffer::Framebuffer(const u32 width, const u32 height, const i32 samples)
+        : width(width), height(height), samples(samples) {
     glGenFramebuffers(1, &id);
     bind();
 
     glGenRenderbuffers(2, rbos);
     glBindRenderbuffer(GL_RENDERBUFFER, color_rbo);
-    glRenderbufferStorageMultisample(GL_RENDERBUFFER, render_samples, GL_SRGB8, static_cast<GLsizei>(width),
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_SRGB8_ALPHA8, static_cast<GLsizei>(width),
                                      static_cast<GLsizei>(height));
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rbo);
 
     glBindRenderbuffer(GL_RENDERBUFFER, depth_rbo);
-    glRenderbufferStorageMultisample(GL_RENDERBUFFER, render_samples, GL_DEPTH_COMPONENT24, static_cast<GLsizei>(width),
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, static_cast<GLsizei>(width),
                                      static_cast<GLsizei>(height));
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rbo);
 
@@ -231,49 +385,361 @@ void Framebuffer::destroy() {
     *this = Framebuffer();
 }
 
-VertexArrayObject::VertexArrayObject(const u32 shader_program_id, std::initializer_list<u32> _vbo_ids,
-                                     std::initializer_list<VertexSpec> specs, const ElementBufferObject _ebo)
-        : shader_program_id(shader_program_id), vbo_ids(_vbo_ids.begin(), _vbo_ids.end()), ebo(_ebo) {
+void FrameTimer::init() {
+    glGenQueries(static_cast<GLsizei>(query_count), queries.data());
+}
+
+void FrameTimer::destroy() {
+    glDeleteQueries(static_cast<GLsizei>(query_count), queries.data());
+    *this = FrameTimer();
+}
+
+f32 FrameTimer::begin() {
+    index = (index + 1) % query_count;
+    f32 result = -1.0f;
+
+    if (pending[index]) {
+        i32 available;
+        glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            // The GPU is more than a ring behind. Skip timing this frame rather than wait.
+            began = false;
+            return result;
+        }
+
+        u64 elapsed_ns;
+        glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &elapsed_ns);
+        result = static_cast<f32>(static_cast<f64>(elapsed_ns) / 1e6);
+        pending[index] = false;
+    }
 
-    CHECK_F(vbo_ids.size() == specs.size());
+    glBeginQuery(GL_TIME_ELAPSED, queries[index]);
+    began = true;
+    return result;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+void FrameTimer::end() {
+    if (began) {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[index] = true;
+        began = false;
+    }
+}
 
-    glGenVertexArrays(1, &id);
-    glBindVertexArray(id);
+VertexArrayObject::VertexArrayObject(const ProgramHandle program, const i32 stride,
+                                     std::initializer_list<VertexSpec> specs)
+        : program(program), stride(stride) {
 
-    for (u32 i = 0; i < vbo_ids.size(); ++i) {
-        auto& vbo = get_vbo(i);
-        const VertexSpec spec = specs.begin()[i];
-        vbo.bind();
-        glVertexAttribPointer(spec.index, spec.size, spec.type, false, spec.stride,
-                              reinterpret_cast<void*>(spec.offset));
-        glEnableVertexAttribArray(spec.index);
+    glCreateVertexArrays(1, &id);
+    for (const VertexSpec& spec : specs) {
+        glVertexArrayAttribFormat(id, spec.index, spec.size, spec.type, spec.normalized, spec.offset);
+        glVertexArrayAttribBinding(id, spec.index, 0);
+        glEnableVertexArrayAttrib(id, spec.index);
     }
+}
 
-    ebo.bind();
+DrawItem VertexArrayObject::draw_item(const GLenum primitive, const BufferPool& vertex_pool,
+                                      const BufferRange& vertices, const BufferPool& index_pool,
+                                      const BufferRange& indices) const {
+    DrawItem item;
+    item.program = app->renderer.shader_programs.get(program).id;
+    item.vao = id;
+    item.vertex_buffer = vertex_pool.get_buffer(vertices);
+    item.vertex_stride = stride;
+    item.index_buffer = index_pool.get_buffer(indices);
+    item.primitive = primitive;
+    item.count = static_cast<i32>(indices.count);
+    item.base_vertex = static_cast<i32>(vertices.offset);
+    item.first_index = indices.offset;
+    return item;
+}
 
-    glBindVertexArray(0);
+void GLState::invalidate() {
+    program = unknown;
+    vao = unknown;
+    vertex_buffer = unknown;
+    index_buffer = unknown;
+    polygon_mode = unknown;
+    depth_mask = unknown;
+    clip_distances = unknown;
+    textures.fill(unknown);
 }
 
-VertexBufferObject& VertexArrayObject::get_vbo(const u32 index) {
-    return app->renderer.vbos.at(vbo_ids.at(index));
+bool GLState::change(u32& cached, const u32 value, const u32 calls) {
+    if (cached == value) {
+        stats.elided += calls;
+        return false;
+    }
+    cached = value;
+    stats.issued += calls;
+    return true;
 }
 
-void VertexArrayObject::draw() {
-    app->renderer.shader_programs.at(shader_program_id).use();
-    glBindVertexArray(id);
-    glDrawElements(ebo.primitive, ebo.count, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+void GLState::use_program(const u32 id) {
+    if (change(program, id)) {
+        glUseProgram(id);
+    }
+}
+
+void GLState::bind_vertex_array(const u32 id) {
+    if (change(vao, id)) {
+        glBindVertexArray(id);
+        vertex_buffer = unknown;
+        index_buffer = unknown;
+    }
+}
+
+void GLState::bind_vertex_buffer(const u32 buffer, const i32 stride) {
+    if (change(vertex_buffer, buffer)) {
+        glVertexArrayVertexBuffer(vao, 0, buffer, 0, stride);
+    }
+}
+
+void GLState::bind_index_buffer(const u32 buffer) {
+    if (change(index_buffer, buffer)) {
+        glVertexArrayElementBuffer(vao, buffer);
+    }
+}
+
+void GLState::bind_texture(const u32 unit, const u32 texture) {
+    if (change(textures.at(unit), texture)) {
+        glBindTextureUnit(unit, texture);
+    }
+}
+
+void GLState::set_polygon_mode(const GLenum mode) {
+    if (change(polygon_mode, mode)) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+void GLState::set_depth_mask(const bool enabled) {
+    if (change(depth_mask, enabled)) {
+        glDepthMask(enabled);
+    }
+}
+
+void GLState::set_clip_distances(const bool enabled) {
+    if (change(clip_distances, enabled, 2)) {
+        if (enabled) {
+            glEnable(GL_CLIP_DISTANCE0);
+            glEnable(GL_CLIP_DISTANCE1);
+        } else {
+            glDisable(GL_CLIP_DISTANCE0);
+            glDisable(GL_CLIP_DISTANCE1);
+        }
+    }
+}
+
+u64 RenderQueue::make_key(const RenderPass pass, const u32 program, const u32 vao) {
+    return u64(pass) << 32 | u64(program & 0xFFFF) << 16 | u64(vao & 0xFFFF);
+}
+
+void RenderQueue::push(const RenderPass pass, DrawItem item) {
+    item.key = make_key(pass, item.program, item.vao);
+    items.push_back(item);
+}
+
+void RenderQueue::execute(GLState& state) {
+    std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+
+    for (const DrawItem& item : items) {
+        state.use_program(item.program);
+        state.bind_vertex_array(item.vao);
+        if (item.vertex_buffer != 0) {
+            state.bind_vertex_buffer(item.vertex_buffer, item.vertex_stride);
+        }
+        if (item.index_buffer != 0) {
+            state.bind_index_buffer(item.index_buffer);
+        }
+        if (item.texture != 0) {
+            state.bind_texture(0, item.texture);
+        }
+        state.set_polygon_mode(item.polygon_mode);
+        state.set_depth_mask(item.depth_mask);
+        state.set_clip_distances(item.clip_distances);
+
+        if (item.indexed) {
+            glDrawElementsInstancedBaseVertexBaseInstance(
+                    item.primitive, item.count, GL_UNSIGNED_INT,
+                    reinterpret_cast<const void*>(size_t(item.first_index) * sizeof(u32)), item.instances,
+                    item.base_vertex, item.base_instance);
+        } else {
+            glDrawArraysInstancedBaseInstance(item.primitive, 0, item.count, item.instances, item.base_instance);
+        }
+    }
+
+    items.clear();
 }
 
 void VertexArrayObject::destroy() {
     glDeleteVertexArrays(1, &id);
-    ebo.destroy();
     *this = VertexArrayObject();
 }
 
+PlanetMesh build_planet_mesh(const ProvinceGeometry& geometry, const BorderMode border_mode) {
+    PlanetMesh mesh;
+    std::vector<glm::vec3>& vertices = mesh.vertices;
+    std::vector<f64> longitudes;
+    std::vector<f32>& wraps = mesh.wraps;
+    std::vector<u32>& tri_indices = mesh.tri_indices;
+    std::vector<u32>& line_indices = mesh.line_indices;
+
+    // Ring of each vertex and its position along it, with repeated points counted once, for finding the triangle
+    // edges on a border. Earcut drops repeated points, including the point closing a ring.
+    std::vector<u32> vertex_rings;
+    std::vector<u32> ring_positions;
+    std::vector<u32> ring_lengths;
+    {
+        using Point = std::array<f64, 2>;
+        using Polygon = std::vector<std::vector<Point>>;
+        Polygon polygon_vec;
+
+        for (u32 poly = 0; poly < geometry.polygon_count(); ++poly) {
+            polygon_vec.clear();
+
+            for (u32 ring = geometry.polygon_offsets[poly]; ring < geometry.polygon_offsets[poly + 1]; ++ring) {
+                std::vector<Point> ring_vec;
+                for (u32 i = geometry.ring_offsets[ring]; i < geometry.ring_offsets[ring + 1]; ++i) {
+                    ring_vec.push_back({geometry.points[i].x, geometry.points[i].y});
+                }
+                polygon_vec.push_back(std::move(ring_vec));
+            }
+
+            std::vector<u32> poly_tri_indices = mapbox::earcut<u32>(polygon_vec);
+            CHECK_F(poly_tri_indices.size() % 3 == 0);
+
+            u32 tri_vertices_offset = static_cast<u32>(vertices.size());
+
+            for (const auto& ring : polygon_vec) {
+                u32 line_vertices_offset = static_cast<u32>(vertices.size());
+                bool first_vertex = true;
+
+                const auto ring_id = static_cast<u32>(ring_lengths.size());
+                const bool closed = ring.size() > 1 && ring.front() == ring.back();
+                u32 position = 0;
+                for (size_t k = 0; k < ring.size(); ++k) {
+                    if (k > 0 && ring[k] != ring[k - 1]) {
+                        ++position;
+                    }
+                    vertex_rings.push_back(ring_id);
+                    ring_positions.push_back(closed && k + 1 == ring.size() ? 0 : position);
+                }
+                ring_lengths.push_back(closed ? position : position + 1);
+
+                for (const auto& point : ring) {
+                    const glm::dvec3 v = lon_lat_to_sphere(point[0], point[1]);
+
+                    u32 i = static_cast<u32>(vertices.size());
+                    if (first_vertex) {
+                        line_indices.push_back(i);
+                        first_vertex = false;
+                    } else {
+                        line_indices.push_back(i);
+                        line_indices.push_back(i);
+                    }
+                    vertices.push_back(glm::vec3(v));
+                    longitudes.push_back(point[0]);
+                    wraps.push_back(point[0] >= 180.0 - antimeridian_tolerance    ? 1.0f
+                                    : point[0] <= -180.0 + antimeridian_tolerance ? -1.0f
+                                                                                  : 0.0f);
+                }
+                line_indices.push_back(line_vertices_offset);
+            }
+
+            for (u32 index : poly_tri_indices) {
+                tri_indices.push_back(index + tri_vertices_offset);
+            }
+        }
+    }
+
+    CHECK_F(tri_indices.size() % 3 == 0);
+    CHECK_F(line_indices.size() % 2 == 0);
+
+    if (border_mode == BorderMode::thick) {
+        mesh.border_segments = build_border_segments(vertices, vertex_rings);
+        DEXPR(mesh.border_segments.size());
+    }
+
+    // Thick borders are only drawn on the globe, so flat maps still need the lines.
+    if (border_mode != BorderMode::shaded) {
+        split_antimeridian(vertices, longitudes, wraps, tri_indices, 3);
+        split_antimeridian(vertices, longitudes, wraps, line_indices, 2);
+        DEXPR(vertices.size());
+        DEXPR(tri_indices.size() / 3);
+        DEXPR(line_indices.size() / 2);
+        return mesh;
+    }
+
+    const auto on_border = [&](const u32 a, const u32 b) {
+        if (vertex_rings[a] != vertex_rings[b]) {
+            return false;
+        }
+        const u32 distance = ring_positions[a] > ring_positions[b] ? ring_positions[a] - ring_positions[b]
+                                                                   : ring_positions[b] - ring_positions[a];
+        return distance == 1 || distance + 1 == ring_lengths[vertex_rings[a]];
+    };
+
+    // Bit i is set if the edge opposite corner i is on a border.
+    std::vector<u8> tri_borders(tri_indices.size() / 3);
+    for (size_t t = 0; t < tri_borders.size(); ++t) {
+        const u32* const corners = &tri_indices[3 * t];
+        tri_borders[t] = static_cast<u8>(on_border(corners[1], corners[2]) | on_border(corners[2], corners[0]) << 1 |
+                                         on_border(corners[0], corners[1]) << 2);
+    }
+    split_antimeridian(vertices, longitudes, wraps, tri_indices, 3, &tri_borders);
+
+    // Every triangle gets its own corners, holding the triangle's barycentric coordinates. The coordinate for an edge
+    // that isn't a border is 1 at every corner, so only border edges are ever near 0.
+    PlanetMesh shaded;
+    shaded.vertices.reserve(tri_indices.size());
+    shaded.wraps.reserve(tri_indices.size());
+    shaded.edges.reserve(tri_indices.size());
+    shaded.tri_indices.reserve(tri_indices.size());
+    for (size_t i = 0; i < tri_indices.size(); ++i) {
+        const size_t corner = i % 3;
+        const u8 borders = tri_borders[i / 3];
+        glm::u8vec4 edges(0);
+        for (u32 edge = 0; edge < 3; ++edge) {
+            edges[static_cast<i32>(edge)] = edge == corner || !(borders >> edge & 1) ? 255 : 0;
+        }
+
+        shaded.vertices.push_back(vertices[tri_indices[i]]);
+        shaded.wraps.push_back(wraps[tri_indices[i]]);
+        shaded.edges.push_back(edges);
+        shaded.tri_indices.push_back(static_cast<u32>(i));
+    }
+    DEXPR(shaded.vertices.size());
+    DEXPR(shaded.tri_indices.size() / 3);
+
+    return shaded;
+}
+
+PlanetMesh build_placeholder_mesh() {
+    constexpr u32 columns = 64;
+    constexpr u32 rows = 32;
+
+    PlanetMesh mesh;
+    for (u32 row = 0; row <= rows; ++row) {
+        const f64 latitude = -90.0 + 180.0 * row / rows;
+        for (u32 column = 0; column <= columns; ++column) {
+            const f64 longitude = -180.0 + 360.0 * column / columns;
+            mesh.vertices.push_back(glm::vec3(lon_lat_to_sphere(longitude, latitude)));
+            mesh.wraps.push_back(column == 0 ? -1.0f : column == columns ? 1.0f : 0.0f);
+        }
+    }
+
+    for (u32 row = 0; row < rows; ++row) {
+        for (u32 column = 0; column < columns; ++column) {
+            const u32 i = row * (columns + 1) + column;
+            const u32 above = i + columns + 1;
+            mesh.tri_indices.insert(mesh.tri_indices.end(), {i, i + 1, above, i + 1, above + 1, above});
+        }
+    }
+
+    return mesh;
+}
+
 void Renderer::init() {
 
     CHECK_F(gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)));
@@ -299,160 +765,215 @@ void Renderer::init() {
     glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
     glLineWidth(1.0f);
 
-    view_projection_ubo = UniformBufferObject("ViewProjection", 0, GL_STREAM_DRAW);
+    view_projection_ubo = UniformBufferObject(Keyword::ViewProjection, 0, GL_STREAM_DRAW);
 
-    std::vector<glm::vec3> vertices;
-    std::vector<u32> tri_indices;
-    std::vector<u32> line_indices;
-    {
-        using Point = std::array<f64, 2>;
-        using Polygon = std::vector<std::vector<Point>>;
-        Polygon polygon_vec;
+    const ShaderHandle planet_vert = add_shader("planet.vert", GL_VERTEX_SHADER);
+    const ShaderHandle planet_frag = add_shader("planet.frag", GL_FRAGMENT_SHADER);
+    const ProgramHandle planet_prog = add_shader_program(planet_vert, planet_frag);
 
-        for (auto& feature : app->admin_1_fixed_l) {
-            CHECK_F(feature->GetGeomFieldCount() == 1);
+    const ShaderHandle outline_frag = add_shader("outline.frag", GL_FRAGMENT_SHADER);
+    const ProgramHandle outline_prog = add_shader_program(planet_vert, outline_frag);
 
-            OGRGeometry* geom = feature->GetGeometryRef();
-            CHECK_F(geom->getGeometryType() == wkbMultiPolygon);
-
-            OGRMultiPolygon* multi_poly = geom->toMultiPolygon();
-            CHECK_F(multi_poly->getNumGeometries() > 0);
+    const VertexSpec position_spec = {
+            .index = 0,
+            .size = 3,
+            .type = GL_FLOAT,
+            .offset = offsetof(PlanetVertex, position),
+    };
+    const VertexSpec wrap_spec = {
+            .index = 1,
+            .size = 1,
+            .type = GL_FLOAT,
+            .offset = offsetof(PlanetVertex, wrap),
+    };
+    const VertexSpec edges_spec = {
+            .index = 2,
+            .size = 3,
+            .type = GL_UNSIGNED_BYTE,
+            .offset = offsetof(PlanetVertex, edges),
+            .normalized = true,
+    };
 
-            for (auto& poly : multi_poly) {
-                CHECK_NOTNULL_F(poly->getExteriorRing());
-                polygon_vec.clear();
+    // Buffers of a million vertices, or four million indices
+    vertex_pool.init(sizeof(PlanetVertex), 64, 14);
+    index_pool.init(sizeof(u32), 256, 14);
 
-                for (auto& ring : poly) {
-                    CHECK_F(ring->getNumPoints() > 0);
+    // The planet is filled in by `upload_planet`, first with the placeholder.
+    planet_vao = VertexArrayObject(planet_prog, sizeof(PlanetVertex), {position_spec, wrap_spec, edges_spec});
+    outline_vao = VertexArrayObject(outline_prog, sizeof(PlanetVertex), {position_spec, wrap_spec, edges_spec});
+    upload_planet(build_placeholder_mesh());
 
-                    std::vector<Point> ring_vec;
-                    for (auto& point : ring) {
-                        CHECK_F(!point.Is3D());
-                        const f64 longitude = point.getX();
-                        const f64 latitude = point.getY();
-                        CHECK_F(latitude >= -90 && latitude <= 90);
-                        CHECK_F(longitude >= -180 && longitude <= 180);
-                        ring_vec.push_back({longitude, latitude});
-                    }
-                    polygon_vec.push_back(std::move(ring_vec));
-                }
+    for (const ProgramHandle handle : {planet_prog, outline_prog}) {
+        shader_programs.get(handle).bind_uniform_block(view_projection_ubo);
+    }
 
-                std::vector<u32> poly_tri_indices = mapbox::earcut<u32>(polygon_vec);
-                CHECK_F(poly_tri_indices.size() % 3 == 0);
-
-                u32 tri_vertices_offset = static_cast<u32>(vertices.size());
-
-                for (const auto& ring : polygon_vec) {
-                    u32 line_vertices_offset = static_cast<u32>(vertices.size());
-                    bool first_vertex = true;
-
-                    for (const auto& point : ring) {
-                        const f64 longitude = point[0];
-                        const f64 latitude = point[1];
-                        const f64 azimuth = glm::radians(-longitude + 180);
-                        const f64 inclination = glm::radians(-latitude + 90);
-                        const glm::dvec3 v = {std::sin(inclination) * std::cos(azimuth), std::cos(inclination),
-                                              std::sin(inclination) * std::sin(azimuth)};
-
-                        u32 i = static_cast<u32>(vertices.size());
-                        if (first_vertex) {
-                            line_indices.push_back(i);
-                            first_vertex = false;
-                        } else {
-                            line_indices.push_back(i);
-                            line_indices.push_back(i);
-                        }
-                        vertices.push_back(glm::vec3(v));
-                    }
-                    line_indices.push_back(line_vertices_offset);
-                }
+    const Path terrain_path = app->options.terrain_path.empty() ? app->get_resource_path("gis/raster/terrain.tif")
+                                                                 : app->options.terrain_path;
+    if (!terrain.init(terrain_path, app->options.terrain)) {
+        LOG_F(WARNING, "Terrain is disabled");
+    }
 
-                for (u32 index : poly_tri_indices) {
-                    tri_indices.push_back(index + tri_vertices_offset);
-                }
-            }
+    resolution_config = app->options.resolution;
+    borders = app->options.borders;
+    lines.init(*this);
+    lines.styles[static_cast<u32>(LineClass::borders)].width_scale = borders.width_px;
+    i32 max_samples;
+    glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+    const i32 samples = std::min(render_samples, max_samples);
+    if (resolution_config.enabled) {
+        for (i32 step = 0; step <= 5; ++step) {
+            const f32 scale =
+                    resolution_config.min_scale + (1.0f - resolution_config.min_scale) * 0.2f * static_cast<f32>(step);
+            quality_ladder.push_back({scale, 0});
         }
+        for (i32 step_samples = 2; step_samples <= samples; step_samples *= 2) {
+            quality_ladder.push_back({1.0f, step_samples});
+        }
+    } else {
+        quality_ladder.push_back({1.0f, samples});
     }
+    quality = static_cast<u32>(quality_ladder.size() - 1);
+    frame_timer.init();
+}
 
-    CHECK_F(tri_indices.size() % 3 == 0);
-    CHECK_F(line_indices.size() % 2 == 0);
-    DEXPR(vertices.size());
-    DEXPR(tri_indices.size() / 3);
-    DEXPR(line_indices.size() / 2);
-
-    u32 planet_vert = add_shader("planet.vert", GL_VERTEX_SHADER);
-    u32 planet_frag = add_shader("planet.frag", GL_FRAGMENT_SHADER);
-    u32 planet_prog = add_shader_program(planet_vert, planet_frag);
-
-    u32 outline_frag = add_shader("outline.frag", GL_FRAGMENT_SHADER);
-    u32 outline_prog = add_shader_program(planet_vert, outline_frag);
+// The old ranges may still be drawn by frames in flight, so the pools hold on to them until those frames finish.
+void Renderer::upload_planet(const PlanetMesh& mesh) {
+    std::vector<PlanetVertex> vertices(mesh.vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        vertices[i] = {mesh.vertices[i], mesh.wraps[i], mesh.edges.empty() ? glm::u8vec4(255) : mesh.edges[i]};
+    }
 
-    const u32 planet_vbo = add_vbo(GL_STATIC_DRAW);
-    const VertexSpec planet_spec = {
-            .index = 0,
-            .size = 3,
-            .type = GL_FLOAT,
-            .stride = 3 * sizeof(f32),
-            .offset = 0,
-    };
+    vertex_pool.free(planet_vertices);
+    index_pool.free(planet_tri_indices);
+    index_pool.free(planet_line_indices);
 
-    vbos.at(planet_vbo)
-            .buffer_data_realloc(vertices.data(), static_cast<GLsizeiptr>(vertices.size() * sizeof(glm::vec3)));
+    planet_vertices = vertex_pool.allocate(static_cast<u32>(vertices.size()));
+    planet_tri_indices = index_pool.allocate(static_cast<u32>(mesh.tri_indices.size()));
+    planet_line_indices = index_pool.allocate(static_cast<u32>(mesh.line_indices.size()));
 
-    auto planet_ebo = ElementBufferObject(GL_STATIC_DRAW, GL_TRIANGLES);
-    planet_ebo.buffer_elements_realloc(tri_indices.data(), static_cast<i32>(tri_indices.size()));
-    planet_vao = VertexArrayObject(planet_prog, {planet_vbo}, {planet_spec}, planet_ebo);
+    vertex_pool.upload(planet_vertices, vertices.data());
+    index_pool.upload(planet_tri_indices, mesh.tri_indices.data());
+    index_pool.upload(planet_line_indices, mesh.line_indices.data());
+}
 
-    auto outline_ebo = ElementBufferObject(GL_STATIC_DRAW, GL_LINES);
-    outline_ebo.buffer_elements_realloc(line_indices.data(), static_cast<i32>(line_indices.size()));
-    outline_vao = VertexArrayObject(outline_prog, {planet_vbo}, {planet_spec}, outline_ebo);
+void Renderer::init_provinces(const PlanetMesh& mesh) {
+    upload_planet(mesh);
+    text.init(*this);
+    // Setting up labels binds a texture and a VAO directly.
+    gl_state.invalidate();
+    lines.set_segments(LineClass::borders, mesh.border_segments);
 
-    for (u32 id : {planet_prog, outline_prog}) {
-        auto& program = shader_programs.at(id);
-        program.bind_uniform_block(view_projection_ubo);
-    }
+    vertex_pool.log_report("Vertex");
+    index_pool.log_report("Index");
 }
 
-void Renderer::render() {
-
-    {
-        std::unordered_set<u32> programs_to_load;
-        for (auto& entry : shaders) {
-            Shader& shader = entry.second;
-            if (shader.load()) {
-                auto range = shader_users.equal_range(shader.id);
-                for (auto it = range.first; it != range.second; ++it) {
-                    programs_to_load.insert(it->second);
+bool Renderer::reload_shaders() {
+    std::vector<ProgramHandle> programs_to_load;
+    for (Shader& shader : shaders) {
+        if (shader.load()) {
+            for (const ProgramHandle user : shader.users) {
+                if (std::find(programs_to_load.begin(), programs_to_load.end(), user) == programs_to_load.end()) {
+                    programs_to_load.push_back(user);
                 }
             }
         }
+    }
 
-        for (auto id : programs_to_load) {
-            shader_programs.at(id).load();
-        }
+    for (const ProgramHandle handle : programs_to_load) {
+        shader_programs.get(handle).load();
     }
 
-    if (app->wireframe_render) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    } else {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    return !programs_to_load.empty();
+}
+
+void Renderer::render() {
+    gl_state.stats = GLStateStats();
+    last_gpu_ms = -1.0f;
+    vertex_pool.update();
+    index_pool.update();
+
+    // Minimized
+    if (view.framebuffer_width <= 0 || view.framebuffer_height <= 0) {
+        return;
     }
 
+    const f32 frame_gpu_ms = frame_timer.begin();
+    last_gpu_ms = frame_gpu_ms;
+    update_quality(frame_gpu_ms);
+    update_framebuffers();
+
+    scene_framebuffer.bind();
+    glViewport(0, 0, render_width, render_height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0, app->framebuffer_width, app->framebuffer_height);
 
-    const glm::mat4 view = glm::lookAt(app->camera_pos, app->camera_target, app->camera_up);
+    const glm::mat4 view_matrix = glm::lookAt(view.camera_pos, view.camera_target, view.camera_up);
     const glm::mat4 projection = glm::perspective(
-            app->fovy, static_cast<f32>(app->framebuffer_width) / static_cast<f32>(app->framebuffer_height), 0.01f,
+            view.fovy, static_cast<f32>(view.framebuffer_width) / static_cast<f32>(view.framebuffer_height), 0.01f,
             1000.0f);
 
-    const glm::mat4 vp = projection * view;
+    const glm::mat4 vp = projection * view_matrix;
     view_projection_ubo.buffer_data(glm::value_ptr(vp), sizeof(vp));
 
-    planet_vao.draw();
-    outline_vao.draw();
+    const f64 now_s = glfwGetTime();
+    projection_blend = std::min(
+            projection_blend + static_cast<f32>(now_s - last_render_s) / projection_transition_s, 1.0f);
+    last_render_s = now_s;
+
+    // Ease in and out
+    const f32 blend = projection_blend * projection_blend * (3.0f - 2.0f * projection_blend);
+    for (const ProgramHandle handle : {planet_vao.program, outline_vao.program}) {
+        ShaderProgram& program = shader_programs.get(handle);
+        program.set_uniform_i32(Keyword::projection_from, static_cast<i32>(projection_from));
+        program.set_uniform_i32(Keyword::projection_to, static_cast<i32>(projection_to));
+        program.set_uniform_f32(Keyword::projection_blend, blend);
+    }
+
+    const f32 focal_pixels = static_cast<f32>(view.framebuffer_height) / (2.0f * std::tan(0.5f * view.fovy));
+    terrain.update(app->thread_pool, view.camera_pos, focal_pixels);
+    ShaderProgram& planet_program = shader_programs.get(planet_vao.program);
+    terrain.bind(planet_program, gl_state);
+    // Border widths are in window pixels, and the scene is drawn at `pixel_scale` render target pixels to each.
+    const f32 pixel_scale = static_cast<f32>(render_width) / static_cast<f32>(view.framebuffer_width);
+    planet_program.set_uniform_bool(Keyword::borders_enabled, borders.mode == BorderMode::shaded);
+    planet_program.set_uniform_f32(Keyword::border_width, borders.width_px * pixel_scale);
+
+    const GLenum polygon_mode = view.wireframe ? GL_LINE : GL_FILL;
+    DrawItem planet_item =
+            planet_vao.draw_item(GL_TRIANGLES, vertex_pool, planet_vertices, index_pool, planet_tri_indices);
+    planet_item.polygon_mode = polygon_mode;
+    planet_item.clip_distances = true;
+    queue.push(RenderPass::opaque, planet_item);
+
+    // Labels and thick lines are laid out on the sphere, so they are only drawn on the globe, where thick borders
+    // replace the line pass.
+    const bool on_globe = projection_to == MapProjection::globe && projection_blend >= 1.0f;
+    const bool thick_borders = borders.mode == BorderMode::thick && on_globe;
+
+    // The placeholder has no borders.
+    if (planet_line_indices && !thick_borders) {
+        DrawItem outline_item =
+                outline_vao.draw_item(GL_LINES, vertex_pool, planet_vertices, index_pool, planet_line_indices);
+        outline_item.polygon_mode = polygon_mode;
+        outline_item.clip_distances = true;
+        queue.push(RenderPass::overlay, outline_item);
+    }
 
-    glfwSwapBuffers(app->window);
+    if (on_globe) {
+        lines.render(view.camera_pos, {static_cast<f32>(render_width), static_cast<f32>(render_height)}, pixel_scale,
+                     queue);
+
+        LabelView label_view;
+        label_view.view_projection = vp;
+        label_view.camera_pos = view.camera_pos;
+        label_view.viewport = {view.framebuffer_width, view.framebuffer_height};
+        label_view.focal_pixels = focal_pixels;
+        text.render(label_view, queue);
+    }
+
+    queue.execute(gl_state);
+
+    resolve_framebuffers();
+    frame_timer.end();
 
 #ifdef DEBUG
     switch (glGetError()) {
@@ -486,30 +1007,206 @@ void Renderer::render() {
 #endif
 }
 
-u32 Renderer::add_vbo(const GLenum usage) {
-    auto vbo = VertexBufferObject(usage);
-    u32 id = vbo.id;
-    vbos.emplace(id, vbo);
-    return id;
+bool Renderer::is_animating() const {
+    const bool resizing = render_width != wanted_width || render_height != wanted_height;
+    return projection_blend < 1.0f || terrain.is_loading() || text.placer.fading_count > 0 || resizing;
+}
+
+void Renderer::bench_borders(const PlanetMesh& line_mesh, const PlanetMesh& shaded_mesh) {
+    constexpr std::array modes = {BorderMode::lines, BorderMode::thick, BorderMode::shaded};
+    constexpr u32 rounds = 6;
+    constexpr u32 frames_per_round = 60;
+
+    if (view.framebuffer_width <= 0 || view.framebuffer_height <= 0) {
+        LOG_F(WARNING, "Border benchmark skipped while minimized");
+        return;
+    }
+
+    // Dynamic resolution would answer a slower mode with fewer pixels, so the ladder is pinned to its top step.
+    const std::vector<std::pair<f32, i32>> saved_ladder = quality_ladder;
+    const u32 saved_quality = quality;
+    const BorderMode saved_mode = borders.mode;
+    quality_ladder = {saved_ladder.back()};
+    quality = 0;
+
+    const auto use_mode = [&](const BorderMode mode) {
+        const PlanetMesh& mesh = mode == BorderMode::shaded ? shaded_mesh : line_mesh;
+        borders.mode = mode;
+        upload_planet(mesh);
+        lines.set_segments(LineClass::borders, mesh.border_segments);
+    };
+
+    // Modes take turns so that anything else slowing the GPU down, such as terrain streaming in, is shared between
+    // them. The first round only warms up. Each frame is finished before the next so that they don't overlap, and the
+    // timer's first results after a switch belong to the previous mode.
+    std::array<f64, modes.size()> total_ms = {};
+    std::array<u32, modes.size()> measured_frames = {};
+    for (u32 round = 0; round <= rounds; ++round) {
+        for (size_t m = 0; m < modes.size(); ++m) {
+            use_mode(modes[m]);
+            for (u32 frame = 0; frame < FrameTimer::query_count + frames_per_round; ++frame) {
+                render();
+                glFinish();
+                if (round > 0 && frame >= FrameTimer::query_count && last_gpu_ms >= 0.0f) {
+                    total_ms[m] += static_cast<f64>(last_gpu_ms);
+                    ++measured_frames[m];
+                }
+            }
+        }
+    }
+
+    std::array<f64, modes.size()> average_ms = {};
+    for (size_t m = 0; m < modes.size(); ++m) {
+        average_ms[m] = measured_frames[m] > 0 ? total_ms[m] / measured_frames[m] : -1.0;
+    }
+    LOG_F(INFO, "Border GPU time at {}x{} with {}x MSAA over {} frames each: lines {:.3f} ms, thick {:.3f} ms, "
+          "shaded {:.3f} ms", render_width, render_height, quality_ladder[0].second, measured_frames[0],
+          average_ms[0], average_ms[1], average_ms[2]);
+
+    quality_ladder = saved_ladder;
+    quality = saved_quality;
+    settle_frames = FrameTimer::query_count;
+    use_mode(saved_mode);
+}
+
+void Renderer::set_projection(const MapProjection projection) {
+    if (projection == projection_to) {
+        return;
+    }
+
+    // Turning back mid-transition reverses it from where it is. The planet can only morph between two projections, so
+    // heading for a third one instead jumps to whichever end of the current transition is closer and starts from
+    // there.
+    if (projection == projection_from) {
+        projection_from = projection_to;
+        projection_blend = 1.0f - projection_blend;
+    } else {
+        if (projection_blend >= 0.5f) {
+            projection_from = projection_to;
+        }
+        projection_blend = 0.0f;
+    }
+    projection_to = projection;
+    // Nothing is drawn while idle, so time before now isn't part of the transition.
+    last_render_s = glfwGetTime();
+    LOG_F(INFO, "Projection: {}", get_projection_name(projection));
+}
+
+void Renderer::update_quality(const f32 frame_gpu_ms) {
+    if (frame_gpu_ms < 0.0f || quality_ladder.size() < 2) {
+        return;
+    }
+    if (settle_frames > 0) {
+        --settle_frames;
+        return;
+    }
+
+    gpu_ms = gpu_ms > 0.0f ? 0.8f * gpu_ms + 0.2f * frame_gpu_ms : frame_gpu_ms;
+
+    const f32 budget_ms = resolution_config.frame_budget_ms;
+    over_budget_frames = gpu_ms > budget_ms ? over_budget_frames + 1 : 0;
+    under_budget_frames = gpu_ms < budget_ms * resolution_config.headroom ? under_budget_frames + 1 : 0;
+
+    u32 new_quality = quality;
+    if (over_budget_frames >= resolution_config.frames_to_lower && quality > 0) {
+        --new_quality;
+    } else if (under_budget_frames >= resolution_config.frames_to_raise && quality + 1 < quality_ladder.size()) {
+        ++new_quality;
+    }
+
+    if (new_quality != quality) {
+        quality = new_quality;
+        over_budget_frames = 0;
+        under_budget_frames = 0;
+        settle_frames = FrameTimer::query_count;
+        LOG_F(INFO, "Resolution {:.0f}% with {}x MSAA, GPU {:.2f} ms", quality_ladder[quality].first * 100.0f,
+              quality_ladder[quality].second, gpu_ms);
+    }
+}
+
+void Renderer::update_framebuffers() {
+    const auto [scale, samples] = quality_ladder[quality];
+    const i32 window_width = view.framebuffer_width;
+    const i32 window_height = view.framebuffer_height;
+    const i32 width = std::max(1, static_cast<i32>(std::lround(static_cast<f32>(window_width) * scale)));
+    const i32 height = std::max(1, static_cast<i32>(std::lround(static_cast<f32>(window_height) * scale)));
+
+    if (width != wanted_width || height != wanted_height) {
+        wanted_width = width;
+        wanted_height = height;
+        stable_frames = 0;
+    } else {
+        ++stable_frames;
+    }
+
+    const auto allocated_width = static_cast<i32>(scene_framebuffer.width);
+    const auto allocated_height = static_cast<i32>(scene_framebuffer.height);
+    const bool stable = stable_frames >= resolution_config.resize_stable_frames;
+
+    // Lower resolutions draw into part of the framebuffer, so only a larger window, or a much smaller one, needs a
+    // new one.
+    bool reallocate = scene_framebuffer.id == 0 || samples != scene_framebuffer.samples;
+    if (stable && (width > allocated_width || height > allocated_height)) {
+        reallocate = true;
+    }
+    if (stable && (4 * window_width < 3 * allocated_width || 4 * window_height < 3 * allocated_height)) {
+        reallocate = true;
+    }
+
+    if (reallocate) {
+        const i32 new_width = std::max(width, stable ? 0 : allocated_width);
+        const i32 new_height = std::max(height, stable ? 0 : allocated_height);
+        scene_framebuffer.destroy();
+        resolve_framebuffer.destroy();
+        scene_framebuffer = Framebuffer(static_cast<u32>(new_width), static_cast<u32>(new_height), samples);
+        if (samples > 0) {
+            resolve_framebuffer = Framebuffer(static_cast<u32>(new_width), static_cast<u32>(new_height), 0);
+        }
+        DLOG_F(INFO, "Allocated {}x{} framebuffer with {}x MSAA", new_width, new_height, samples);
+    }
+
+    // Until a new size settles, the old framebuffer is stretched to fit.
+    render_width = std::min(width, static_cast<i32>(scene_framebuffer.width));
+    render_height = std::min(height, static_cast<i32>(scene_framebuffer.height));
+}
+
+void Renderer::resolve_framebuffers() {
+    u32 read_framebuffer = scene_framebuffer.id;
+    if (scene_framebuffer.samples > 0) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_framebuffer.id);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_framebuffer.id);
+        glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, render_width, render_height, GL_COLOR_BUFFER_BIT,
+                          GL_NEAREST);
+        read_framebuffer = resolve_framebuffer.id;
+    }
+
+    const i32 window_width = view.framebuffer_width;
+    const i32 window_height = view.framebuffer_height;
+    const bool same_size = render_width == window_width && render_height == window_height;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, window_width, window_height, GL_COLOR_BUFFER_BIT,
+                      same_size ? GL_NEAREST : GL_LINEAR);
+    Framebuffer::bind_default();
+}
+
+VboHandle Renderer::add_vbo(const GLenum usage) {
+    return vbos.insert(VertexBufferObject(usage));
 }
 
-void Renderer::erase_vbo(const u32 id) {
-    vbos.at(id).destroy();
-    vbos.erase(id);
+void Renderer::erase_vbo(const VboHandle handle) {
+    vbos.get(handle).destroy();
+    vbos.erase(handle);
 }
 
-u32 Renderer::add_shader(const Path& shader_path, GLenum type) {
-    auto shader = Shader(shader_path, type);
-    u32 id = shader.id;
-    shaders.emplace(id, shader);
-    return id;
+ShaderHandle Renderer::add_shader(const Path& shader_path, GLenum type) {
+    return shaders.insert(Shader(shader_path, type));
 }
 
-u32 Renderer::add_shader_program(u32 vertex_shader, u32 fragment_shader) {
-    auto program = ShaderProgram(shaders.at(vertex_shader), shaders.at(fragment_shader));
-    u32 id = program.id;
-    shader_programs.emplace(id, program);
-    shader_users.emplace(vertex_shader, id);
-    shader_users.emplace(fragment_shader, id);
-    return id;
+ProgramHandle Renderer::add_shader_program(const ShaderHandle vertex_shader, const ShaderHandle fragment_shader) {
+    const ProgramHandle handle =
+            shader_programs.insert(ShaderProgram(shaders.get(vertex_shader), shaders.get(fragment_shader)));
+    shaders.get(vertex_shader).users.push_back(handle);
+    shaders.get(fragment_shader).users.push_back(handle);
+    return handle;
 }
@@ -1,13 +1,26 @@
 #pragma once
 
+#include "buffer_pool.hpp"
 #include "filesystem.hpp"
+#include "lines.hpp"
+#include "slot_map.hpp"
+#include "symbol.hpp"
+#include "terrain.hpp"
+#include "text.hpp"
 #include "utility.hpp"
 
 #include <glad/glad.h>
+#include <glm/ext/vector_uint4_sized.hpp>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
+#include <array>
 #include <initializer_list>
-#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ProvinceGeometry;
+struct ShaderProgram;
 
 struct GLBuffer {
 public:
@@ -43,18 +56,20 @@ struct ElementBufferObject : public GLBuffer {
 };
 
 struct UniformBufferObject : public GLBuffer {
-    const char* name;
+    Symbol name;
     u32 binding;
 
     UniformBufferObject() = default;
-    UniformBufferObject(const char* name, u32 binding, GLenum usage);
+    UniformBufferObject(Symbol name, u32 binding, GLenum usage);
 };
 
 struct Framebuffer {
     static void bind_default();
 
     u32 id = 0;
-    u32 width, height;
+    u32 width = 0;
+    u32 height = 0;
+    i32 samples = 0;
 
     union {
         struct {
@@ -65,7 +80,7 @@ struct Framebuffer {
     };
 
     Framebuffer() = default;
-    Framebuffer(u32 width, u32 height);
+    Framebuffer(u32 width, u32 height, i32 samples);
 
     void bind();
     void destroy();
@@ -75,6 +90,8 @@ struct Shader {
     u32 id = 0;
     Path path;
     std::filesystem::file_time_type last_time = std::filesystem::file_time_type::min();
+    // Programs to relink when this shader is reloaded
+    std::vector<Handle<ShaderProgram>> users;
 
     Shader() = default;
     Shader(const Path& shader_path, GLenum type);
@@ -84,20 +101,23 @@ struct Shader {
 
 struct ShaderProgram {
     u32 id = 0;
+    // Uniform locations looked up since the last link. Programs have a handful of uniforms, so a linear search of
+    // symbol IDs beats hashing.
+    std::vector<std::pair<Symbol, i32>> locations;
 
     ShaderProgram() = default;
     ShaderProgram(const Shader& vertex_shader, const Shader& fragment_shader);
 
-    void set_uniform_f32(const char* name, f32 value);
-    void set_uniform_i32(const char* name, i32 value);
-    void set_uniform_bool(const char* name, bool value);
-    void set_uniform_mat4(const char* name, const f32* data);
-    void set_uniform_vec3(const char* name, const f32* data);
-    void set_uniform_vec3(const char* name, const glm::vec3& data);
+    void set_uniform_f32(Symbol name, f32 value);
+    void set_uniform_i32(Symbol name, i32 value);
+    void set_uniform_bool(Symbol name, bool value);
+    void set_uniform_mat4(Symbol name, const f32* data);
+    void set_uniform_vec2(Symbol name, const glm::vec2& data);
+    void set_uniform_vec3(Symbol name, const f32* data);
+    void set_uniform_vec3(Symbol name, const glm::vec3& data);
 
-    i32 get_location(const char* name);
+    i32 get_location(Symbol name);
     void bind_uniform_block(const UniformBufferObject& ubo);
-    void use();
     void load();
 };
 
@@ -105,43 +125,305 @@ struct VertexSpec {
     u32 index;
     i32 size;
     GLenum type;
-    GLsizei stride;
-    ptrdiff_t offset;
+    u32 offset;
+    // Integers are read as fractions of their maximum
+    bool normalized = false;
+};
+
+enum class RenderPass : u8 {
+    // Planet surface
+    opaque,
+    // Borders, drawn over the surface so that their smoothed edges blend with it
+    overlay,
+    // Labels, which are depth tested but don't write depth
+    labels,
+};
+
+struct DrawItem {
+    u64 key;
+    u32 program;
+    u32 vao;
+    // Attached to the VAO before drawing if not 0. Otherwise the VAO's own buffers are used.
+    u32 vertex_buffer = 0;
+    i32 vertex_stride = 0;
+    u32 index_buffer = 0;
+    GLenum primitive;
+    // Indexed draws read `count` indices from `first_index` and add `base_vertex` to each. Otherwise `count` vertices
+    // are drawn `instances` times.
+    bool indexed = true;
+    i32 count;
+    i32 base_vertex = 0;
+    u32 first_index = 0;
+    i32 instances = 1;
+    // Added to `gl_InstanceID` for instanced attributes, and readable as `gl_BaseInstance`
+    u32 base_instance = 0;
+    // Bound to texture unit 0 if not 0
+    u32 texture = 0;
+    GLenum polygon_mode = GL_FILL;
+    bool depth_mask = true;
+    // Whether the program writes `gl_ClipDistance[0]` and `[1]`
+    bool clip_distances = false;
+};
+
+struct GLStateStats {
+    u64 issued = 0;
+    u64 elided = 0;
+};
+
+// Shadow copy of the GL state that draws change, so that setting something to what it already is costs nothing. Code
+// that changes this state directly must call `invalidate()` afterwards.
+struct GLState {
+    static constexpr u32 texture_units = 4;
+    static constexpr u32 unknown = ~0u;
+
+    u32 program = 0;
+    u32 vao = 0;
+    // Buffers attached to `vao`, forgotten when another VAO is bound
+    u32 vertex_buffer = unknown;
+    u32 index_buffer = unknown;
+    u32 polygon_mode = GL_FILL;
+    u32 depth_mask = 1;
+    u32 clip_distances = 0;
+    std::array<u32, texture_units> textures = {};
+    GLStateStats stats;
+
+    void invalidate();
+
+    void use_program(u32 id);
+    void bind_vertex_array(u32 id);
+    // Attach buffers to the bound VAO's binding 0 and element buffer.
+    void bind_vertex_buffer(u32 buffer, i32 stride);
+    void bind_index_buffer(u32 buffer);
+    void bind_texture(u32 unit, u32 texture);
+    void set_polygon_mode(GLenum mode);
+    void set_depth_mask(bool enabled);
+    void set_clip_distances(bool enabled);
+
+private:
+    // Returns true, and counts the call as issued, if `value` differs from `cached`.
+    bool change(u32& cached, u32 value, u32 calls = 1);
 };
 
+// Draws collected over a frame, then sorted and issued through a `GLState`. Keys order draws by pass, then program,
+// then VAO, so that draws sharing state are adjacent. Every draw covers a whole mesh or batch, so there is nothing to
+// sort by depth, and draws with the same key keep the order they were pushed in.
+struct RenderQueue {
+    std::vector<DrawItem> items;
+
+    static u64 make_key(RenderPass pass, u32 program, u32 vao);
+
+    void push(RenderPass pass, DrawItem item);
+    void execute(GLState& state);
+};
+
+using VboHandle = Handle<VertexBufferObject>;
+using ShaderHandle = Handle<Shader>;
+using ProgramHandle = Handle<ShaderProgram>;
+
+// A vertex format and the program drawing it. Every attribute reads from binding 0, and the buffers are attached per
+// draw, so meshes anywhere in a `BufferPool` share the VAO.
 struct VertexArrayObject {
     u32 id = 0;
-    u32 shader_program_id;
-    std::vector<u32> vbo_ids;
-    ElementBufferObject ebo;
+    ProgramHandle program;
+    i32 stride = 0;
 
     VertexArrayObject() = default;
-    VertexArrayObject(u32 shader_program_id, std::initializer_list<u32> vbo_ids,
-                      std::initializer_list<VertexSpec> specs, ElementBufferObject ebo);
+    VertexArrayObject(ProgramHandle program, i32 stride, std::initializer_list<VertexSpec> specs);
+
+    // An indexed draw of `indices`, whose values count from the start of `vertices`.
+    DrawItem draw_item(GLenum primitive, const BufferPool& vertex_pool, const BufferRange& vertices,
+                       const BufferPool& index_pool, const BufferRange& indices) const;
+    void destroy();
+};
+
+struct DynamicResolutionConfig {
+    // If false, the scene is always drawn at the window's resolution with `render_samples`.
+    bool enabled = true;
+    // GPU time per frame to stay under
+    f32 frame_budget_ms = 14.0f;
+    // Lowest resolution, as a fraction of the window's along each axis
+    f32 min_scale = 0.5f;
+    // Quality is only raised while GPU time stays below this fraction of the budget, so it doesn't oscillate.
+    f32 headroom = 0.75f;
+    u32 frames_to_lower = 3;
+    u32 frames_to_raise = 60;
+    // A new window size is only allocated once it has stayed the same for this many frames, so dragging the window's
+    // edge doesn't reallocate every frame.
+    u32 resize_stable_frames = 10;
+};
 
-    VertexBufferObject& get_vbo(u32 index);
-    void draw();
+// Measures GPU time per frame with timer queries. Results are read a few frames later, so the CPU never waits on
+// them.
+struct FrameTimer {
+    static constexpr u32 query_count = 4;
+
+    std::array<u32, query_count> queries = {};
+    std::array<bool, query_count> pending = {};
+    u32 index = 0;
+    bool began = false;
+
+    void init();
     void destroy();
+    // Returns the GPU time of the oldest frame in flight, or a negative number if it isn't available.
+    f32 begin();
+    void end();
+};
+
+// How the planet is drawn. Must match planet.vert.
+enum class MapProjection : i32 {
+    globe,
+    equirectangular,
+    mollweide,
+    robinson,
+    count,
+};
+
+const char* get_projection_name(MapProjection projection);
+
+enum class BorderMode : u8 {
+    // A second pass of `GL_LINES` over the planet's vertices
+    lines,
+    // Drawn by planet.frag in the same pass as the surface, from each fragment's distance to its triangle's border
+    // edges. Triangles don't share vertices in this mode.
+    shaded,
+    // Drawn by `LineRenderer` as screen-space quads. Flat maps, which it doesn't project, still use `lines`.
+    thick,
+};
+
+const char* get_border_mode_name(BorderMode mode);
+
+struct BorderConfig {
+    BorderMode mode = BorderMode::lines;
+    // Width in pixels of shaded and thick borders between two provinces. Coasts are half as wide.
+    f32 width_px = 1.5f;
+};
+
+// Vertex of the planet in GPU memory. Must match planet.vert.
+struct PlanetVertex {
+    glm::vec3 position;
+    f32 wrap;
+    // Barycentric coordinates for shaded borders, where only border edges reach 0
+    glm::u8vec4 edges;
+};
+
+// Triangles and border lines of the planet, on the unit sphere. Each vertex has a wrap flag for flat projections.
+struct PlanetMesh {
+    std::vector<glm::vec3> vertices;
+    std::vector<f32> wraps;
+    // Only for shaded borders. One per vertex, as in `PlanetVertex::edges`.
+    std::vector<glm::u8vec4> edges;
+    std::vector<u32> tri_indices;
+    // Empty with shaded borders
+    std::vector<u32> line_indices;
+    // Only for thick borders. Each edge shared by two provinces is only included once.
+    std::vector<LineSegment> border_segments;
+};
+
+// Triangulates every province. Doesn't need a GL context, so it runs on a worker during startup.
+PlanetMesh build_planet_mesh(const ProvinceGeometry& geometry, BorderMode border_mode);
+// A coarse sphere without borders, drawn until the provinces are loaded.
+PlanetMesh build_placeholder_mesh();
+
+// Camera and window state for a frame, copied from the main thread so the renderer never reads it while it changes.
+struct RenderView {
+    glm::vec3 camera_pos;
+    glm::vec3 camera_target;
+    glm::vec3 camera_up;
+    f32 fovy;
+    i32 framebuffer_width = 0;
+    i32 framebuffer_height = 0;
+    bool wireframe = false;
 };
 
 struct Renderer {
-    std::unordered_map<u32, VertexBufferObject> vbos;
+    // Resources are referred to by handle rather than GL name, so lookups index an array and a stale reference is
+    // caught instead of finding a resource that reused the name.
+    SlotMap<VertexBufferObject> vbos;
 
     UniformBufferObject view_projection_ubo;
 
-    std::unordered_map<u32, Shader> shaders;
-    std::unordered_map<u32, ShaderProgram> shader_programs;
-    std::unordered_multimap<u32, u32> shader_users;
+    SlotMap<Shader> shaders;
+    SlotMap<ShaderProgram> shader_programs;
+
+    // Meshes are sub-allocated from a few large buffers, so replacing one never reallocates a buffer. The vertex pool
+    // holds `PlanetVertex`es and the index pool `u32`s.
+    BufferPool vertex_pool;
+    BufferPool index_pool;
+    BufferRange planet_vertices;
+    BufferRange planet_tri_indices;
+    BufferRange planet_line_indices;
 
     VertexArrayObject planet_vao;
     VertexArrayObject outline_vao;
 
+    Terrain terrain;
+    TextRenderer text;
+    LineRenderer lines;
+
+    RenderView view;
+
+    // `gl_state.stats` counts the state changes of the last frame.
+    GLState gl_state;
+    RenderQueue queue;
+
+    // The planet is morphed from one projection to the other by the vertex shader, so switching only changes
+    // uniforms.
+    BorderConfig borders;
+
+    MapProjection projection_from = MapProjection::globe;
+    MapProjection projection_to = MapProjection::globe;
+    f32 projection_blend = 1.0f;
+    f64 last_render_s = 0.0;
+
+    // The scene is drawn offscreen, resolved, then scaled to the window. Resolution and samples are steps on a ladder
+    // from `min_scale` without MSAA up to full resolution with `render_samples`, moved by the GPU time.
+    DynamicResolutionConfig resolution_config;
+    Framebuffer scene_framebuffer;
+    Framebuffer resolve_framebuffer;
+    FrameTimer frame_timer;
+    std::vector<std::pair<f32, i32>> quality_ladder;
+    u32 quality = 0;
+    f32 gpu_ms = 0.0f;
+    // GPU time of the frame `frame_timer` last measured, or negative if none was ready
+    f32 last_gpu_ms = -1.0f;
+    u32 over_budget_frames = 0;
+    u32 under_budget_frames = 0;
+    // Frames to ignore after a change, while timings from before it are still coming in
+    u32 settle_frames = 0;
+    i32 wanted_width = 0;
+    i32 wanted_height = 0;
+    u32 stable_frames = 0;
+    i32 render_width = 0;
+    i32 render_height = 0;
+
+    // Sets up GL and shaders, with the placeholder planet. Doesn't use any province data.
     void init();
+    void upload_planet(const PlanetMesh& mesh);
+    // Replaces the placeholder with the province mesh and sets up labels, once the provinces have loaded.
+    void init_provinces(const PlanetMesh& mesh);
+    // Reloads shaders whose files have changed. Returns true if any were reloaded.
+    bool reload_shaders();
+    // Draws a frame of `view`. The caller presents it.
     void render();
-
-    u32 add_vbo(GLenum usage);
-    void erase_vbo(u32 id);
-
-    u32 add_shader(const Path& shader_path, GLenum type);
-    u32 add_shader_program(u32 vertex_shader, u32 fragment_shader);
+    // True while the picture would change from one frame to the next without any input, such as during a projection
+    // transition or while terrain tiles stream in.
+    bool is_animating() const;
+
+    // Starts an animated transition from the projection currently shown.
+    void set_projection(MapProjection projection);
+    // Draws `view` with each border mode in turn at full resolution and logs their GPU times side by side. `line_mesh`
+    // must be built for thick borders, which gives it both the line indices and the border segments. Afterwards the
+    // mesh for `borders.mode` is uploaded again.
+    void bench_borders(const PlanetMesh& line_mesh, const PlanetMesh& shaded_mesh);
+
+    void update_quality(f32 frame_gpu_ms);
+    // Reallocates the offscreen framebuffers if needed and sets `render_width` and `render_height`.
+    void update_framebuffers();
+    void resolve_framebuffers();
+
+    VboHandle add_vbo(GLenum usage);
+    void erase_vbo(VboHandle handle);
+
+    ShaderHandle add_shader(const Path& shader_path, GLenum type);
+    ProgramHandle add_shader_program(ShaderHandle vertex_shader, ShaderHandle fragment_shader);
 };
@@ -0,0 +1,201 @@
+#include "render_thread.hpp"
+
+#include "app.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+
+namespace {
+
+// How often shader files are checked while no frames are being drawn
+constexpr std::chrono::milliseconds idle_shader_poll_interval(250);
+} // namespace
+
+void RenderCommandList::set_view(const RenderView& view) {
+    RenderCommand command;
+    command.type = RenderCommandType::set_view;
+    command.view = view;
+    commands.push_back(command);
+}
+
+void RenderCommandList::set_projection(const MapProjection projection) {
+    RenderCommand command;
+    command.type = RenderCommandType::set_projection;
+    command.projection = projection;
+    commands.push_back(command);
+}
+
+void RenderCommandList::init_provinces(std::shared_ptr<const PlanetMesh> mesh) {
+    RenderCommand command;
+    command.type = RenderCommandType::init_provinces;
+    command.mesh = std::move(mesh);
+    commands.push_back(std::move(command));
+}
+
+void RenderCommandList::draw() {
+    RenderCommand command;
+    command.type = RenderCommandType::draw;
+    commands.push_back(command);
+}
+
+void RenderCommandList::bench_borders(std::shared_ptr<const PlanetMesh> line_mesh,
+                                      std::shared_ptr<const PlanetMesh> shaded_mesh) {
+    RenderCommand command;
+    command.type = RenderCommandType::bench_borders;
+    command.mesh = std::move(line_mesh);
+    command.shaded_mesh = std::move(shaded_mesh);
+    commands.push_back(std::move(command));
+}
+
+void RenderThread::start(GLFWwindow* const window, Renderer& renderer) {
+    CHECK_F(!thread.joinable());
+    this->window = window;
+    this->renderer = &renderer;
+    stopping = false;
+    busy = false;
+
+    glfwMakeContextCurrent(nullptr);
+    thread = std::thread([this] { run(); });
+}
+
+void RenderThread::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    cv.notify_one();
+    thread.join();
+}
+
+bool RenderThread::is_ready() {
+    std::lock_guard lock(mutex);
+    return !busy && pending.empty();
+}
+
+void RenderThread::submit(RenderCommandList& list) {
+    if (list.commands.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        if (pending.empty()) {
+            pending.swap(list.commands);
+        } else {
+            pending.insert(pending.end(), list.commands.begin(), list.commands.end());
+        }
+    }
+    list.commands.clear();
+    cv.notify_one();
+}
+
+void RenderThread::wait_idle() {
+    std::unique_lock lock(mutex);
+    idle_cv.wait(lock, [this] { return !busy && pending.empty(); });
+}
+
+RenderThreadStats RenderThread::take_stats() {
+    std::lock_guard lock(mutex);
+    const RenderThreadStats result = stats;
+    stats = RenderThreadStats();
+    return result;
+}
+
+void RenderThread::run() {
+    loguru::set_thread_name("render");
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(1);
+
+    std::vector<RenderCommand> commands;
+    while (true) {
+        {
+            std::unique_lock lock(mutex);
+            cv.wait_for(lock, idle_shader_poll_interval, [this] { return stopping || !pending.empty(); });
+            if (pending.empty() && stopping) {
+                break;
+            }
+            commands.swap(pending);
+            busy = !commands.empty();
+        }
+
+        if (commands.empty()) {
+            if (renderer->reload_shaders()) {
+                redraw_requested = true;
+                glfwPostEmptyEvent();
+            }
+            continue;
+        }
+
+        replay(commands);
+        commands.clear();
+
+        {
+            std::lock_guard lock(mutex);
+            busy = false;
+        }
+        idle_cv.notify_all();
+        // Wake the main thread, which may be waiting to submit the next frame.
+        glfwPostEmptyEvent();
+    }
+
+    glfwMakeContextCurrent(nullptr);
+}
+
+void RenderThread::replay(const std::vector<RenderCommand>& commands) {
+    for (const RenderCommand& command : commands) {
+        switch (command.type) {
+        case RenderCommandType::set_view: {
+            renderer->view = command.view;
+        } break;
+
+        case RenderCommandType::set_projection: {
+            renderer->set_projection(command.projection);
+        } break;
+
+        case RenderCommandType::init_provinces: {
+            const auto start = std::chrono::steady_clock::now();
+            renderer->init_provinces(*command.mesh);
+            app->log_startup_phase("Province mesh upload and labels", start);
+        } break;
+
+        case RenderCommandType::draw: {
+            const auto start = std::chrono::steady_clock::now();
+
+            renderer->reload_shaders();
+            renderer->render();
+
+            const auto swap_start = std::chrono::steady_clock::now();
+            if (renderer->view.framebuffer_width > 0 && renderer->view.framebuffer_height > 0) {
+                glfwSwapBuffers(window);
+            }
+            const auto end = std::chrono::steady_clock::now();
+
+            animating = renderer->is_animating();
+            if (!drawn_first_frame) {
+                drawn_first_frame = true;
+                app->log_startup_phase("First frame", start);
+            }
+
+            std::lock_guard lock(mutex);
+            ++stats.frames;
+            stats.frame_s += std::chrono::duration<f64>(end - start).count();
+            stats.swap_s += std::chrono::duration<f64>(end - swap_start).count();
+            if (renderer->last_gpu_ms >= 0.0f) {
+                ++stats.gpu_frames;
+                stats.gpu_s += static_cast<f64>(renderer->last_gpu_ms) / 1000.0;
+            }
+            stats.gl.issued += renderer->gl_state.stats.issued;
+            stats.gl.elided += renderer->gl_state.stats.elided;
+        } break;
+
+        case RenderCommandType::bench_borders: {
+            renderer->bench_borders(*command.mesh, *command.shaded_mesh);
+        } break;
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "render.hpp"
+#include "utility.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+enum class RenderCommandType : u8 {
+    // Camera and window state for the following frames
+    set_view,
+    // Starts a transition to another map projection
+    set_projection,
+    // Replaces the placeholder planet once the provinces have loaded
+    init_provinces,
+    // Draws and presents a frame
+    draw,
+    // Runs `Renderer::bench_borders`
+    bench_borders,
+};
+
+struct RenderCommand {
+    RenderCommandType type;
+    RenderView view;
+    MapProjection projection = MapProjection::globe;
+    std::shared_ptr<const PlanetMesh> mesh;
+    // Only for `bench_borders`, which takes its line mesh from `mesh`
+    std::shared_ptr<const PlanetMesh> shaded_mesh;
+};
+
+// Commands recorded by the main thread for the render thread.
+struct RenderCommandList {
+    std::vector<RenderCommand> commands;
+
+    void set_view(const RenderView& view);
+    void set_projection(MapProjection projection);
+    void init_provinces(std::shared_ptr<const PlanetMesh> mesh);
+    void draw();
+    void bench_borders(std::shared_ptr<const PlanetMesh> line_mesh, std::shared_ptr<const PlanetMesh> shaded_mesh);
+};
+
+// Time spent on each side of the split since the last `RenderThread::take_stats()`.
+struct RenderThreadStats {
+    u64 frames = 0;
+    f64 frame_s = 0.0;
+    // Part of `frame_s` spent waiting in `glfwSwapBuffers`, usually for vsync
+    f64 swap_s = 0.0;
+    // GPU time of the frames whose timer queries were ready, which lag a few frames behind
+    u64 gpu_frames = 0;
+    f64 gpu_s = 0.0;
+    // GL state changes made and skipped by the renderer's state cache
+    GLStateStats gl;
+};
+
+// Owns the GL context and replays command lists from the main thread, so that event handling and ticks never wait on
+// vsync or the GPU, and a slow frame doesn't delay input. Commands are double-buffered: the main thread records into
+// its own list and hands it over with `submit`, while the render thread replays the list it took before.
+struct RenderThread {
+    std::thread thread;
+    GLFWwindow* window = nullptr;
+    Renderer* renderer = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Notified whenever the render thread finishes a list
+    std::condition_variable idle_cv;
+    // Submitted commands the render thread hasn't taken yet
+    std::vector<RenderCommand> pending;
+    // True while the render thread is replaying a list
+    bool busy = false;
+    bool stopping = false;
+    bool drawn_first_frame = false;
+    RenderThreadStats stats;
+
+    // Set after every frame, from `Renderer::is_animating()`.
+    std::atomic<bool> animating = false;
+    // Set when a shader was reloaded while idle, so the main thread schedules a frame.
+    std::atomic<bool> redraw_requested = false;
+
+    // Makes the context current on a new render thread. The calling thread must own the context, and gives it up.
+    void start(GLFWwindow* window, Renderer& renderer);
+    // Replays any pending commands, then joins the thread. The context is left current on no thread.
+    void stop();
+
+    // True if the render thread has nothing to do, so a new frame will start as soon as it's submitted.
+    bool is_ready();
+    // Moves `list`'s commands to the render thread and leaves it empty. Never waits for a frame to finish.
+    void submit(RenderCommandList& list);
+    // Waits until every submitted command has been replayed.
+    void wait_idle();
+
+    RenderThreadStats take_stats();
+
+private:
+    void run();
+    void replay(const std::vector<RenderCommand>& commands);
+};
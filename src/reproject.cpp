@@ -0,0 +1,135 @@
+#include "reproject.hpp"
+
+#include <cpl_conv.h>
+
+#include <chrono>
+#include <random>
+
+namespace {
+
+// A PROJ string rather than "EPSG:4326", so that no database lookup is needed for the target.
+const char* const wgs84_definition = "+proj=longlat +datum=WGS84 +no_defs +type=crs";
+} // namespace
+
+bool Reprojector::init(const OGRSpatialReference* const source, const ThreadPool& thread_pool) {
+    if (source == nullptr) {
+        return false;
+    }
+
+    OGRSpatialReference wgs84;
+    wgs84.SetWellKnownGeogCS("WGS84");
+    const char* const same_options[] = {"IGNORE_DATA_AXIS_TO_SRS_AXIS_MAPPING=YES",
+                                        "CRITERION=EQUIVALENT_EXCEPT_AXIS_ORDER_GEOGCRS", nullptr};
+    if (source->IsSame(&wgs84, same_options)) {
+        return false;
+    }
+
+    source_name = source->GetName() != nullptr ? source->GetName() : "unknown CRS";
+
+    char* wkt = nullptr;
+    const char* const wkt_options[] = {"FORMAT=WKT2_2018", nullptr};
+    CHECK_F(source->exportToWkt(&wkt, wkt_options) == OGRERR_NONE, "Failed to export {} as WKT", source_name);
+    const std::string source_wkt = wkt;
+    CPLFree(wkt);
+
+    for (u32 i = 0; i < thread_pool.size(); ++i) {
+        PJ_CONTEXT* const context = proj_context_create();
+        CHECK_NOTNULL_F(context);
+
+        PJ* const transformation = proj_create_crs_to_crs(context, source_wkt.c_str(), wgs84_definition, nullptr);
+        CHECK_NOTNULL_F(transformation, "Failed to create a transformation from {}: {}", source_name,
+                        proj_errno_string(proj_context_errno(context)));
+
+        // Use longitude/latitude and easting/northing order, whatever the CRSs' axis order, to match the data.
+        PJ* const normalized = proj_normalize_for_visualization(context, transformation);
+        CHECK_NOTNULL_F(normalized);
+        proj_destroy(transformation);
+
+        contexts.push_back(context);
+        transformations.push_back(normalized);
+    }
+
+    return true;
+}
+
+void Reprojector::destroy() {
+    for (PJ* const transformation : transformations) {
+        proj_destroy(transformation);
+    }
+    for (PJ_CONTEXT* const context : contexts) {
+        proj_context_destroy(context);
+    }
+    *this = Reprojector();
+}
+
+size_t Reprojector::transform(std::vector<glm::dvec2>& points, ThreadPool& thread_pool) {
+    CHECK_F(!contexts.empty());
+    if (points.empty()) {
+        return 0;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // One batch per context. Each batch only ever runs on one thread, so it can use its context freely.
+    const size_t batch_size = (points.size() + contexts.size() - 1) / contexts.size();
+    thread_pool.parallel_for(points.size(), batch_size, [&](const size_t begin, const size_t end) {
+        const size_t batch = begin / batch_size;
+        glm::dvec2* const first = points.data() + begin;
+        proj_trans_generic(transformations[batch], PJ_FWD, &first->x, sizeof(glm::dvec2), end - begin, &first->y,
+                           sizeof(glm::dvec2), end - begin, nullptr, 0, 0, nullptr, 0, 0);
+    });
+
+    const f64 elapsed_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    for (const glm::dvec2& point : points) {
+        if (!std::isfinite(point.x) || !std::isfinite(point.y)) {
+            ++failed;
+        }
+    }
+
+    LOG_F(INFO, "Reprojected {} points from {} in {:.1f} ms ({:.1f} M points/s, {} threads)", points.size(),
+          source_name, elapsed_s * 1000.0, static_cast<f64>(points.size()) / elapsed_s / 1e6, contexts.size());
+    if (failed > 0) {
+        LOG_F(WARNING, "{} points couldn't be reprojected from {}", failed, source_name);
+    }
+
+    return failed;
+}
+
+void bench_reprojection(ThreadPool& thread_pool) {
+    constexpr size_t point_count = 4'000'000;
+    constexpr f64 mercator_extent = 20'037'508.34;
+
+    OGRSpatialReference mercator;
+    CHECK_F(mercator.importFromProj4("+proj=merc +a=6378137 +b=6378137 +lat_ts=0 +lon_0=0 +x_0=0 +y_0=0 +k=1 "
+                                     "+units=m +no_defs") == OGRERR_NONE);
+
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<f64> coordinate(-mercator_extent, mercator_extent);
+    std::vector<glm::dvec2> source(point_count);
+    for (glm::dvec2& point : source) {
+        point = {coordinate(rng), coordinate(rng)};
+    }
+
+    const auto measure = [&](const std::string& name, ThreadPool& pool) {
+        Reprojector reprojector;
+        CHECK_F(reprojector.init(&mercator, pool));
+        std::vector<glm::dvec2> points = source;
+
+        const auto start = std::chrono::steady_clock::now();
+        const size_t failed = reprojector.transform(points, pool);
+        const f64 elapsed_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+        reprojector.destroy();
+
+        CHECK_F(failed == 0);
+        LOG_F(INFO, "Reprojection ({}): {:.1f} M points/s", name, static_cast<f64>(point_count) / elapsed_s / 1e6);
+    };
+
+    ThreadPool single_thread;
+    single_thread.init(0);
+    measure("1 thread", single_thread);
+    single_thread.destroy();
+
+    measure(fmt::format("{} threads", thread_pool.size()), thread_pool);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
+#include <glm/vec2.hpp>
+#include <ogr_spatialref.h>
+#include <proj.h>
+
+#include <string>
+#include <vector>
+
+// Converts whole arrays of coordinates from a source CRS to WGS 84 longitude/latitude in degrees, which is what the
+// planet mesh expects. PROJ contexts and transformations can't be shared between threads, so there is one of each per
+// thread pool thread, and each `transform` splits the points into one batch per context.
+struct Reprojector {
+    std::string source_name;
+    std::vector<PJ_CONTEXT*> contexts;
+    std::vector<PJ*> transformations;
+
+    // Returns false if `source` is null or already WGS 84 longitude/latitude, so there is nothing to do.
+    bool init(const OGRSpatialReference* source, const ThreadPool& thread_pool);
+    void destroy();
+
+    // Points are (x, y) in the source CRS's easting/northing order and become (longitude, latitude). Returns the
+    // number of points that couldn't be converted, which are left as infinity.
+    size_t transform(std::vector<glm::dvec2>& points, ThreadPool& thread_pool);
+};
+
+// Logs reprojection throughput from Web Mercator on one thread and on the whole pool.
+void bench_reprojection(ThreadPool& thread_pool);
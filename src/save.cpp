@@ -0,0 +1,286 @@
+#include "save.hpp"
+
+#include "compress.hpp"
+#include "simulation.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr u32 save_magic = 0x56535357; // "WSSV"
+constexpr u32 save_version = 1;
+
+u64 align_up(const u64 value, const u64 alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void write_padding(std::ofstream& stream, const u64 size) {
+    static const char zeros[save_block_alignment] = {};
+    stream.write(zeros, static_cast<std::streamsize>(align_up(size, save_block_alignment) - size));
+}
+} // namespace
+
+void SaveWriter::add_block(const std::string& name, const void* const data, const size_t size,
+                           const u32 element_size, const SaveCodec codec) {
+    CHECK_F(name.size() < save_block_name_size, "Save block name too long: {}", name);
+    blocks.push_back({name, data, size, element_size, codec});
+}
+
+void SaveWriter::copy_data() {
+    for (Block& block : blocks) {
+        auto copy = std::make_unique<u8[]>(block.size);
+        memcpy(copy.get(), block.data, block.size);
+        block.data = copy.get();
+        owned_data.push_back(std::move(copy));
+    }
+}
+
+bool SaveWriter::write(const Path& path) const {
+    Path temp_path = path;
+    temp_path += ".tmp";
+
+    std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+    if (!stream) {
+        return false;
+    }
+
+    SaveHeader header = {};
+    header.magic = save_magic;
+    header.version = save_version;
+    header.block_count = blocks.size();
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_padding(stream, sizeof(header));
+    u64 offset = align_up(sizeof(header), save_block_alignment);
+
+    std::vector<SaveBlockInfo> toc(blocks.size());
+    std::vector<u8> compressed;
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const Block& block = blocks[i];
+        SaveBlockInfo& info = toc[i];
+        memcpy(info.name, block.name.c_str(), block.name.size() + 1);
+        info.offset = offset;
+        info.raw_size = block.size;
+        info.element_size = block.element_size;
+        info.codec = SaveCodec::none;
+
+        const void* stored = block.data;
+        info.stored_size = block.size;
+
+        if (block.codec == SaveCodec::lz && block.size > 0) {
+            compressed.resize(lz_compress_bound(block.size));
+            const size_t compressed_size = lz_compress(static_cast<const u8*>(block.data), block.size,
+                                                       compressed.data());
+            // Keep blocks that don't shrink raw, so they can still be used in place.
+            if (compressed_size < block.size) {
+                info.codec = SaveCodec::lz;
+                info.stored_size = compressed_size;
+                stored = compressed.data();
+            }
+        }
+
+        stream.write(static_cast<const char*>(stored), static_cast<std::streamsize>(info.stored_size));
+        write_padding(stream, info.stored_size);
+        offset += align_up(info.stored_size, save_block_alignment);
+    }
+
+    header.toc_offset = offset;
+    header.file_size = offset + toc.size() * sizeof(SaveBlockInfo);
+    stream.write(reinterpret_cast<const char*>(toc.data()),
+                 static_cast<std::streamsize>(toc.size() * sizeof(SaveBlockInfo)));
+
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.close();
+    if (!stream) {
+        return false;
+    }
+
+    std::error_code error;
+    fs::rename(temp_path, path, error);
+    return !error;
+}
+
+SaveFile::~SaveFile() {
+    close();
+}
+
+bool SaveFile::open(const Path& path) {
+    close();
+
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SaveHeader))) {
+        close();
+        return false;
+    }
+    mapping_size = static_cast<size_t>(st.st_size);
+
+    void* const ptr = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+        close();
+        return false;
+    }
+    mapping = static_cast<const u8*>(ptr);
+
+    memcpy(&header, mapping, sizeof(header));
+    const bool header_ok = header.magic == save_magic && header.version == save_version &&
+                           header.file_size == mapping_size && header.toc_offset % save_block_alignment == 0 &&
+                           header.toc_offset <= mapping_size &&
+                           header.block_count * sizeof(SaveBlockInfo) == mapping_size - header.toc_offset;
+    if (!header_ok) {
+        LOG_F(WARNING, "Invalid save file header: {}", path.string());
+        close();
+        return false;
+    }
+
+    toc.resize(header.block_count);
+    memcpy(toc.data(), mapping + header.toc_offset, toc.size() * sizeof(SaveBlockInfo));
+    for (const SaveBlockInfo& info : toc) {
+        // The raw size of a compressed block is checked here, so that a corrupt one can't make `get` allocate an
+        // unbounded buffer.
+        const bool size_ok = info.codec == SaveCodec::none ? info.stored_size == info.raw_size
+                             : info.codec == SaveCodec::lz ? info.raw_size <= lz_decompress_bound(info.stored_size)
+                                                           : false;
+        const bool block_ok = memchr(info.name, '\0', save_block_name_size) != nullptr &&
+                              info.offset % save_block_alignment == 0 && info.offset <= header.toc_offset &&
+                              info.stored_size <= header.toc_offset - info.offset && size_ok;
+        if (!block_ok) {
+            LOG_F(WARNING, "Invalid save file block: {}", path.string());
+            close();
+            return false;
+        }
+    }
+
+    decompressed.resize(toc.size());
+    return true;
+}
+
+void SaveFile::close() {
+    if (mapping != nullptr) {
+        munmap(const_cast<u8*>(mapping), mapping_size);
+    }
+    if (fd != -1) {
+        ::close(fd);
+    }
+
+    fd = -1;
+    mapping = nullptr;
+    mapping_size = 0;
+    header = {};
+    toc.clear();
+    decompressed.clear();
+}
+
+i64 SaveFile::find(const char* const name) const {
+    for (size_t i = 0; i < toc.size(); ++i) {
+        if (c_str_eq(toc[i].name, name)) {
+            return static_cast<i64>(i);
+        }
+    }
+    return -1;
+}
+
+SaveBlockView SaveFile::get(const char* const name) {
+    const i64 index = find(name);
+    if (index == -1) {
+        return {};
+    }
+
+    const size_t i = static_cast<size_t>(index);
+    const SaveBlockInfo& info = toc[i];
+    SaveBlockView result;
+    result.size = info.raw_size;
+    result.element_size = info.element_size;
+
+    switch (info.codec) {
+    case SaveCodec::none:
+        result.data = mapping + info.offset;
+        break;
+
+    case SaveCodec::lz:
+        if (!decompressed[i]) {
+            auto buffer = std::make_unique<u8[]>(info.raw_size);
+            if (!lz_decompress(mapping + info.offset, info.stored_size, buffer.get(), info.raw_size)) {
+                LOG_F(WARNING, "Failed to decompress save block {}", info.name);
+                return {};
+            }
+            decompressed[i] = std::move(buffer);
+        }
+        result.data = decompressed[i].get();
+        break;
+    }
+
+    return result;
+}
+
+void bench_save(const Path& dir, const u32 province_count) {
+    fs::create_directories(dir);
+    const Path path = dir / "bench.wss";
+
+    for (const u32 scale : {1u, 10u, 100u}) {
+        const size_t rows = size_t(province_count) * scale;
+
+        // Columns shaped like typical game state: small integer IDs, slowly varying quantities and counters.
+        Rng rng(scale);
+        AlignedVector<u32> owners(rows);
+        AlignedVector<i64> population(rows);
+        AlignedVector<Fixed> development(rows);
+        AlignedVector<u32> flags(rows);
+        for (size_t i = 0; i < rows; ++i) {
+            owners[i] = static_cast<u32>(i / 37) % 300;
+            population[i] = 10000 + static_cast<i64>(rng.uniform(5000));
+            development[i] = Fixed::from_ratio(static_cast<i64>(rng.uniform(1000)), 100);
+            flags[i] = rng.uniform(16) == 0 ? rng.uniform(8) : 0;
+        }
+        const size_t raw_bytes = rows * (sizeof(u32) * 2 + sizeof(i64) + sizeof(Fixed));
+
+        for (const SaveCodec codec : {SaveCodec::none, SaveCodec::lz}) {
+            SaveWriter writer;
+            writer.add_vector("owners", owners, codec);
+            writer.add_vector("population", population, codec);
+            writer.add_vector("development", development, codec);
+            writer.add_vector("flags", flags, codec);
+
+            const auto write_start = std::chrono::steady_clock::now();
+            CHECK_F(writer.write(path));
+            const f64 write_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - write_start).count();
+
+            // Touch every byte, so that page faults and decompression are both counted.
+            const auto load_start = std::chrono::steady_clock::now();
+            u64 checksum = 0;
+            {
+                SaveFile file;
+                CHECK_F(file.open(path));
+                for (const char* name : {"owners", "population", "development", "flags"}) {
+                    const SaveBlockView view = file.get(name);
+                    CHECK_NOTNULL_F(view.data);
+                    const u8* const bytes = static_cast<const u8*>(view.data);
+                    for (size_t i = 0; i < view.size; i += 64) {
+                        checksum += bytes[i];
+                    }
+                }
+            }
+            const f64 load_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - load_start).count();
+
+            const f64 mb = static_cast<f64>(raw_bytes) / 1e6;
+            LOG_F(INFO, "Save {}x ({} rows, {}): {:.1f} MB -> {:.1f} MB, write {:.0f} MB/s, load {:.0f} MB/s ({})",
+                  scale, rows, codec == SaveCodec::lz ? "lz" : "raw", mb, static_cast<f64>(fs::file_size(path)) / 1e6,
+                  mb / write_s, mb / load_s, checksum);
+        }
+    }
+
+    fs::remove(path);
+}
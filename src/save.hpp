@@ -0,0 +1,130 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "utility.hpp"
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Save files are a header, a sequence of blocks and a table of contents at the end. Each block holds one column of
+// game state, starts on a 64-byte boundary and is either stored raw or compressed with `lz_compress()`. Raw blocks
+// are used straight from the memory-mapped file, so loading them costs nothing beyond page faults.
+
+inline constexpr u32 save_block_alignment = 64;
+inline constexpr size_t save_block_name_size = 48;
+
+enum class SaveCodec : u32 {
+    none,
+    lz,
+};
+
+struct SaveHeader {
+    u32 magic;
+    u32 version;
+    u64 block_count;
+    u64 toc_offset;
+    u64 file_size;
+};
+
+struct SaveBlockInfo {
+    char name[save_block_name_size];
+    u64 offset;
+    u64 stored_size;
+    u64 raw_size;
+    u32 element_size;
+    SaveCodec codec;
+};
+
+struct SaveWriter {
+    struct Block {
+        std::string name;
+        const void* data;
+        size_t size;
+        u32 element_size;
+        SaveCodec codec;
+    };
+
+    // Blocks are referenced, not copied, until `write()` or `copy_data()`.
+    std::vector<Block> blocks;
+    std::vector<std::unique_ptr<u8[]>> owned_data;
+
+    void add_block(const std::string& name, const void* data, size_t size, u32 element_size, SaveCodec codec);
+
+    template <class T, class A>
+    void add_vector(const std::string& name, const std::vector<T, A>& values, const SaveCodec codec) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        add_block(name, values.data(), values.size() * sizeof(T), sizeof(T), codec);
+    }
+
+    template <class T>
+    void add_value(const std::string& name, const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        add_block(name, &value, sizeof(T), sizeof(T), SaveCodec::none);
+    }
+
+    // Copies the data of every block into the writer, so that the source may change or be freed before `write()`.
+    void copy_data();
+
+    // Writes to a temporary file which then replaces `path`. Returns false on failure.
+    bool write(const Path& path) const;
+};
+
+struct SaveBlockView {
+    const void* data = nullptr;
+    size_t size = 0;
+    u32 element_size = 0;
+
+    template <class T>
+    const T* as() const {
+        CHECK_F(element_size == sizeof(T));
+        return static_cast<const T*>(data);
+    }
+
+    size_t count() const {
+        return element_size > 0 ? size / element_size : 0;
+    }
+};
+
+// A memory-mapped save file. Views returned by `get()` stay valid until `close()`.
+struct SaveFile {
+    int fd = -1;
+    const u8* mapping = nullptr;
+    size_t mapping_size = 0;
+
+    // Copied out of the mapping; the blocks themselves are not.
+    SaveHeader header = {};
+    std::vector<SaveBlockInfo> toc;
+
+    // Decompressed copies of compressed blocks, by TOC index.
+    std::vector<std::unique_ptr<u8[]>> decompressed;
+
+    SaveFile() = default;
+    SaveFile(const SaveFile&) = delete;
+    SaveFile& operator=(const SaveFile&) = delete;
+    ~SaveFile();
+
+    // Returns false if the file is missing or malformed.
+    bool open(const Path& path);
+    void close();
+
+    // Returns -1 if there is no block with the given name.
+    i64 find(const char* name) const;
+
+    // Returns an empty view if the block is missing or fails to decompress.
+    SaveBlockView get(const char* name);
+
+    template <class T>
+    bool get_value(const char* const name, T& value) {
+        const SaveBlockView view = get(name);
+        if (view.data == nullptr || view.size != sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, view.data, sizeof(T));
+        return true;
+    }
+};
+
+// Logs save and load throughput for columns of 1, 10 and 100 times `province_count` rows.
+void bench_save(const Path& dir, u32 province_count);
@@ -0,0 +1,473 @@
+#include "simulation.hpp"
+
+#include "async_log.hpp"
+#include "thread_pool.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+constexpr u64 prime64_1 = 0x9E3779B185EBCA87;
+constexpr u64 prime64_2 = 0xC2B2AE3D27D4EB4F;
+constexpr u64 prime64_3 = 0x165667B19E3779F9;
+
+// First bytes of the XXH3 default secret.
+constexpr u64 secret[4] = {0xbe4ba423396cfeb8, 0x1cad21f72c81017c, 0xdb979083e96dd4de, 0x1f67b3b7a4a44072};
+
+u64 rotl(const u64 x, const i32 k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+u64 splitmix64(u64& state) {
+    state += 0x9E3779B97F4A7C15;
+    u64 z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+u64 mul128_fold64(const u64 lhs, const u64 rhs) {
+    const unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+    return static_cast<u64>(product) ^ static_cast<u64>(product >> 64);
+}
+
+u64 avalanche(u64 h) {
+    h ^= h >> 37;
+    h *= prime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+u64 read_u64(const u8* const data) {
+    u64 result;
+    memcpy(&result, data, sizeof(result));
+    return result;
+}
+
+// `a` and `b` name the same state, or one names a part of the other, as "world.armies" does "world.armies.strength".
+bool overlaps(const std::string& a, const std::string& b) {
+    const std::string& shorter = a.size() < b.size() ? a : b;
+    const std::string& longer = a.size() < b.size() ? b : a;
+    return longer.compare(0, shorter.size(), shorter) == 0 &&
+           (longer.size() == shorter.size() || longer[shorter.size()] == '.');
+}
+
+bool any_overlap(const std::vector<std::string>& lhs, const std::vector<std::string>& rhs) {
+    for (const std::string& a : lhs) {
+        for (const std::string& b : rhs) {
+            if (overlaps(a, b)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool conflicts(const SimSystem& a, const SimSystem& b) {
+    return a.exclusive || b.exclusive || any_overlap(a.access.writes, b.access.writes) ||
+           any_overlap(a.access.writes, b.access.reads) || any_overlap(a.access.reads, b.access.writes);
+}
+
+// Shared by the threads running a tick's systems. Systems take milliseconds, so a lock is cheap enough.
+struct ScheduleState {
+    ThreadPool* thread_pool;
+    const std::vector<SimSystem>* systems;
+    std::function<void(u32)> run_system;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Dependencies of each system that haven't finished
+    std::vector<u32> pending;
+    // Systems whose dependencies have all finished, lowest index last
+    std::vector<u32> ready;
+    u32 finished = 0;
+};
+
+// Runs ready systems until there are none left, or, if `wait`, until every system has finished. A system that makes
+// others ready starts helpers on the pool for all but one of them, which this thread takes.
+//
+// Helpers may only get to run after the tick is done, so they hold on to the state. They only touch the simulation
+// after taking a system, and every system has finished by the time the waiting thread returns.
+void run_ready(const std::shared_ptr<ScheduleState>& state, const bool wait) {
+    const auto count = static_cast<u32>(state->pending.size());
+    std::unique_lock lock(state->mutex);
+    while (state->finished < count) {
+        if (state->ready.empty()) {
+            if (!wait) {
+                return;
+            }
+            // Only this schedule's systems are taken here, so a tick never waits behind unrelated pool work. Systems
+            // running elsewhere can't need this thread: `parallel_for` callers work through their own chunks.
+            state->cv.wait(lock, [&] { return !state->ready.empty() || state->finished == count; });
+            continue;
+        }
+
+        const u32 index = state->ready.back();
+        state->ready.pop_back();
+        lock.unlock();
+        state->run_system(index);
+        lock.lock();
+
+        ++state->finished;
+        size_t made_ready = 0;
+        for (const u32 dependent : (*state->systems)[index].dependents) {
+            if (--state->pending[dependent] == 0) {
+                state->ready.push_back(dependent);
+                ++made_ready;
+            }
+        }
+        for (size_t i = 1; i < made_ready; ++i) {
+            state->thread_pool->submit([state] { run_ready(state, false); });
+        }
+        state->cv.notify_all();
+    }
+}
+} // namespace
+
+Rng::Rng(const u64 seed) {
+    this->seed(seed);
+}
+
+void Rng::seed(u64 seed) {
+    for (u64& s : state) {
+        s = splitmix64(seed);
+    }
+}
+
+u64 Rng::next_u64() {
+    const u64 result = rotl(state[1] * 5, 7) * 9;
+    const u64 t = state[1] << 17;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 45);
+
+    return result;
+}
+
+u32 Rng::uniform(const u32 bound) {
+    CHECK_F(bound > 0);
+
+    // Lemire's multiply-and-reject method.
+    u64 m = (next_u64() >> 32) * bound;
+    if (static_cast<u32>(m) < bound) {
+        const u32 threshold = -bound % bound;
+        while (static_cast<u32>(m) < threshold) {
+            m = (next_u64() >> 32) * bound;
+        }
+    }
+    return static_cast<u32>(m >> 32);
+}
+
+Fixed Rng::uniform_fixed() {
+    return Fixed::from_raw(static_cast<i64>(next_u64() >> (64 - Fixed::fraction_bits)));
+}
+
+StateHasher::StateHasher(const u64 seed) : acc(seed ^ prime64_1) {}
+
+void StateHasher::update(const void* const data, size_t size) {
+    const u8* bytes = static_cast<const u8*>(data);
+    length += size;
+
+    if (buffer_size > 0) {
+        const size_t n = std::min<size_t>(size, sizeof(buffer) - buffer_size);
+        memcpy(buffer + buffer_size, bytes, n);
+        buffer_size += static_cast<u32>(n);
+        bytes += n;
+        size -= n;
+
+        if (buffer_size < sizeof(buffer)) {
+            return;
+        }
+        consume_stripe(buffer);
+        buffer_size = 0;
+    }
+
+    while (size >= sizeof(buffer)) {
+        consume_stripe(bytes);
+        bytes += sizeof(buffer);
+        size -= sizeof(buffer);
+    }
+
+    memcpy(buffer, bytes, size);
+    buffer_size = static_cast<u32>(size);
+}
+
+u64 StateHasher::finish() const {
+    u64 h = acc;
+    if (buffer_size > 0) {
+        u8 last[sizeof(buffer)] = {};
+        memcpy(last, buffer, buffer_size);
+        h += mul128_fold64(read_u64(last) ^ secret[2], read_u64(last + 8) ^ secret[3]);
+    }
+    h ^= length * prime64_2;
+    return avalanche(h);
+}
+
+void StateHasher::consume_stripe(const u8* const stripe) {
+    acc += mul128_fold64(read_u64(stripe) ^ secret[0], read_u64(stripe + 8) ^ secret[1]);
+    acc = rotl(acc, 27) * prime64_1;
+}
+
+void Simulation::init(const u64 seed) {
+    this->seed = seed;
+    tick = 0;
+    rng.seed(seed);
+    tick_hash = seed;
+    hash_history_start = 0;
+    commands.clear();
+
+    for (StateBlock& block : state_blocks) {
+        if (block.reset) {
+            block.reset();
+        }
+        block.dirty = true;
+    }
+    ++version;
+}
+
+u32 Simulation::add_state_block(std::string name, std::function<void(StateHasher&)> hash,
+                                std::function<void(SaveWriter&)> save, std::function<bool(SaveFile&)> load,
+                                std::function<bool()> end_tick, std::function<void()> reset) {
+    state_blocks.push_back({std::move(name), std::move(hash), std::move(save), std::move(load), std::move(end_tick),
+                            std::move(reset)});
+    return static_cast<u32>(state_blocks.size() - 1);
+}
+
+void Simulation::mark_dirty(const u32 block) {
+    CHECK_F(!running_systems, "Systems can't mark state blocks dirty; use the block's end_tick");
+    state_blocks.at(block).dirty = true;
+    ++version;
+}
+
+void Simulation::add_system(std::string name, SystemAccess access, std::function<void(Simulation&)> update) {
+    SimSystem& system = systems.emplace_back();
+    system.name = std::move(name);
+    system.access = std::move(access);
+    system.update = std::move(update);
+    schedule_stale = true;
+}
+
+void Simulation::add_system(std::string name, std::function<void(Simulation&)> update) {
+    add_system(std::move(name), {}, std::move(update));
+    systems.back().exclusive = true;
+}
+
+void Simulation::step() {
+    run_systems();
+    for (u32 i = 0; i < state_blocks.size(); ++i) {
+        if (state_blocks[i].end_tick && state_blocks[i].end_tick()) {
+            mark_dirty(i);
+        }
+    }
+    commands.clear();
+    ++tick;
+
+    StateHasher hasher(tick_hash);
+    hasher.update(tick);
+    hasher.update(compute_state_hash());
+    tick_hash = hasher.finish();
+    hash_history.resize(hash_history_ticks);
+    hash_history[(tick - 1) % hash_history_ticks] = tick_hash;
+}
+
+bool Simulation::get_tick_hash(const u64 tick, u64& hash) const {
+    if (tick <= hash_history_start || tick > this->tick || this->tick - tick >= hash_history_ticks) {
+        return false;
+    }
+    hash = hash_history[(tick - 1) % hash_history_ticks];
+    return true;
+}
+
+void Simulation::reset_timings() {
+    for (SimSystem& system : systems) {
+        system.total_s = 0.0;
+        system.critical_ticks = 0;
+    }
+    total_systems_s = 0.0;
+    total_critical_path_s = 0.0;
+}
+
+void Simulation::log_timings(const u64 ticks) const {
+    const f64 divisor = static_cast<f64>(std::max<u64>(ticks, 1));
+    f64 serial_s = 0.0;
+    for (const SimSystem& system : systems) {
+        LOG_F(INFO, "  {}: {:.3f} ms/tick ({:.3f} s total), on the critical path in {:.0f}% of ticks", system.name,
+              system.total_s * 1000.0 / divisor, system.total_s,
+              static_cast<f64>(system.critical_ticks) * 100.0 / divisor);
+        serial_s += system.total_s;
+    }
+    LOG_F(INFO, "  Systems took {:.3f} ms/tick, against {:.3f} ms/tick in sequence and {:.3f} ms/tick on the critical "
+                "path",
+          total_systems_s * 1000.0 / divisor, serial_s * 1000.0 / divisor, total_critical_path_s * 1000.0 / divisor);
+}
+
+u64 Simulation::compute_state_hash() {
+    StateHasher hasher(seed);
+    hasher.update(rng.state);
+
+    for (StateBlock& block : state_blocks) {
+        if (block.dirty) {
+            StateHasher block_hasher(seed);
+            block.hash(block_hasher);
+            block.cached_hash = block_hasher.finish();
+            block.dirty = false;
+        }
+        hasher.update(block.cached_hash);
+    }
+
+    return hasher.finish();
+}
+
+void Simulation::save(SaveWriter& writer) const {
+    writer.add_value("sim.seed", seed);
+    writer.add_value("sim.tick", tick);
+    writer.add_value("sim.rng", rng.state);
+    writer.add_value("sim.tick_hash", tick_hash);
+
+    for (const StateBlock& block : state_blocks) {
+        if (block.save) {
+            block.save(writer);
+        }
+    }
+}
+
+// Links each system to the earlier systems it conflicts with. Only runs when systems are added, not every tick.
+void Simulation::build_schedule() {
+    for (SimSystem& system : systems) {
+        system.dependencies.clear();
+        system.dependents.clear();
+    }
+    for (u32 j = 0; j < systems.size(); ++j) {
+        for (u32 i = 0; i < j; ++i) {
+            if (conflicts(systems[i], systems[j])) {
+                systems[j].dependencies.push_back(i);
+                systems[i].dependents.push_back(j);
+            }
+        }
+    }
+    schedule_stale = false;
+}
+
+void Simulation::run_systems() {
+    if (schedule_stale) {
+        build_schedule();
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto count = static_cast<u32>(systems.size());
+    running_systems = true;
+
+    if (!thread_pool || thread_pool->threads.empty() || count < 2) {
+        for (u32 i = 0; i < count; ++i) {
+            run_system(i, start);
+        }
+    } else {
+        auto state = std::make_shared<ScheduleState>();
+        state->thread_pool = thread_pool;
+        state->systems = &systems;
+        state->run_system = [this, start](const u32 index) { run_system(index, start); };
+        state->pending.resize(count);
+        for (u32 i = count; i-- > 0;) {
+            state->pending[i] = static_cast<u32>(systems[i].dependencies.size());
+            if (state->pending[i] == 0) {
+                state->ready.push_back(i);
+            }
+        }
+
+        // Helpers start taking systems as soon as they are submitted.
+        const size_t root_count = state->ready.size();
+        for (size_t i = 1; i < root_count; ++i) {
+            thread_pool->submit([state] { run_ready(state, false); });
+        }
+        run_ready(state, true);
+    }
+
+    running_systems = false;
+    systems_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+    total_systems_s += systems_s;
+    find_critical_path();
+
+    if (loguru::current_verbosity_cutoff() >= 1 && !critical_path.empty()) {
+        std::string path = systems[critical_path[0]].name;
+        for (size_t i = 1; i < critical_path.size(); ++i) {
+            path += " > " + systems[critical_path[i]].name;
+        }
+        ALOG_F(1, "Tick {}: systems took {:.3f} ms, critical path {:.3f} ms: {}", tick + 1, systems_s * 1000.0,
+               critical_path_s * 1000.0, path);
+    }
+}
+
+void Simulation::run_system(const u32 index, const std::chrono::steady_clock::time_point start) {
+    SimSystem& system = systems[index];
+    const auto system_start = std::chrono::steady_clock::now();
+    system.update(*this);
+    const auto system_end = std::chrono::steady_clock::now();
+
+    system.start_s = std::chrono::duration<f64>(system_start - start).count();
+    system.end_s = std::chrono::duration<f64>(system_end - start).count();
+    system.total_s += system.end_s - system.start_s;
+}
+
+// Finds the chain of dependent systems with the longest total time in the last tick. Systems only depend on earlier
+// ones, so their order is a topological order.
+void Simulation::find_critical_path() {
+    critical_path.clear();
+    critical_path_s = 0.0;
+    if (systems.empty()) {
+        return;
+    }
+
+    const auto count = static_cast<u32>(systems.size());
+    std::vector<f64> finish_s(count);
+    std::vector<u32> previous(count, count);
+    u32 last = 0;
+    for (u32 i = 0; i < count; ++i) {
+        const SimSystem& system = systems[i];
+        f64 ready_s = 0.0;
+        for (const u32 dependency : system.dependencies) {
+            if (finish_s[dependency] > ready_s) {
+                ready_s = finish_s[dependency];
+                previous[i] = dependency;
+            }
+        }
+        finish_s[i] = ready_s + (system.end_s - system.start_s);
+        if (finish_s[i] > finish_s[last]) {
+            last = i;
+        }
+    }
+
+    for (u32 i = last; i != count; i = previous[i]) {
+        critical_path.push_back(i);
+        ++systems[i].critical_ticks;
+    }
+    std::reverse(critical_path.begin(), critical_path.end());
+    critical_path_s = finish_s[last];
+    total_critical_path_s += critical_path_s;
+}
+
+bool Simulation::load(SaveFile& file) {
+    if (!file.get_value("sim.seed", seed) || !file.get_value("sim.tick", tick) ||
+        !file.get_value("sim.rng", rng.state) || !file.get_value("sim.tick_hash", tick_hash)) {
+        return false;
+    }
+    hash_history_start = tick;
+    commands.clear();
+
+    for (StateBlock& block : state_blocks) {
+        if (block.load && !block.load(file)) {
+            LOG_F(WARNING, "Failed to load state block {}", block.name);
+            return false;
+        }
+        block.dirty = true;
+    }
+    ++version;
+
+    return true;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include "fixed.hpp"
+#include "save.hpp"
+#include "utility.hpp"
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+struct Simulation;
+struct ThreadPool;
+
+// xoshiro256** seeded through splitmix64. The simulation owns the only generator game state may draw from, so the
+// sequence of draws, and therefore the game, only depends on the seed and the inputs.
+struct Rng {
+    u64 state[4] = {};
+
+    Rng() = default;
+    explicit Rng(u64 seed);
+
+    void seed(u64 seed);
+
+    u64 next_u64();
+
+    // Uniform in [0, bound), without modulo bias.
+    u32 uniform(u32 bound);
+
+    // Uniform in [0, 1).
+    Fixed uniform_fixed();
+};
+
+// Streaming 64-bit hash in the style of XXH3: 16-byte stripes are folded into the accumulator through 64x64->128-bit
+// multiplications with secret constants, and the result is avalanched at the end. Only used to compare states, so it
+// doesn't need to match XXH3's output.
+struct StateHasher {
+    u64 acc;
+    u64 length = 0;
+    u8 buffer[16];
+    u32 buffer_size = 0;
+
+    explicit StateHasher(u64 seed = 0);
+
+    void update(const void* data, size_t size);
+
+    template <class T>
+    void update(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T> && std::has_unique_object_representations_v<T>);
+        update(&value, sizeof(T));
+    }
+
+    template <class T, class A>
+    void update(const std::vector<T, A>& values) {
+        static_assert(std::is_trivially_copyable_v<T> && std::has_unique_object_representations_v<T>);
+        update(values.size());
+        update(values.data(), values.size() * sizeof(T));
+    }
+
+    u64 finish() const;
+
+private:
+    void consume_stripe(const u8* stripe);
+};
+
+// A piece of simulation state that takes part in the tick hash. Its hash is cached, and only recomputed after
+// `Simulation::mark_dirty()`, so unchanged state costs nothing per tick.
+// `save` and `load` are optional; blocks without them are not persisted. `end_tick` is also optional: if set, it is
+// called after the systems of every tick, and returning true marks the block dirty, for state that tracks its own
+// changes. `reset`, if set, is called by `Simulation::init()` to return the state to the start of a game.
+//
+// The functions are code in this library, so blocks are removed before a hot reload and added again after it.
+struct StateBlock {
+    std::string name;
+    std::function<void(StateHasher&)> hash;
+    std::function<void(SaveWriter&)> save;
+    std::function<bool(SaveFile&)> load;
+    std::function<bool()> end_tick;
+    std::function<void()> reset;
+    u64 cached_hash = 0;
+    bool dirty = true;
+};
+
+// State a system touches, by name: a state block, or a part of one such as "world.armies.strength". A name covers
+// the names it prefixes, so "world.armies" covers every column of the table, and adding and removing armies. Systems
+// that draw from `Simulation::rng` write `sim_rng`. Reading `Simulation::commands` needs no declaration, since systems
+// never write them.
+struct SystemAccess {
+    std::vector<std::string> reads;
+    std::vector<std::string> writes;
+};
+
+inline constexpr const char* sim_rng = "sim.rng";
+
+struct SimSystem {
+    std::string name;
+    SystemAccess access;
+    // Added without declaring its access, so it runs alone.
+    bool exclusive = false;
+    std::function<void(Simulation&)> update;
+
+    // Earlier systems whose access conflicts with this one's, and later ones that conflict with it
+    std::vector<u32> dependencies;
+    std::vector<u32> dependents;
+
+    // Start and end of `update` during the last tick, relative to the start of its systems
+    f64 start_s = 0.0;
+    f64 end_s = 0.0;
+
+    // Since the last `Simulation::reset_timings()`: wall time spent in `update`, and the number of ticks the system
+    // was on the critical path
+    f64 total_s = 0.0;
+    u64 critical_ticks = 0;
+};
+
+// A request to change game state, queued for the next tick. Commands are the only way input reaches the simulation,
+// so recording them is enough to replay a game.
+struct SimCommand {
+    i32 type;
+    std::vector<u8> data;
+};
+
+// Deterministic lockstep simulation. Systems must only use fixed-point arithmetic, `rng` and ordered containers, so
+// that the same seed and inputs give the same state on every machine. After every tick, the hash of all state blocks
+// is chained into `tick_hash`, which identifies the whole history up to that tick.
+//
+// Systems that declare their access run concurrently on `thread_pool`. Two systems conflict if one writes state that
+// the other reads or writes; conflicting systems run in the order they were added, and others never touch the same
+// state, so the result doesn't depend on the number of threads or on how they are scheduled.
+struct Simulation {
+    u64 seed = 0;
+    u64 tick = 0;
+    Rng rng;
+
+    std::vector<StateBlock> state_blocks;
+    std::vector<SimSystem> systems;
+    // Runs systems if set. Otherwise they run in order on the calling thread.
+    ThreadPool* thread_pool = nullptr;
+    // The dependencies of systems are found again before the next tick.
+    bool schedule_stale = true;
+    // Set while systems run, when `mark_dirty()` isn't allowed
+    bool running_systems = false;
+
+    // Commands for the next tick. Systems read them, and they are cleared once the tick is done.
+    std::vector<SimCommand> commands;
+
+    u64 tick_hash = 0;
+    // Incremented whenever state blocks are marked dirty, loaded or reset, so that views can tell when they are out of
+    // date.
+    u64 version = 0;
+    // `tick_hash` after each of the last `hash_history_ticks` ticks, indexed by (tick number - 1) modulo that. Bounded,
+    // since a session can run for days.
+    static constexpr u64 hash_history_ticks = 60 * 60 * 10;
+    std::vector<u64> hash_history;
+    // Tick of the last `init()` or `load()`, which the history starts after
+    u64 hash_history_start = 0;
+
+    // Of the last tick: wall time spent running systems, and the chain of dependent systems that took longest, which
+    // bounds the time however many threads there are
+    f64 systems_s = 0.0;
+    f64 critical_path_s = 0.0;
+    std::vector<u32> critical_path;
+    // Sums of the above since the last `reset_timings()`
+    f64 total_systems_s = 0.0;
+    f64 total_critical_path_s = 0.0;
+
+    void init(u64 seed);
+
+    u32 add_state_block(std::string name, std::function<void(StateHasher&)> hash,
+                        std::function<void(SaveWriter&)> save = {}, std::function<bool(SaveFile&)> load = {},
+                        std::function<bool()> end_tick = {}, std::function<void()> reset = {});
+    // Not for systems, which may be running concurrently. State that systems write tracks its changes and reports
+    // them through its block's `end_tick`, which runs once they have all finished.
+    void mark_dirty(u32 block);
+
+    void add_system(std::string name, SystemAccess access, std::function<void(Simulation&)> update);
+    // The system conflicts with every other, so it runs alone, after the systems added before it.
+    void add_system(std::string name, std::function<void(Simulation&)> update);
+
+    void step();
+
+    void reset_timings();
+    // Logs the time per tick spent in each system over `ticks` ticks, how often it was on the critical path, and how
+    // close the systems came to the critical path.
+    void log_timings(u64 ticks) const;
+
+    // Sets `hash` to `tick_hash` as of `tick`. Returns false if that tick hasn't happened yet, happened before the last
+    // `init()` or `load()`, or is too old to be kept.
+    bool get_tick_hash(u64 tick, u64& hash) const;
+
+    // Hash of the current state, independent of the history that led to it.
+    u64 compute_state_hash();
+
+    // Adds the simulation state to `writer`, which references it until `SaveWriter::write()`. The hash history is not
+    // saved; a loaded simulation starts a new one.
+    void save(SaveWriter& writer) const;
+    // Returns false, leaving the simulation in an unspecified state, if `file` is missing any saved state.
+    bool load(SaveFile& file);
+
+private:
+    void build_schedule();
+    void run_systems();
+    void run_system(u32 index, std::chrono::steady_clock::time_point start);
+    void find_critical_path();
+};
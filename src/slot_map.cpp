@@ -0,0 +1,105 @@
+#include "slot_map.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+
+namespace {
+
+// About the size of a `VertexBufferObject`
+struct BenchResource {
+    u32 id;
+    u32 type;
+    u32 usage;
+    i64 size;
+};
+
+template <class F>
+f64 time_ns_per(const size_t count, F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const f64 elapsed_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+    return elapsed_s * 1e9 / static_cast<f64>(count);
+}
+} // namespace
+
+void bench_slot_map() {
+    constexpr size_t lookup_count = 10'000'000;
+    constexpr size_t iteration_count = 20'000'000;
+
+    std::mt19937 rng(12345);
+
+    for (const u32 resource_count : {64u, 4'096u, 65'536u}) {
+        std::unordered_map<u32, BenchResource> map;
+        SlotMap<BenchResource> slot_map;
+        std::vector<u32> keys;
+        std::vector<Handle<BenchResource>> handles;
+
+        // GL names are small integers handed out in order.
+        for (u32 i = 0; i < resource_count; ++i) {
+            const BenchResource resource = {i + 1, i % 3, i % 5, i64(i) * 16};
+            map.emplace(resource.id, resource);
+            keys.push_back(resource.id);
+            handles.push_back(slot_map.insert(resource));
+        }
+
+        // Churn, so that neither container is in its freshly built order.
+        for (u32 i = 0; i < resource_count / 4; ++i) {
+            const u32 victim = static_cast<u32>(rng() % resource_count);
+            const BenchResource resource = map.at(keys[victim]);
+            map.erase(keys[victim]);
+            slot_map.erase(handles[victim]);
+
+            const u32 id = resource_count + i + 1;
+            map.emplace(id, BenchResource{id, resource.type, resource.usage, resource.size});
+            keys[victim] = id;
+            handles[victim] = slot_map.insert(BenchResource{id, resource.type, resource.usage, resource.size});
+        }
+
+        std::vector<u32> order(lookup_count);
+        for (u32& i : order) {
+            i = static_cast<u32>(rng() % resource_count);
+        }
+
+        i64 map_sum = 0;
+        const f64 map_lookup_ns = time_ns_per(lookup_count, [&] {
+            for (const u32 i : order) {
+                map_sum += map.at(keys[i]).size;
+            }
+        });
+
+        i64 slot_map_sum = 0;
+        const f64 slot_map_lookup_ns = time_ns_per(lookup_count, [&] {
+            for (const u32 i : order) {
+                slot_map_sum += slot_map.get(handles[i]).size;
+            }
+        });
+        CHECK_F(map_sum == slot_map_sum);
+
+        const size_t passes = std::max<size_t>(iteration_count / resource_count, 1);
+        map_sum = 0;
+        const f64 map_iterate_ns = time_ns_per(passes * resource_count, [&] {
+            for (size_t pass = 0; pass < passes; ++pass) {
+                for (const auto& entry : map) {
+                    map_sum += entry.second.size;
+                }
+            }
+        });
+
+        slot_map_sum = 0;
+        const f64 slot_map_iterate_ns = time_ns_per(passes * resource_count, [&] {
+            for (size_t pass = 0; pass < passes; ++pass) {
+                for (const BenchResource& resource : slot_map) {
+                    slot_map_sum += resource.size;
+                }
+            }
+        });
+        CHECK_F(map_sum == slot_map_sum);
+
+        LOG_F(INFO,
+              "{} resources: lookup {:.2f} ns (unordered_map) vs {:.2f} ns (SlotMap), iteration {:.2f} ns vs {:.2f} ns "
+              "per value",
+              resource_count, map_lookup_ns, slot_map_lookup_ns, map_iterate_ns, slot_map_iterate_ns);
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "utility.hpp"
+
+#include <vector>
+
+// Refers to a value in a `SlotMap<T>`. A handle to an erased value is detected rather than finding whatever reused its
+// slot.
+template <class T>
+struct Handle {
+    u32 index = 0;
+    // 0 for a null handle. Slots start at generation 1 and move to the next generation when their value is erased.
+    u32 generation = 0;
+
+    explicit operator bool() const {
+        return generation != 0;
+    }
+
+    bool operator==(const Handle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+
+    bool operator!=(const Handle& other) const {
+        return !(*this == other);
+    }
+};
+
+// Values in one contiguous array, found through handles in O(1). Each handle indexes a slot, which holds the value's
+// position in the array and a generation that the handle must match. Erasing moves the last value into the gap, so
+// iteration stays dense, and puts the slot on a free list for reuse under the next generation.
+template <class T>
+struct SlotMap {
+    struct Slot {
+        // Index into `values` if occupied, or the next free slot otherwise
+        u32 index;
+        u32 generation;
+    };
+
+    static constexpr u32 no_slot = ~0u;
+
+    std::vector<T> values;
+    // Slot of each value, for fixing up the slot of the value moved by `erase`
+    std::vector<u32> value_slots;
+    std::vector<Slot> slots;
+    u32 free_head = no_slot;
+
+    Handle<T> insert(T value) {
+        u32 slot_index;
+        if (free_head != no_slot) {
+            slot_index = free_head;
+            free_head = slots[slot_index].index;
+        } else {
+            slot_index = static_cast<u32>(slots.size());
+            slots.push_back({0, 1});
+        }
+
+        Slot& slot = slots[slot_index];
+        slot.index = static_cast<u32>(values.size());
+        values.push_back(std::move(value));
+        value_slots.push_back(slot_index);
+        return {slot_index, slot.generation};
+    }
+
+    void erase(const Handle<T> handle) {
+        CHECK_F(contains(handle), "Erasing an invalid handle");
+        Slot& slot = slots[handle.index];
+
+        const u32 last = static_cast<u32>(values.size() - 1);
+        if (slot.index != last) {
+            values[slot.index] = std::move(values[last]);
+            value_slots[slot.index] = value_slots[last];
+            slots[value_slots[slot.index]].index = slot.index;
+        }
+        values.pop_back();
+        value_slots.pop_back();
+
+        // Generation 0 is kept for null handles.
+        slot.generation = slot.generation == ~0u ? 1 : slot.generation + 1;
+        slot.index = free_head;
+        free_head = handle.index;
+    }
+
+    bool contains(const Handle<T> handle) const {
+        return handle.generation != 0 && handle.index < slots.size() &&
+               slots[handle.index].generation == handle.generation;
+    }
+
+    // Returns null if `handle` is null or its value has been erased.
+    T* find(const Handle<T> handle) {
+        return contains(handle) ? &values[slots[handle.index].index] : nullptr;
+    }
+
+    const T* find(const Handle<T> handle) const {
+        return contains(handle) ? &values[slots[handle.index].index] : nullptr;
+    }
+
+    T& get(const Handle<T> handle) {
+        CHECK_F(contains(handle), "Invalid handle {} generation {}", handle.index, handle.generation);
+        return values[slots[handle.index].index];
+    }
+
+    const T& get(const Handle<T> handle) const {
+        CHECK_F(contains(handle), "Invalid handle {} generation {}", handle.index, handle.generation);
+        return values[slots[handle.index].index];
+    }
+
+    Handle<T> get_handle(const size_t value_index) const {
+        const u32 slot_index = value_slots[value_index];
+        return {slot_index, slots[slot_index].generation};
+    }
+
+    size_t size() const {
+        return values.size();
+    }
+
+    auto begin() {
+        return values.begin();
+    }
+
+    auto end() {
+        return values.end();
+    }
+
+    auto begin() const {
+        return values.begin();
+    }
+
+    auto end() const {
+        return values.end();
+    }
+};
+
+// Logs the time to iterate over and look up values in a `SlotMap` and in an `std::unordered_map` keyed by GL name,
+// which the renderer used before.
+void bench_slot_map();
@@ -0,0 +1,152 @@
+#include "symbol.hpp"
+
+#include "app.hpp"
+
+#include <cstring>
+#include <mutex>
+
+SymbolTable::SymbolTable() {
+    slots.resize(1024);
+    add("", hash_string(""));
+    for (const std::string_view name : keyword_names) {
+        add(name, hash_string(name));
+    }
+}
+
+Symbol SymbolTable::intern(const std::string_view str) {
+    if (str.empty()) {
+        return Symbol();
+    }
+
+    const u64 hash = hash_string(str);
+    const Keyword keyword = keyword_table.find(str, hash);
+    if (keyword != Keyword::count) {
+        return keyword;
+    }
+
+    {
+        std::shared_lock lock(mutex);
+        const u32 id = slots[find_slot(str, hash)];
+        if (id != 0) {
+            return Symbol(id);
+        }
+    }
+
+    // Another thread may have added it between the locks.
+    std::unique_lock lock(mutex);
+    const u32 id = slots[find_slot(str, hash)];
+    if (id != 0) {
+        return Symbol(id);
+    }
+    return add(str, hash);
+}
+
+Symbol SymbolTable::find(const std::string_view str) {
+    if (str.empty()) {
+        return Symbol();
+    }
+
+    const u64 hash = hash_string(str);
+    const Keyword keyword = keyword_table.find(str, hash);
+    if (keyword != Keyword::count) {
+        return keyword;
+    }
+
+    std::shared_lock lock(mutex);
+    return Symbol(slots[find_slot(str, hash)]);
+}
+
+const char* SymbolTable::get_name(const Symbol symbol) const {
+    return get_entry(symbol).str;
+}
+
+std::string_view SymbolTable::get_view(const Symbol symbol) const {
+    const Entry& entry = get_entry(symbol);
+    return {entry.str, entry.length};
+}
+
+u64 SymbolTable::get_hash(const Symbol symbol) const {
+    return get_entry(symbol).hash;
+}
+
+u32 SymbolTable::size() const {
+    return count.load(std::memory_order_acquire);
+}
+
+const SymbolTable::Entry& SymbolTable::get_entry(const Symbol symbol) const {
+    CHECK_F(symbol.id < size(), "Invalid symbol {}", symbol.id);
+    return pages[symbol.id >> page_bits][symbol.id & (page_size - 1)];
+}
+
+u32 SymbolTable::find_slot(const std::string_view str, const u64 hash) const {
+    const auto mask = static_cast<u32>(slots.size() - 1);
+    u32 slot = static_cast<u32>(mix_hash(hash)) & mask;
+    while (true) {
+        const u32 id = slots[slot];
+        if (id == 0) {
+            return slot;
+        }
+        const Entry& entry = get_entry(Symbol(id));
+        if (entry.hash == hash && std::string_view(entry.str, entry.length) == str) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+// Called with the lock held exclusively, or from the constructor.
+Symbol SymbolTable::add(const std::string_view str, const u64 hash) {
+    const u32 id = count.load(std::memory_order_relaxed);
+    CHECK_F(id < page_size * max_pages, "Too many symbols");
+
+    if (char_block_used + str.size() + 1 > char_block_size) {
+        char_blocks.push_back(std::make_unique<char[]>(std::max(char_block_size, str.size() + 1)));
+        char_block_used = 0;
+    }
+    char* const chars = char_blocks.back().get() + char_block_used;
+    std::memcpy(chars, str.data(), str.size());
+    chars[str.size()] = '\0';
+    // Long strings get a block of their own, which is left full.
+    char_block_used = str.size() + 1 > char_block_size ? char_block_size : char_block_used + str.size() + 1;
+
+    std::unique_ptr<Entry[]>& page = pages[id >> page_bits];
+    if (!page) {
+        page = std::make_unique<Entry[]>(page_size);
+    }
+    page[id & (page_size - 1)] = {chars, static_cast<u32>(str.size()), hash};
+    count.store(id + 1, std::memory_order_release);
+
+    // The empty string is symbol 0, which the slots can't hold, and is never looked up.
+    if (id != 0) {
+        if (2 * size() > slots.size()) {
+            grow();
+        }
+        slots[find_slot(str, hash)] = id;
+    }
+    return Symbol(id);
+}
+
+// Reinserts every symbol by its stored hash, without touching the strings.
+void SymbolTable::grow() {
+    std::vector<u32> old_slots = std::move(slots);
+    slots.assign(old_slots.size() * 2, 0);
+    const auto mask = static_cast<u32>(slots.size() - 1);
+    for (const u32 id : old_slots) {
+        if (id == 0) {
+            continue;
+        }
+        u32 slot = static_cast<u32>(mix_hash(get_entry(Symbol(id)).hash)) & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id;
+    }
+}
+
+Symbol intern(const std::string_view str) {
+    return app->symbols.intern(str);
+}
+
+const char* get_name(const Symbol symbol) {
+    return app->symbols.get_name(symbol);
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "utility.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+// Names the engine itself uses. Their symbols are interned first, in this order, so each has a fixed ID known at
+// compile time.
+enum class Keyword : u32 {
+    // Province fields
+    name,
+    admin,
+
+    // Uniform blocks and uniforms
+    ViewProjection,
+    projection_from,
+    projection_to,
+    projection_blend,
+    terrain_enabled,
+    terrain_colour,
+    terrain_height_scale,
+    terrain_tiles,
+    terrain_indirection,
+    borders_enabled,
+    border_width,
+    atlas,
+    viewport,
+
+    count,
+};
+
+inline constexpr u32 keyword_count = static_cast<u32>(Keyword::count);
+
+inline constexpr std::array<std::string_view, keyword_count> keyword_names = {
+        "name",
+        "admin",
+        "ViewProjection",
+        "projection_from",
+        "projection_to",
+        "projection_blend",
+        "terrain_enabled",
+        "terrain_colour",
+        "terrain_height_scale",
+        "terrain_tiles",
+        "terrain_indirection",
+        "borders_enabled",
+        "border_width",
+        "atlas",
+        "viewport",
+};
+
+// An interned string. Comparing and hashing symbols only touches their IDs. ID 0 is the empty string, which is also
+// used for no symbol.
+struct Symbol {
+    u32 id = 0;
+
+    constexpr Symbol() = default;
+    constexpr explicit Symbol(const u32 id) : id(id) {}
+    // Implicit, so that keywords can be passed wherever a symbol is expected.
+    constexpr Symbol(const Keyword keyword) : id(static_cast<u32>(keyword) + 1) {}
+
+    constexpr explicit operator bool() const {
+        return id != 0;
+    }
+
+    constexpr bool operator==(const Symbol other) const {
+        return id == other.id;
+    }
+
+    constexpr bool operator!=(const Symbol other) const {
+        return id != other.id;
+    }
+};
+
+struct SymbolHash {
+    size_t operator()(const Symbol symbol) const {
+        return symbol.id;
+    }
+};
+
+// Perfect hash table of the keywords, built by the compiler. The seed is the first one that gives every keyword its
+// own slot, so a lookup is one hash of the string and at most one string comparison.
+struct KeywordTable {
+    static constexpr u32 slot_count = 64;
+    static_assert(slot_count >= 2 * keyword_count);
+
+    u64 seed = 0;
+    // Keyword + 1 for each slot, or 0 if empty
+    std::array<u8, slot_count> slots = {};
+
+    constexpr KeywordTable() {
+        while (!try_seed()) {
+            ++seed;
+        }
+    }
+
+    static constexpr u32 get_slot(const u64 hash, const u64 seed) {
+        return static_cast<u32>(mix_hash(hash ^ seed) & (slot_count - 1));
+    }
+
+    // Returns `Keyword::count` if `str`, whose `hash_string` is `hash`, isn't a keyword.
+    constexpr Keyword find(const std::string_view str, const u64 hash) const {
+        const u8 entry = slots[get_slot(hash, seed)];
+        if (entry != 0 && keyword_names[entry - 1u] == str) {
+            return static_cast<Keyword>(entry - 1u);
+        }
+        return Keyword::count;
+    }
+
+    constexpr Keyword find(const std::string_view str) const {
+        return find(str, hash_string(str));
+    }
+
+private:
+    constexpr bool try_seed() {
+        for (u8& slot : slots) {
+            slot = 0;
+        }
+        for (u32 i = 0; i < keyword_count; ++i) {
+            u8& slot = slots[get_slot(hash_string(keyword_names[i]), seed)];
+            if (slot != 0) {
+                return false;
+            }
+            slot = static_cast<u8>(i + 1);
+        }
+        return true;
+    }
+};
+
+inline constexpr KeywordTable keyword_table;
+
+static_assert(keyword_table.find("ViewProjection") == Keyword::ViewProjection);
+static_assert(keyword_table.find("viewport") == Keyword::viewport);
+static_assert(keyword_table.find("not a keyword") == Keyword::count);
+
+// Thread-safe string interning. Each distinct string is stored once, with its hash, and never moves, so names can be
+// kept as `const char*` or compared as symbols. Lookups of strings take a shared lock, or none for keywords. Reading a
+// symbol's name or hash never locks: entries are written before their symbol is handed out, into pages that are never
+// moved or freed.
+struct SymbolTable {
+    struct Entry {
+        const char* str;
+        u32 length;
+        u64 hash;
+    };
+
+    static constexpr u32 page_bits = 12;
+    static constexpr u32 page_size = 1u << page_bits;
+    static constexpr u32 max_pages = 1u << 12;
+    static constexpr size_t char_block_size = 64 * 1024;
+
+    std::shared_mutex mutex;
+    std::array<std::unique_ptr<Entry[]>, max_pages> pages;
+    std::atomic<u32> count = 0;
+
+    // Characters of every entry, with a null after each, in blocks that are never moved
+    std::vector<std::unique_ptr<char[]>> char_blocks;
+    size_t char_block_used = char_block_size;
+
+    // Open addressing by hash, holding symbol IDs, or 0 for an empty slot. Kept at most half full.
+    std::vector<u32> slots;
+
+    // Interns the empty string and the keywords.
+    SymbolTable();
+
+    Symbol intern(std::string_view str);
+    // Returns the null symbol if `str` hasn't been interned. Never adds an entry.
+    Symbol find(std::string_view str);
+
+    const char* get_name(Symbol symbol) const;
+    std::string_view get_view(Symbol symbol) const;
+    u64 get_hash(Symbol symbol) const;
+    u32 size() const;
+
+private:
+    const Entry& get_entry(Symbol symbol) const;
+    // Returns the slot holding `str`, or the empty slot where it would go.
+    u32 find_slot(std::string_view str, u64 hash) const;
+    Symbol add(std::string_view str, u64 hash);
+    void grow();
+};
+
+// Through `app->symbols`, which outlives a hot reload of the code.
+Symbol intern(std::string_view str);
+const char* get_name(Symbol symbol);
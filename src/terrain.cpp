@@ -0,0 +1,665 @@
+#include "terrain.hpp"
+
+#include "geometry.hpp"
+#include "render.hpp"
+
+#include <gdal_frmts.h>
+#include <glad/glad.h>
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+// The indirection texture has `2^max_level` texels along each side of a face, so this bounds its size.
+constexpr u32 max_terrain_level = 9;
+
+constexpr u16 no_layer = 0xFFFF;
+
+constexpr f64 earth_radius_m = 6'371'000.0;
+
+// Cube faces as (normal, right, up). Must match planet.frag.
+constexpr f64 face_axes[6][3][3] = {
+        {{1.0, 0.0, 0.0}, {0.0, 0.0, -1.0}, {0.0, 1.0, 0.0}},  {{-1.0, 0.0, 0.0}, {0.0, 0.0, 1.0}, {0.0, 1.0, 0.0}},
+        {{0.0, 1.0, 0.0}, {1.0, 0.0, 0.0}, {0.0, 0.0, -1.0}},  {{0.0, -1.0, 0.0}, {1.0, 0.0, 0.0}, {0.0, 0.0, 1.0}},
+        {{0.0, 0.0, 1.0}, {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}},   {{0.0, 0.0, -1.0}, {-1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}},
+};
+
+// Point on the unit sphere for cube face coordinates in [-1, 1].
+glm::dvec3 face_point(const u32 face, const f64 u, const f64 v) {
+    const auto& axes = face_axes[face];
+    return glm::normalize(glm::dvec3(axes[0][0], axes[0][1], axes[0][2]) +
+                          u * glm::dvec3(axes[1][0], axes[1][1], axes[1][2]) +
+                          v * glm::dvec3(axes[2][0], axes[2][1], axes[2][2]));
+}
+
+u64 tile_key(const u32 face, const u32 level, const u32 x, const u32 y) {
+    return u64(face) << 61 | u64(level) << 56 | u64(x) << 28 | u64(y);
+}
+
+u64 tile_key(const TerrainTile& tile) {
+    return tile_key(tile.face, tile.level, tile.x, tile.y);
+}
+
+u32 tile_key_level(const u64 key) {
+    return (key >> 56) & 0x1F;
+}
+
+GDALDataset* open_raster(const Path& path) {
+    const char* const allowed_drivers[] = {"GTiff", nullptr};
+    return static_cast<GDALDataset*>(
+            GDALOpenEx(path.c_str(), GDAL_OF_RASTER | GDAL_OF_READONLY, allowed_drivers, nullptr, nullptr));
+}
+} // namespace
+
+bool Terrain::init(const Path& path, const TerrainConfig& config) {
+    this->config = config;
+    this->path = path;
+
+    if (!std::filesystem::exists(path)) {
+        LOG_F(WARNING, "Terrain raster {} not found", path.string());
+        return false;
+    }
+
+    // Only the drivers in use are registered, so GTiff waits until there is a raster to read.
+    GDALRegister_GTiff();
+    GDALDataset* const dataset = open_raster(path);
+    if (dataset == nullptr) {
+        LOG_F(WARNING, "Failed to open terrain raster {}", path.string());
+        return false;
+    }
+    datasets.push_back(dataset);
+
+    if (dataset->GetGeoTransform(geo_transform.data()) != CE_None || std::abs(geo_transform[2]) > 0.0 ||
+        std::abs(geo_transform[4]) > 0.0) {
+        LOG_F(WARNING, "Terrain raster {} isn't north up", path.string());
+        return false;
+    }
+
+    const OGRSpatialReference* const srs = dataset->GetSpatialRef();
+    if (srs != nullptr && !srs->IsGeographic()) {
+        LOG_F(WARNING, "Terrain raster {} isn't in longitude/latitude", path.string());
+        return false;
+    }
+
+    const i32 band_count = dataset->GetRasterCount();
+    if (band_count == 1) {
+        kind = TerrainKind::height;
+    } else if (band_count >= 3) {
+        kind = TerrainKind::colour;
+    } else {
+        LOG_F(WARNING, "Terrain raster {} has {} bands", path.string(), band_count);
+        return false;
+    }
+
+    raster_width = dataset->GetRasterXSize();
+    raster_height = dataset->GetRasterYSize();
+
+    GDALRasterBand* const band = dataset->GetRasterBand(1);
+    i32 has_no_data_i32;
+    no_data = band->GetNoDataValue(&has_no_data_i32);
+    has_no_data = has_no_data_i32;
+
+    const auto raster_size = static_cast<u32>(std::max(raster_width, raster_height));
+    if (band->GetOverviewCount() == 0 && raster_size > 4 * config.tile_size) {
+        LOG_F(WARNING, "Terrain raster {} has no overviews, so coarse tiles read it at full resolution", path.string());
+    }
+
+    // Stop splitting once a tile's samples are finer than the raster's pixels. A level 0 tile spans 90 degrees.
+    const f64 pixel_degrees = std::min(std::abs(geo_transform[1]), std::abs(geo_transform[5]));
+    max_level = 0;
+    while (max_level < max_terrain_level &&
+           90.0 / static_cast<f64>(1u << max_level) / static_cast<f64>(config.tile_size - 1) > pixel_degrees) {
+        ++max_level;
+    }
+
+    // Heights are stored as R32F and colours as RGBA8
+    tile_bytes = size_t(config.tile_size) * config.tile_size * 4;
+
+    i32 max_layers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    layer_count = static_cast<u32>(
+            std::min({config.gpu_budget_bytes / tile_bytes, static_cast<size_t>(max_layers), size_t(no_layer)}));
+    if (layer_count < 6) {
+        LOG_F(WARNING, "Terrain GPU budget of {} bytes is too small", config.gpu_budget_bytes);
+        return false;
+    }
+
+    const auto tile_size = static_cast<GLsizei>(config.tile_size);
+    glGenTextures(1, &tile_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tile_texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, kind == TerrainKind::height ? GL_R32F : GL_SRGB8_ALPHA8, tile_size,
+                   tile_size, static_cast<GLsizei>(layer_count));
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    free_layers.clear();
+    for (u32 i = layer_count; i-- > 0;) {
+        free_layers.push_back(static_cast<i32>(i));
+    }
+
+    indirection_size = 1u << max_level;
+    indirection.assign(size_t(6) * indirection_size * indirection_size * 2, 0);
+    for (size_t i = 0; i < indirection.size(); i += 2) {
+        indirection[i] = no_layer;
+    }
+    for (auto& dirty : indirection_dirty) {
+        dirty = {0, 0, indirection_size - 1, indirection_size - 1};
+    }
+
+    glGenTextures(1, &indirection_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, indirection_texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RG16UI, static_cast<GLsizei>(indirection_size),
+                   static_cast<GLsizei>(indirection_size), 6);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    upload_indirection();
+
+    LOG_F(INFO, "Terrain: {}x{} {} raster, {} levels, {} texture layers", raster_width, raster_height,
+          kind == TerrainKind::height ? "height" : "colour", max_level + 1, layer_count);
+
+    enabled = true;
+    return true;
+}
+
+void Terrain::destroy() {
+    for (GDALDataset* const dataset : datasets) {
+        GDALClose(dataset);
+    }
+    datasets.clear();
+
+    if (tile_texture != 0) {
+        glDeleteTextures(1, &tile_texture);
+        tile_texture = 0;
+    }
+    if (indirection_texture != 0) {
+        glDeleteTextures(1, &indirection_texture);
+        indirection_texture = 0;
+    }
+
+    if (decoded_count > 0) {
+        LOG_F(INFO, "Terrain: decoded {} tiles, {:.2f} ms each", decoded_count,
+              decode_s * 1000.0 / static_cast<f64>(decoded_count));
+    }
+    enabled = false;
+}
+
+void Terrain::update(ThreadPool& pool, const glm::vec3& camera_pos, const f32 focal_pixels) {
+    if (!enabled) {
+        return;
+    }
+
+    ++frame;
+    receive_tiles();
+
+    // The level 0 tiles come first, so that the whole globe is covered as soon as possible.
+    std::vector<u64> requests;
+    for (u32 face = 0; face < 6; ++face) {
+        const u64 key = tile_key(face, 0, 0, 0);
+        if (tiles.find(key) == tiles.end()) {
+            requests.push_back(key);
+        }
+    }
+    select_tiles(camera_pos, focal_pixels, requests);
+
+    // Coarser tiles cover more of the screen, so they are loaded before finer ones.
+    std::stable_sort(requests.begin(), requests.end(),
+                     [](const u64 a, const u64 b) { return tile_key_level(a) < tile_key_level(b); });
+    for (const u64 key : requests) {
+        if (in_flight >= config.max_in_flight) {
+            break;
+        }
+        const auto it = tiles.find(key);
+        if (it == tiles.end() || !it->second.loading) {
+            request_tile(pool, key);
+        }
+    }
+
+    std::vector<TerrainTile*> uploads;
+    for (auto& entry : tiles) {
+        TerrainTile& tile = entry.second;
+        if (tile.layer < 0 && !tile.data.empty() && (tile.last_used == frame || tile.level == 0)) {
+            uploads.push_back(&tile);
+        }
+    }
+    std::sort(uploads.begin(), uploads.end(),
+              [](const TerrainTile* a, const TerrainTile* b) { return a->level < b->level; });
+    waiting_uploads = 0;
+    if (uploads.size() > config.max_uploads_per_frame) {
+        waiting_uploads = static_cast<u32>(uploads.size() - config.max_uploads_per_frame);
+        uploads.resize(config.max_uploads_per_frame);
+    }
+    for (TerrainTile* const tile : uploads) {
+        if (!upload_tile(*tile)) {
+            break;
+        }
+    }
+    upload_indirection();
+
+    evict_cpu();
+}
+
+bool Terrain::is_loading() const {
+    return enabled && (in_flight > 0 || waiting_uploads > 0);
+}
+
+void Terrain::bind(ShaderProgram& program, GLState& state) {
+    // Samplers of different types can't share a unit, even when one isn't used.
+    program.set_uniform_i32(Keyword::terrain_tiles, 1);
+    program.set_uniform_i32(Keyword::terrain_indirection, 2);
+    program.set_uniform_bool(Keyword::terrain_enabled, enabled);
+    if (!enabled) {
+        return;
+    }
+
+    program.set_uniform_bool(Keyword::terrain_colour, kind == TerrainKind::colour);
+    program.set_uniform_f32(Keyword::terrain_height_scale,
+                            config.height_exaggeration / static_cast<f32>(earth_radius_m));
+
+    state.bind_texture(1, tile_texture);
+    state.bind_texture(2, indirection_texture);
+}
+
+void Terrain::select_tiles(const glm::vec3& camera_pos, const f32 focal_pixels, std::vector<u64>& requests) {
+    const glm::dvec3 camera = camera_pos;
+    const f64 camera_distance = glm::length(camera);
+    const glm::dvec3 camera_dir = camera / camera_distance;
+    // Points further than this angle from the camera's direction are over the horizon.
+    const f64 horizon = camera_distance > 1.0 ? std::acos(1.0 / camera_distance) : glm::radians(90.0);
+
+    struct Node {
+        u32 face;
+        u32 level;
+        u32 x;
+        u32 y;
+    };
+    std::vector<Node> stack;
+    for (u32 face = 0; face < 6; ++face) {
+        stack.push_back({face, 0, 0, 0});
+    }
+
+    while (!stack.empty()) {
+        const Node node = stack.back();
+        stack.pop_back();
+
+        const f64 tile_extent = 2.0 / static_cast<f64>(1u << node.level);
+        const f64 u0 = -1.0 + tile_extent * static_cast<f64>(node.x);
+        const f64 v0 = -1.0 + tile_extent * static_cast<f64>(node.y);
+        const glm::dvec3 centre = face_point(node.face, u0 + 0.5 * tile_extent, v0 + 0.5 * tile_extent);
+        f64 radius = 0.0;
+        for (const f64 u : {u0, u0 + tile_extent}) {
+            for (const f64 v : {v0, v0 + tile_extent}) {
+                radius = std::max(radius, great_circle_distance(centre, face_point(node.face, u, v)));
+            }
+        }
+
+        const f64 centre_angle = great_circle_distance(centre, camera_dir);
+        if (centre_angle - radius > horizon) {
+            continue;
+        }
+
+        const u64 key = tile_key(node.face, node.level, node.x, node.y);
+        const auto it = tiles.find(key);
+        if (it != tiles.end()) {
+            it->second.last_used = frame;
+        }
+
+        // Distance to the nearest point of the tile, and the size of a sample there on screen. The half diagonal of a
+        // tile is about `1/sqrt(2)` of a side.
+        const f64 nearest_cos = std::cos(std::max(0.0, centre_angle - radius));
+        const f64 distance = std::sqrt(
+                std::max(camera_distance * camera_distance + 1.0 - 2.0 * camera_distance * nearest_cos, 1e-12));
+        const f64 sample_angle = radius * std::sqrt(2.0) / static_cast<f64>(config.tile_size - 1);
+        const f64 sample_pixels = sample_angle / distance * static_cast<f64>(focal_pixels);
+
+        if (node.level < max_level && sample_pixels > static_cast<f64>(config.sample_pixels)) {
+            for (u32 i = 0; i < 4; ++i) {
+                stack.push_back({node.face, node.level + 1, node.x * 2 + (i & 1), node.y * 2 + (i >> 1)});
+            }
+        } else if (it == tiles.end() || (!it->second.loading && it->second.data.empty() && it->second.layer < 0)) {
+            requests.push_back(key);
+        }
+    }
+}
+
+void Terrain::request_tile(ThreadPool& pool, const u64 key) {
+    TerrainTile& tile = tiles[key];
+    tile.face = u32(key >> 61);
+    tile.level = tile_key_level(key);
+    tile.x = u32(key >> 28) & 0xFFF'FFFF;
+    tile.y = u32(key) & 0xFFF'FFFF;
+    tile.loading = true;
+    tile.last_used = frame;
+    ++in_flight;
+
+    pool.submit([this, key] {
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<u8> data = decode_tile(key);
+        const f64 elapsed_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard lock(done_mutex);
+        done.emplace_back(key, std::move(data));
+        ++decoded_count;
+        decode_s += elapsed_s;
+    });
+}
+
+std::vector<u8> Terrain::decode_tile(const u64 key) {
+    const u32 face = u32(key >> 61);
+    const u32 level = tile_key_level(key);
+    const u32 tile_x = u32(key >> 28) & 0xFFF'FFFF;
+    const u32 tile_y = u32(key) & 0xFFF'FFFF;
+    const u32 n = config.tile_size;
+
+    GDALDataset* dataset = nullptr;
+    {
+        std::lock_guard lock(dataset_mutex);
+        if (!datasets.empty()) {
+            dataset = datasets.back();
+            datasets.pop_back();
+        }
+    }
+    if (dataset == nullptr) {
+        dataset = open_raster(path);
+        CHECK_NOTNULL_F(dataset, "Failed to open terrain raster {}", path.string());
+    }
+
+    // Where each sample is, and the box around them. A tile over the antimeridian or a pole gets a box spanning every
+    // longitude.
+    const f64 tile_extent = 2.0 / static_cast<f64>(1u << level);
+    const f64 sample_extent = tile_extent / static_cast<f64>(n - 1);
+    std::vector<glm::dvec2> lon_lats(size_t(n) * n);
+    glm::dvec2 min_lon_lat(INFINITY);
+    glm::dvec2 max_lon_lat(-INFINITY);
+    for (u32 j = 0; j < n; ++j) {
+        for (u32 i = 0; i < n; ++i) {
+            const f64 u = -1.0 + tile_extent * static_cast<f64>(tile_x) + sample_extent * static_cast<f64>(i);
+            const f64 v = -1.0 + tile_extent * static_cast<f64>(tile_y) + sample_extent * static_cast<f64>(j);
+            const glm::dvec2 lon_lat = sphere_to_lon_lat(face_point(face, u, v));
+            lon_lats[size_t(j) * n + i] = lon_lat;
+            min_lon_lat = glm::min(min_lon_lat, lon_lat);
+            max_lon_lat = glm::max(max_lon_lat, lon_lat);
+        }
+    }
+
+    const auto& gt = geo_transform;
+    const auto to_pixel = [&](const glm::dvec2& lon_lat) {
+        return glm::dvec2((lon_lat.x - gt[0]) / gt[1], (lon_lat.y - gt[3]) / gt[5]);
+    };
+
+    // Raster window around the box, with a pixel of margin for interpolation
+    const glm::dvec2 corner_a = to_pixel(min_lon_lat);
+    const glm::dvec2 corner_b = to_pixel(max_lon_lat);
+    const glm::dvec2 pixel_min = glm::min(corner_a, corner_b);
+    const glm::dvec2 pixel_max = glm::max(corner_a, corner_b);
+    const i32 window_x0 = std::clamp(static_cast<i32>(std::floor(pixel_min.x)) - 1, 0, raster_width);
+    const i32 window_y0 = std::clamp(static_cast<i32>(std::floor(pixel_min.y)) - 1, 0, raster_height);
+    const i32 window_x1 = std::clamp(static_cast<i32>(std::ceil(pixel_max.x)) + 2, 0, raster_width);
+    const i32 window_y1 = std::clamp(static_cast<i32>(std::ceil(pixel_max.y)) + 2, 0, raster_height);
+    const i32 window_width = window_x1 - window_x0;
+    const i32 window_height = window_y1 - window_y0;
+
+    std::vector<u8> result(tile_bytes, 0);
+    std::vector<f32> heights;
+    std::vector<u8> colours;
+    CPLErr error = CE_Failure;
+
+    // Read at about the spacing of the tile's samples, which is half as much at the edges of a face as at its centre.
+    // When the buffer is smaller than the window, GDAL reads from the closest overview instead of the full raster.
+    const f64 sample_degrees = glm::degrees(0.5 * sample_extent);
+    const i32 max_buffer_size = 8 * static_cast<i32>(n);
+    const auto buffer_size = [&](const i32 window_size, const f64 pixel_size) {
+        const auto wanted = static_cast<i32>(std::ceil(static_cast<f64>(window_size) * pixel_size / sample_degrees));
+        return std::min(window_size, std::clamp(wanted, 2, max_buffer_size));
+    };
+    const i32 buffer_width = window_width > 0 ? buffer_size(window_width, std::abs(gt[1])) : 0;
+    const i32 buffer_height = window_height > 0 ? buffer_size(window_height, std::abs(gt[5])) : 0;
+
+    if (buffer_width > 0 && buffer_height > 0) {
+        GDALRasterIOExtraArg extra_arg;
+        INIT_RASTERIO_EXTRA_ARG(extra_arg);
+        extra_arg.eResampleAlg = GRIORA_Bilinear;
+
+        if (kind == TerrainKind::height) {
+            heights.resize(static_cast<size_t>(buffer_width) * static_cast<size_t>(buffer_height));
+            error = dataset->GetRasterBand(1)->RasterIO(GF_Read, window_x0, window_y0, window_width, window_height,
+                                                        heights.data(), buffer_width, buffer_height, GDT_Float32, 0,
+                                                        0, &extra_arg);
+        } else {
+            colours.resize(static_cast<size_t>(buffer_width) * static_cast<size_t>(buffer_height) * 3);
+            i32 bands[] = {1, 2, 3};
+            error = dataset->RasterIO(GF_Read, window_x0, window_y0, window_width, window_height, colours.data(),
+                                      buffer_width, buffer_height, GDT_Byte, 3, bands, 3, 3 * buffer_width, 1,
+                                      &extra_arg);
+        }
+    }
+
+    {
+        std::lock_guard lock(dataset_mutex);
+        datasets.push_back(dataset);
+    }
+
+    if (buffer_width > 0 && buffer_height > 0 && error != CE_None) {
+        LOG_F(WARNING, "Failed to read terrain tile {}/{}/{}/{}", face, level, tile_x, tile_y);
+    }
+    if (error != CE_None) {
+        return result;
+    }
+
+    if (has_no_data) {
+        const auto no_data_f32 = static_cast<f32>(no_data);
+        for (f32& height : heights) {
+            if (std::isnan(height) || std::abs(height - no_data_f32) <= 1e-6f * std::max(1.0f, std::abs(no_data_f32))) {
+                height = 0.0f;
+            }
+        }
+    }
+
+    const f64 scale_x = static_cast<f64>(buffer_width) / static_cast<f64>(window_width);
+    const f64 scale_y = static_cast<f64>(buffer_height) / static_cast<f64>(window_height);
+    std::vector<f32> samples(kind == TerrainKind::height ? size_t(n) * n : 0);
+
+    for (size_t s = 0; s < lon_lats.size(); ++s) {
+        const glm::dvec2 pixel = to_pixel(lon_lats[s]);
+        if (pixel.x < 0.0 || pixel.y < 0.0 || pixel.x >= raster_width || pixel.y >= raster_height) {
+            continue;
+        }
+
+        // Bilinear interpolation between buffer pixel centres
+        const f64 bx = std::clamp((pixel.x - window_x0) * scale_x - 0.5, 0.0, static_cast<f64>(buffer_width - 1));
+        const f64 by = std::clamp((pixel.y - window_y0) * scale_y - 0.5, 0.0, static_cast<f64>(buffer_height - 1));
+        const auto x0 = static_cast<i32>(bx);
+        const auto y0 = static_cast<i32>(by);
+        const i32 x1 = std::min(x0 + 1, buffer_width - 1);
+        const i32 y1 = std::min(y0 + 1, buffer_height - 1);
+        const auto fx = static_cast<f32>(bx - x0);
+        const auto fy = static_cast<f32>(by - y0);
+        const auto index = [&](const i32 x, const i32 y) {
+            return static_cast<size_t>(y) * static_cast<size_t>(buffer_width) + static_cast<size_t>(x);
+        };
+        const auto lerp = [&](const f32 a, const f32 b, const f32 c, const f32 d) {
+            return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fy;
+        };
+
+        if (kind == TerrainKind::height) {
+            samples[s] = lerp(heights[index(x0, y0)], heights[index(x1, y0)], heights[index(x0, y1)],
+                              heights[index(x1, y1)]);
+        } else {
+            for (size_t c = 0; c < 3; ++c) {
+                const f32 value = lerp(colours[index(x0, y0) * 3 + c], colours[index(x1, y0) * 3 + c],
+                                       colours[index(x0, y1) * 3 + c], colours[index(x1, y1) * 3 + c]);
+                result[s * 4 + c] = static_cast<u8>(std::clamp(std::lround(value), 0l, 255l));
+            }
+            result[s * 4 + 3] = 255;
+        }
+    }
+
+    if (kind == TerrainKind::height) {
+        std::memcpy(result.data(), samples.data(), result.size());
+    }
+    return result;
+}
+
+void Terrain::receive_tiles() {
+    std::vector<std::pair<u64, std::vector<u8>>> received;
+    {
+        std::lock_guard lock(done_mutex);
+        received.swap(done);
+    }
+
+    for (auto& [key, data] : received) {
+        TerrainTile& tile = tiles.at(key);
+        tile.loading = false;
+        --in_flight;
+        cpu_bytes += data.size();
+        tile.data = std::move(data);
+    }
+}
+
+bool Terrain::upload_tile(TerrainTile& tile) {
+    if (free_layers.empty()) {
+        // Evict the least recently used tile that isn't wanted this frame
+        TerrainTile* victim = nullptr;
+        for (auto& entry : tiles) {
+            TerrainTile& other = entry.second;
+            if (other.layer >= 0 && other.level > 0 && other.last_used < frame &&
+                (victim == nullptr || other.last_used < victim->last_used)) {
+                victim = &other;
+            }
+        }
+        if (victim == nullptr) {
+            return false;
+        }
+
+        hide_tile(*victim);
+        free_layers.push_back(victim->layer);
+        victim->layer = -1;
+        if (victim->data.empty()) {
+            tiles.erase(tile_key(*victim));
+        }
+    }
+
+    tile.layer = free_layers.back();
+    free_layers.pop_back();
+
+    // Uploads go through the texture's name, so they don't disturb the renderer's cached bindings.
+    const auto tile_size = static_cast<GLsizei>(config.tile_size);
+    if (kind == TerrainKind::height) {
+        glTextureSubImage3D(tile_texture, 0, 0, 0, tile.layer, tile_size, tile_size, 1, GL_RED, GL_FLOAT,
+                            tile.data.data());
+    } else {
+        glTextureSubImage3D(tile_texture, 0, 0, 0, tile.layer, tile_size, tile_size, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                            tile.data.data());
+    }
+
+    show_tile(tile);
+    return true;
+}
+
+void Terrain::evict_cpu() {
+    if (cpu_bytes <= config.cpu_budget_bytes) {
+        return;
+    }
+
+    std::vector<TerrainTile*> candidates;
+    for (auto& entry : tiles) {
+        TerrainTile& tile = entry.second;
+        if (!tile.data.empty() && tile.level > 0 && tile.last_used < frame) {
+            candidates.push_back(&tile);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const TerrainTile* a, const TerrainTile* b) { return a->last_used < b->last_used; });
+
+    for (TerrainTile* const tile : candidates) {
+        if (cpu_bytes <= config.cpu_budget_bytes) {
+            break;
+        }
+
+        cpu_bytes -= tile->data.size();
+        std::vector<u8>().swap(tile->data);
+        if (tile->layer < 0) {
+            tiles.erase(tile_key(*tile));
+        }
+    }
+}
+
+void Terrain::show_tile(const TerrainTile& tile) {
+    const u32 shift = max_level - tile.level;
+    const u32 x0 = tile.x << shift;
+    const u32 y0 = tile.y << shift;
+    const u32 side = 1u << shift;
+
+    for (u32 y = y0; y < y0 + side; ++y) {
+        for (u32 x = x0; x < x0 + side; ++x) {
+            u16* const entry = &indirection[((size_t(tile.face) * indirection_size + y) * indirection_size + x) * 2];
+            if (entry[0] == no_layer || entry[1] < tile.level) {
+                entry[0] = static_cast<u16>(tile.layer);
+                entry[1] = static_cast<u16>(tile.level);
+            }
+        }
+    }
+
+    auto& dirty = indirection_dirty[tile.face];
+    dirty = {std::min(dirty[0], x0), std::min(dirty[1], y0), std::max(dirty[2], x0 + side - 1),
+             std::max(dirty[3], y0 + side - 1)};
+}
+
+void Terrain::hide_tile(const TerrainTile& tile) {
+    u16 layer = no_layer;
+    u16 level = 0;
+    for (u32 ancestor_level = tile.level; ancestor_level-- > 0;) {
+        const u32 shift = tile.level - ancestor_level;
+        const auto it = tiles.find(tile_key(tile.face, ancestor_level, tile.x >> shift, tile.y >> shift));
+        if (it != tiles.end() && it->second.layer >= 0) {
+            layer = static_cast<u16>(it->second.layer);
+            level = static_cast<u16>(ancestor_level);
+            break;
+        }
+    }
+
+    const u32 shift = max_level - tile.level;
+    const u32 x0 = tile.x << shift;
+    const u32 y0 = tile.y << shift;
+    const u32 side = 1u << shift;
+
+    // Texels showing finer tiles keep them
+    for (u32 y = y0; y < y0 + side; ++y) {
+        for (u32 x = x0; x < x0 + side; ++x) {
+            u16* const entry = &indirection[((size_t(tile.face) * indirection_size + y) * indirection_size + x) * 2];
+            if (entry[0] == static_cast<u16>(tile.layer)) {
+                entry[0] = layer;
+                entry[1] = level;
+            }
+        }
+    }
+
+    auto& dirty = indirection_dirty[tile.face];
+    dirty = {std::min(dirty[0], x0), std::min(dirty[1], y0), std::max(dirty[2], x0 + side - 1),
+             std::max(dirty[3], y0 + side - 1)};
+}
+
+void Terrain::upload_indirection() {
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<i32>(indirection_size));
+
+    for (u32 face = 0; face < 6; ++face) {
+        auto& dirty = indirection_dirty[face];
+        if (dirty[0] > dirty[2]) {
+            continue;
+        }
+
+        const size_t offset = (size_t(face) * indirection_size + dirty[1]) * indirection_size + dirty[0];
+        glTextureSubImage3D(indirection_texture, 0, static_cast<i32>(dirty[0]), static_cast<i32>(dirty[1]),
+                            static_cast<i32>(face), static_cast<GLsizei>(dirty[2] - dirty[0] + 1),
+                            static_cast<GLsizei>(dirty[3] - dirty[1] + 1), 1, GL_RG_INTEGER, GL_UNSIGNED_SHORT,
+                            &indirection[offset * 2]);
+        dirty = {indirection_size, indirection_size, 0, 0};
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
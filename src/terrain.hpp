@@ -0,0 +1,132 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
+#include <gdal_priv.h>
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct GLState;
+struct ShaderProgram;
+
+struct TerrainConfig {
+    // Samples along each side of a tile. Neighbouring tiles share their edge samples, so there are no seams.
+    u32 tile_size = 256;
+    // Decoded tiles kept in memory, and tiles kept in the texture array.
+    size_t cpu_budget_bytes = size_t(512) << 20;
+    size_t gpu_budget_bytes = size_t(256) << 20;
+    // Tiles decoding on the thread pool at once, and uploaded per frame.
+    u32 max_in_flight = 16;
+    u32 max_uploads_per_frame = 8;
+    // Tiles are split until a sample covers no more than this many pixels on screen.
+    f32 sample_pixels = 1.5f;
+    // Vertical exaggeration of a height raster for relief shading.
+    f32 height_exaggeration = 20.0f;
+};
+
+enum class TerrainKind : u8 {
+    // One band of heights in metres, used for relief shading
+    height,
+    // Three bands of sRGB colour
+    colour,
+};
+
+// A tile on a cube-sphere quadtree. Each face of the cube is split into `2^level` tiles along each side.
+struct TerrainTile {
+    u32 face;
+    u32 level;
+    u32 x;
+    u32 y;
+
+    // Decoded samples, or empty if the tile isn't in the CPU cache.
+    std::vector<u8> data;
+    // Texture array layer, or -1 if the tile isn't on the GPU.
+    i32 layer = -1;
+    bool loading = false;
+    // Frame the tile was last wanted by the camera, for LRU eviction.
+    u64 last_used = 0;
+};
+
+// Streams tiles of a large raster onto the globe. Tiles are chosen each frame by their size on screen, read through
+// GDAL's overviews and decoded on the thread pool, then uploaded to a texture array. The planet shader finds the finest
+// loaded tile for each fragment through an indirection texture, with one texel per tile of the deepest level on each
+// face, so coarser tiles cover the globe until finer ones arrive. Decoded tiles and texture layers are kept in LRU
+// caches with separate byte budgets, and the level 0 tiles are never evicted.
+struct Terrain {
+    TerrainConfig config;
+    bool enabled = false;
+    TerrainKind kind;
+
+    Path path;
+    std::array<f64, 6> geo_transform;
+    i32 raster_width;
+    i32 raster_height;
+    bool has_no_data = false;
+    f64 no_data;
+    u32 max_level;
+    size_t tile_bytes;
+
+    // Datasets not in use by a worker. A GDAL dataset can't be used from more than one thread at once, so each decode
+    // takes one, and opens another if none are free.
+    std::mutex dataset_mutex;
+    std::vector<GDALDataset*> datasets;
+
+    std::unordered_map<u64, TerrainTile> tiles;
+    u64 frame = 0;
+    u32 in_flight = 0;
+    // Decoded tiles left over after the last frame's uploads
+    u32 waiting_uploads = 0;
+    size_t cpu_bytes = 0;
+
+    // Tiles finished by workers, waiting to be picked up on the main thread.
+    std::mutex done_mutex;
+    std::vector<std::pair<u64, std::vector<u8>>> done;
+    u64 decoded_count = 0;
+    f64 decode_s = 0.0;
+
+    u32 tile_texture = 0;
+    u32 layer_count = 0;
+    std::vector<i32> free_layers;
+
+    // Layer and level of the finest loaded tile over each texel, for every face. Texels with no tile have the layer
+    // `no_layer`.
+    u32 indirection_texture = 0;
+    u32 indirection_size;
+    std::vector<u16> indirection;
+    // Texel rectangle of each face to upload, as (min x, min y, max x, max y), empty if min > max.
+    std::array<std::array<u32, 4>, 6> indirection_dirty;
+
+    // Returns false, and leaves terrain disabled, if the raster can't be used.
+    bool init(const Path& path, const TerrainConfig& config);
+    void destroy();
+
+    // Loads and uploads tiles for the current view.
+    void update(ThreadPool& pool, const glm::vec3& camera_pos, f32 focal_pixels);
+
+    // True while tiles for the current view are still decoding or waiting to be uploaded, so the view will change
+    // without any input.
+    bool is_loading() const;
+
+    // Sets the planet shader's terrain uniforms and binds the textures.
+    void bind(ShaderProgram& program, GLState& state);
+
+private:
+    void select_tiles(const glm::vec3& camera_pos, f32 focal_pixels, std::vector<u64>& requests);
+    void request_tile(ThreadPool& pool, u64 key);
+    std::vector<u8> decode_tile(u64 key);
+    void receive_tiles();
+    bool upload_tile(TerrainTile& tile);
+    void evict_cpu();
+
+    // Points the indirection texels under a tile at it, where no finer tile is loaded, or back at its closest loaded
+    // ancestor when it's evicted.
+    void show_tile(const TerrainTile& tile);
+    void hide_tile(const TerrainTile& tile);
+    void upload_indirection();
+};
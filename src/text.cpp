@@ -0,0 +1,422 @@
+#include "text.hpp"
+
+#include "app.hpp"
+#include "geometry.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+namespace {
+
+// Labels float just above the surface, so that they aren't cut by the planet mesh between its vertices.
+constexpr f64 label_radius = 1.0005;
+
+// Limits on the height of province and country labels on screen, in pixels per em.
+constexpr f32 province_min_pixels = 11.0f;
+constexpr f32 province_max_pixels = 40.0f;
+constexpr f32 country_min_pixels = 14.0f;
+constexpr f32 country_max_pixels = 120.0f;
+
+// Added to the priority of country labels, which is otherwise their em height, so that they are placed before any
+// province label.
+constexpr f32 country_priority = 1.0f;
+
+// Points further than this from the region's centre, as the cosine of the angle, are left out of the fit. The
+// tangent plane projection degenerates as they approach 90 degrees.
+constexpr f64 min_fit_cos = 0.3;
+
+// Solves a 3x3 linear system by Cramer's rule. Returns false if it is singular.
+bool solve3(const f64 m[3][3], const f64 v[3], f64 result[3]) {
+    const auto det = [](const f64 a[3][3]) {
+        return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+               a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    };
+
+    const f64 d = det(m);
+    if (std::abs(d) < 1e-18) {
+        return false;
+    }
+
+    for (u32 column = 0; column < 3; ++column) {
+        f64 replaced[3][3];
+        for (u32 row = 0; row < 3; ++row) {
+            for (u32 i = 0; i < 3; ++i) {
+                replaced[row][i] = i == column ? v[row] : m[row][i];
+            }
+        }
+        result[column] = det(replaced) / d;
+    }
+    return true;
+}
+
+void append_exterior_points(const ProvinceGeometry& geometry, const ProvinceId province,
+                            std::vector<glm::dvec3>& points) {
+    for (u32 poly = geometry.province_offsets[province]; poly < geometry.province_offsets[province + 1]; ++poly) {
+        const u32 ring = geometry.polygon_offsets[poly];
+        for (u32 i = geometry.ring_offsets[ring]; i < geometry.ring_offsets[ring + 1]; ++i) {
+            points.push_back(lon_lat_to_sphere(geometry.points[i].x, geometry.points[i].y));
+        }
+    }
+}
+} // namespace
+
+glm::dvec3 Baseline::get_point(const f64 s) const {
+    const f64 y = (a * s + b) * s + c;
+    return glm::normalize(center + s * axis_x + y * axis_y);
+}
+
+bool fit_baseline(const std::vector<glm::dvec3>& points, Baseline& baseline) {
+    glm::dvec3 sum = {0.0, 0.0, 0.0};
+    for (const glm::dvec3& point : points) {
+        sum += point;
+    }
+    if (glm::length(sum) < 1e-9) {
+        return false;
+    }
+    const glm::dvec3 center = glm::normalize(sum);
+
+    // East and north at the centre, falling back to an arbitrary frame at the poles.
+    glm::dvec3 east = glm::cross(glm::dvec3(0.0, 1.0, 0.0), center);
+    if (glm::length(east) < 1e-6) {
+        east = glm::cross(glm::dvec3(1.0, 0.0, 0.0), center);
+    }
+    east = glm::normalize(east);
+    const glm::dvec3 north = glm::cross(center, east);
+
+    // Gnomonic projection onto the tangent plane.
+    std::vector<glm::dvec2> projected;
+    projected.reserve(points.size());
+    for (const glm::dvec3& point : points) {
+        const f64 cos_angle = glm::dot(point, center);
+        if (cos_angle >= min_fit_cos) {
+            const glm::dvec3 q = point / cos_angle - center;
+            projected.push_back({glm::dot(q, east), glm::dot(q, north)});
+        }
+    }
+    if (projected.size() < 3) {
+        return false;
+    }
+
+    // Principal axis, pointed east so that the text reads left to right.
+    glm::dvec2 mean = {0.0, 0.0};
+    for (const glm::dvec2& p : projected) {
+        mean += p;
+    }
+    mean /= static_cast<f64>(projected.size());
+
+    f64 sxx = 0.0;
+    f64 sxy = 0.0;
+    f64 syy = 0.0;
+    for (const glm::dvec2& p : projected) {
+        const glm::dvec2 d = p - mean;
+        sxx += d.x * d.x;
+        sxy += d.x * d.y;
+        syy += d.y * d.y;
+    }
+    const f64 angle = 0.5 * std::atan2(2.0 * sxy, sxx - syy);
+    glm::dvec2 u = {std::cos(angle), std::sin(angle)};
+    if (u.x < 0.0) {
+        u = -u;
+    }
+
+    baseline.center = center;
+    baseline.axis_x = u.x * east + u.y * north;
+    baseline.axis_y = -u.y * east + u.x * north;
+
+    // Least squares parabola through the outline, in the rotated frame. For a symmetric outline this is its middle
+    // line, and it bends with regions that curve.
+    f64 s_sums[5] = {};
+    f64 t_sums[3] = {};
+    baseline.s_min = INFINITY;
+    baseline.s_max = -INFINITY;
+    for (const glm::dvec2& p : projected) {
+        const f64 s = p.x * u.x + p.y * u.y;
+        const f64 t = -p.x * u.y + p.y * u.x;
+        baseline.s_min = std::min(baseline.s_min, s);
+        baseline.s_max = std::max(baseline.s_max, s);
+
+        f64 power = 1.0;
+        for (u32 k = 0; k < 5; ++k) {
+            s_sums[k] += power;
+            if (k < 3) {
+                t_sums[k] += t * power;
+            }
+            power *= s;
+        }
+    }
+
+    const f64 normal[3][3] = {
+            {s_sums[4], s_sums[3], s_sums[2]},
+            {s_sums[3], s_sums[2], s_sums[1]},
+            {s_sums[2], s_sums[1], s_sums[0]},
+    };
+    const f64 rhs[3] = {t_sums[2], t_sums[1], t_sums[0]};
+    f64 coefficients[3];
+    if (!solve3(normal, rhs, coefficients)) {
+        return false;
+    }
+    baseline.a = coefficients[0];
+    baseline.b = coefficients[1];
+    baseline.c = coefficients[2];
+
+    // Keep the bend gentle enough to read: the sagitta is at most 30% of the half length.
+    const f64 half_length = 0.5 * (baseline.s_max - baseline.s_min);
+    if (half_length <= 0.0) {
+        return false;
+    }
+    const f64 max_a = 0.3 / half_length;
+    baseline.a = std::clamp(baseline.a, -max_a, max_a);
+
+    f64 residual_sq = 0.0;
+    for (const glm::dvec2& p : projected) {
+        const f64 s = p.x * u.x + p.y * u.y;
+        const f64 t = -p.x * u.y + p.y * u.x;
+        const f64 r = t - ((baseline.a * s + baseline.b) * s + baseline.c);
+        residual_sq += r * r;
+    }
+    baseline.half_thickness = std::sqrt(residual_sq / static_cast<f64>(projected.size()));
+
+    return true;
+}
+
+void TextRenderer::init(Renderer& renderer) {
+    enabled = atlas.init(app->get_resource_path("fonts/label.ttf"), app->get_cache_path("label.font"),
+                         app->thread_pool);
+    if (!enabled) {
+        LOG_F(WARNING, "Labels are disabled");
+        return;
+    }
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, static_cast<GLsizei>(atlas.width), static_cast<GLsizei>(atlas.height), 0,
+                 GL_RED, GL_UNSIGNED_BYTE, atlas.pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    const ShaderHandle text_vert = renderer.add_shader("text.vert", GL_VERTEX_SHADER);
+    const ShaderHandle text_frag = renderer.add_shader("text.frag", GL_FRAGMENT_SHADER);
+    program = renderer.add_shader_program(text_vert, text_frag);
+    ShaderProgram& shader_program = renderer.shader_programs.get(program);
+    shader_program.bind_uniform_block(renderer.view_projection_ubo);
+    shader_program.set_uniform_i32(Keyword::atlas, 0);
+
+    instance_vbo = renderer.add_vbo(GL_STREAM_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    renderer.vbos.get(instance_vbo).bind();
+
+    const struct {
+        i32 size;
+        size_t offset;
+    } attributes[] = {
+            {3, offsetof(GlyphInstance, center)},
+            {3, offsetof(GlyphInstance, right)},
+            {3, offsetof(GlyphInstance, up)},
+            {4, offsetof(GlyphInstance, uv)},
+            {1, offsetof(GlyphInstance, opacity)},
+    };
+    for (u32 i = 0; i < std::size(attributes); ++i) {
+        glVertexAttribPointer(i, attributes[i].size, GL_FLOAT, false, sizeof(GlyphInstance),
+                              reinterpret_cast<void*>(attributes[i].offset));
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+    glBindVertexArray(0);
+
+    add_region_labels();
+    placer.init(labels);
+    DEXPR(labels.size());
+    DEXPR(label_glyphs.size());
+}
+
+void TextRenderer::add_region_labels() {
+    const ProvinceTable& provinces = app->provinces;
+    const ProvinceGeometry& geometry = app->province_geometry;
+
+    std::vector<glm::dvec3> points;
+    Baseline baseline;
+
+    const i64 name_column = provinces.find_column(Keyword::name);
+    if (name_column != -1 && provinces.columns[static_cast<size_t>(name_column)].type == ColumnType::string) {
+        for (ProvinceId province = 0; province < provinces.count; ++province) {
+            const char* const name = provinces.get_string(static_cast<u32>(name_column), province);
+            points.clear();
+            append_exterior_points(geometry, province, points);
+            if (name[0] != '\0' && fit_baseline(points, baseline)) {
+                // Larger provinces get larger text, and are labelled first.
+                add_label(name, baseline, province_min_pixels, province_max_pixels, 0.0f);
+            }
+        }
+    }
+
+    // Countries are the provinces that share an `admin` name.
+    const i64 country_column = provinces.find_column(Keyword::admin);
+    if (country_column != -1 && provinces.columns[static_cast<size_t>(country_column)].type == ColumnType::string) {
+        const auto& country_ids = provinces.columns[static_cast<size_t>(country_column)].get<u32>();
+
+        std::vector<std::vector<ProvinceId>> countries(provinces.strings.size());
+        for (ProvinceId province = 0; province < provinces.count; ++province) {
+            countries[country_ids[province]].push_back(province);
+        }
+
+        for (u32 country = 1; country < countries.size(); ++country) {
+            if (countries[country].empty()) {
+                continue;
+            }
+            points.clear();
+            for (const ProvinceId province : countries[country]) {
+                append_exterior_points(geometry, province, points);
+            }
+            if (fit_baseline(points, baseline)) {
+                add_label(provinces.strings.get(country), baseline, country_min_pixels, country_max_pixels,
+                          country_priority);
+            }
+        }
+    }
+}
+
+bool TextRenderer::add_label(const char* const text, const Baseline& baseline, const f32 min_pixels,
+                             const f32 max_pixels, const f32 priority) {
+    const f64 width_ems = atlas.measure(text);
+    if (width_ems <= 0.0) {
+        return false;
+    }
+
+    // Sample the baseline, to place glyphs by arc length.
+    constexpr u32 sample_count = 64;
+    std::array<glm::dvec3, sample_count> samples;
+    std::array<f64, sample_count> arc_lengths;
+    for (u32 i = 0; i < sample_count; ++i) {
+        const f64 s = baseline.s_min + (baseline.s_max - baseline.s_min) * i / (sample_count - 1);
+        samples[i] = baseline.get_point(s);
+        arc_lengths[i] = i == 0 ? 0.0 : arc_lengths[i - 1] + great_circle_distance(samples[i - 1], samples[i]);
+    }
+    const f64 total_length = arc_lengths.back();
+
+    // As large as fits along the region, and across it.
+    const f64 em_height = std::min(0.8 * total_length / width_ems, 1.2 * baseline.half_thickness);
+    if (em_height <= 0.0) {
+        return false;
+    }
+    const f64 start = 0.5 * (total_length - width_ems * em_height);
+
+    const auto sample = [&](const f64 distance, glm::dvec3& point, glm::dvec3& tangent) {
+        const auto it = std::upper_bound(arc_lengths.begin(), arc_lengths.end(), distance);
+        const u32 i = static_cast<u32>(std::clamp<std::ptrdiff_t>(it - arc_lengths.begin() - 1, 0, sample_count - 2));
+        const f64 segment = arc_lengths[i + 1] - arc_lengths[i];
+        const f64 f = segment > 0.0 ? (distance - arc_lengths[i]) / segment : 0.0;
+        point = glm::normalize(glm::mix(samples[i], samples[i + 1], f));
+
+        tangent = samples[i + 1] - samples[i];
+        tangent = glm::normalize(tangent - glm::dot(tangent, point) * point);
+    };
+
+    Label label;
+    label.text = text;
+    label.em_height = static_cast<f32>(em_height);
+    label.min_pixels = min_pixels;
+    label.max_pixels = max_pixels;
+    label.priority = priority + label.em_height;
+    label.first_glyph = static_cast<u32>(label_glyphs.size());
+
+    glm::dvec3 point;
+    glm::dvec3 tangent;
+    sample(0.5 * total_length, point, tangent);
+    label.position = glm::vec3(point * label_radius);
+
+    // Centre the text vertically on the baseline curve.
+    const f64 vertical_centre = 0.5 * static_cast<f64>(atlas.ascender + atlas.descender);
+    const f32 texel_width = 1.0f / static_cast<f32>(atlas.width);
+    const f32 texel_height = 1.0f / static_cast<f32>(atlas.height);
+
+    f64 pen = 0.0;
+    for (const char* str = text; *str != '\0';) {
+        const Glyph& glyph = atlas.get_glyph(decode_utf8(str));
+        const f64 left = glyph.left;
+        const f64 right = glyph.right;
+        const f64 bottom = glyph.bottom;
+        const f64 top = glyph.top;
+
+        if (glyph.atlas_width > 0) {
+            sample(start + (pen + 0.5 * (left + right)) * em_height, point, tangent);
+            const glm::dvec3 up = glm::cross(point, tangent);
+            const glm::dvec3 centre = point + up * ((0.5 * (bottom + top) - vertical_centre) * em_height);
+
+            GlyphInstance instance;
+            instance.center = glm::vec3(glm::normalize(centre) * label_radius);
+            instance.right = glm::vec3(tangent * (0.5 * (right - left) * em_height));
+            instance.up = glm::vec3(up * (0.5 * (top - bottom) * em_height));
+            instance.opacity = 1.0f;
+            instance.uv = {static_cast<f32>(glyph.atlas_x) * texel_width,
+                           static_cast<f32>(glyph.atlas_y) * texel_height,
+                           static_cast<f32>(glyph.atlas_x + glyph.atlas_width) * texel_width,
+                           static_cast<f32>(glyph.atlas_y + glyph.atlas_height) * texel_height};
+            label_glyphs.push_back(instance);
+        }
+        pen += static_cast<f64>(glyph.advance);
+    }
+
+    label.glyph_count = static_cast<u32>(label_glyphs.size()) - label.first_glyph;
+    if (label.glyph_count == 0) {
+        return false;
+    }
+    label.start = label_glyphs[label.first_glyph].center;
+    label.end = label_glyphs.back().center;
+    labels.push_back(std::move(label));
+    return true;
+}
+
+void TextRenderer::render(const LabelView& view, RenderQueue& queue) {
+    if (!enabled) {
+        return;
+    }
+
+    placer.update(labels, view);
+
+    frame_glyphs.clear();
+    for (const u32 i : placer.priority_order) {
+        const f32 opacity = placer.opacity[i];
+        if (opacity <= 0.0f) {
+            continue;
+        }
+
+        const Label& label = labels[i];
+        const auto first = label_glyphs.begin() + static_cast<std::ptrdiff_t>(label.first_glyph);
+        const auto last = first + static_cast<std::ptrdiff_t>(label.glyph_count);
+        for (auto it = first; it != last; ++it) {
+            frame_glyphs.push_back(*it);
+            frame_glyphs.back().opacity = opacity;
+        }
+    }
+
+    if (frame_glyphs.empty()) {
+        return;
+    }
+
+    app->renderer.vbos.get(instance_vbo)
+            .buffer_data(frame_glyphs.data(), static_cast<GLsizeiptr>(frame_glyphs.size() * sizeof(GlyphInstance)));
+
+    // Labels are tested against the planet's depth, but don't write it, so overlapping quads blend.
+    DrawItem item;
+    item.program = app->renderer.shader_programs.get(program).id;
+    item.vao = vao;
+    item.primitive = GL_TRIANGLE_STRIP;
+    item.indexed = false;
+    item.count = 4;
+    item.instances = static_cast<i32>(frame_glyphs.size());
+    item.texture = texture;
+    item.depth_mask = false;
+    queue.push(RenderPass::labels, item);
+}
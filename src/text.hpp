@@ -0,0 +1,75 @@
+#pragma once
+
+#include "font.hpp"
+#include "labels.hpp"
+#include "slot_map.hpp"
+#include "utility.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <vector>
+
+struct RenderQueue;
+struct Renderer;
+struct ShaderProgram;
+struct VertexBufferObject;
+
+// One glyph quad, drawn as an instance. The corners are `center ± right ± up`.
+struct GlyphInstance {
+    glm::vec3 center;
+    glm::vec3 right;
+    glm::vec3 up;
+    // Atlas rectangle, as the texture coordinates of the bottom left and top right corners.
+    glm::vec4 uv;
+    f32 opacity;
+};
+
+// A curve through the middle of a region, along its longest extent, on which to lay out its label. Points are
+// projected onto the plane tangent to the sphere at `center`, and the baseline is a parabola in that plane.
+struct Baseline {
+    glm::dvec3 center;
+    glm::dvec3 axis_x;
+    glm::dvec3 axis_y;
+    f64 s_min;
+    f64 s_max;
+    // y = (a * s + b) * s + c
+    f64 a;
+    f64 b;
+    f64 c;
+    // Typical distance of the region's outline from the baseline.
+    f64 half_thickness;
+
+    glm::dvec3 get_point(f64 s) const;
+};
+
+// Returns false if `points`, which are on the unit sphere, don't give a usable baseline.
+bool fit_baseline(const std::vector<glm::dvec3>& points, Baseline& baseline);
+
+// Draws every visible label with a single instanced draw of SDF glyph quads.
+struct TextRenderer {
+    FontAtlas atlas;
+    bool enabled = false;
+
+    u32 texture = 0;
+    u32 vao = 0;
+    Handle<VertexBufferObject> instance_vbo;
+    Handle<ShaderProgram> program;
+
+    std::vector<Label> labels;
+    std::vector<GlyphInstance> label_glyphs;
+    LabelPlacer placer;
+    // Glyphs of the labels visible this frame, uploaded to `instance_vbo`.
+    std::vector<GlyphInstance> frame_glyphs;
+
+    void init(Renderer& renderer);
+    // Places labels and queues their glyphs.
+    void render(const LabelView& view, RenderQueue& queue);
+
+    // Lays out `text` along `baseline`. Returns false if it doesn't fit.
+    bool add_label(const char* text, const Baseline& baseline, f32 min_pixels, f32 max_pixels, f32 priority);
+
+private:
+    void add_region_labels();
+};
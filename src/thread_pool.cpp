@@ -0,0 +1,118 @@
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <memory>
+
+namespace {
+
+struct ParallelForState {
+    std::atomic<size_t> next_chunk = 0;
+    std::atomic<size_t> finished_chunks = 0;
+    std::mutex mutex;
+    std::condition_variable done_cv;
+};
+} // namespace
+
+void ThreadPool::init() {
+    const u32 hardware_threads = std::thread::hardware_concurrency();
+    init(hardware_threads > 1 ? hardware_threads - 1 : 0);
+}
+
+void ThreadPool::init(const u32 thread_count) {
+    CHECK_F(threads.empty());
+    stopping = false;
+    for (u32 i = 0; i < thread_count; ++i) {
+        threads.emplace_back([this] { worker(); });
+    }
+}
+
+void ThreadPool::destroy() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    task_cv.notify_all();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+u32 ThreadPool::size() const {
+    return static_cast<u32>(threads.size()) + 1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (threads.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    task_cv.notify_one();
+}
+
+void ThreadPool::parallel_for(const size_t count, const size_t chunk_size,
+                              const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+
+    const size_t chunk = std::max<size_t>(chunk_size, 1);
+    const size_t chunk_count = (count + chunk - 1) / chunk;
+
+    // Helpers may only get to run after all chunks are done, so everything they touch besides `fn` is shared. `fn`
+    // itself is only called for a claimed chunk, and this function doesn't return before every claimed chunk finishes.
+    auto state = std::make_shared<ParallelForState>();
+
+    auto work = [state, &fn, count, chunk, chunk_count] {
+        while (true) {
+            const size_t i = state->next_chunk.fetch_add(1);
+            if (i >= chunk_count) {
+                break;
+            }
+
+            fn(i * chunk, std::min(count, (i + 1) * chunk));
+
+            if (state->finished_chunks.fetch_add(1) + 1 == chunk_count) {
+                std::lock_guard lock(state->mutex);
+                state->done_cv.notify_all();
+            }
+        }
+    };
+
+    const size_t helpers = std::min(threads.size(), chunk_count - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        submit(work);
+    }
+
+    work();
+
+    std::unique_lock lock(state->mutex);
+    state->done_cv.wait(lock, [&] { return state->finished_chunks.load() == chunk_count; });
+}
+
+void ThreadPool::parallel_for(const size_t count, const std::function<void(size_t, size_t)>& fn) {
+    const size_t chunk_count = size_t(size()) * 4;
+    parallel_for(count, (count + chunk_count - 1) / chunk_count, fn);
+}
+
+void ThreadPool::worker() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex);
+            task_cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "utility.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ThreadPool {
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable task_cv;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+
+    // Starts one worker per hardware thread, minus one for the calling thread.
+    void init();
+    void init(u32 thread_count);
+
+    // Finishes all queued tasks, then joins the workers.
+    void destroy();
+
+    // Number of threads that take part in `parallel_for`, including the caller.
+    u32 size() const;
+
+    void submit(std::function<void()> task);
+
+    // Runs `fn(begin, end)` over `[0, count)` in chunks of `chunk_size` and returns once every chunk has finished. The
+    // calling thread takes chunks too, so this can be called from inside a task.
+    void parallel_for(size_t count, size_t chunk_size, const std::function<void(size_t, size_t)>& fn);
+
+    // Splits `[0, count)` into about four chunks per thread.
+    void parallel_for(size_t count, const std::function<void(size_t, size_t)>& fn);
+
+private:
+    void worker();
+};
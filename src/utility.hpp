@@ -7,8 +7,12 @@
 #include <cmath>
 #include <cstdint>
 #include <functional>
+#include <new>
 #include <string.h>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #define CONCATENATE_2(s1, s2) s1##s2
 #define CONCATENATE(s1, s2) CONCATENATE_2(s1, s2)
@@ -90,6 +94,25 @@ inline void hash_combine(size_t& seed, const T& value) {
     seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
 }
 
+// 64-bit FNV-1a. Usable at compile time, so tables of known strings can be built by the compiler.
+inline constexpr u64 hash_string(const std::string_view str) {
+    u64 hash = 0xcbf29ce484222325;
+    for (const char c : str) {
+        hash = (hash ^ static_cast<u8>(c)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+// Spreads the bits of a hash, so that its low bits can index a table.
+inline constexpr u64 mix_hash(u64 x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccd;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53;
+    x ^= x >> 33;
+    return x;
+}
+
 template <class K, class V, class Hash, class Equal>
 inline bool has_key(const std::unordered_map<K, V, Hash, Equal>& c, const K& key) {
     return c.find(key) != c.end();
@@ -99,13 +122,10 @@ inline bool c_str_eq(const char* const lhs, const char* const rhs) {
     return strcmp(lhs, rhs) == 0;
 }
 
+// For strings that are looked up often, `Symbol`s avoid hashing them at all.
 struct CStrHash {
     size_t operator()(const char* const str) const {
-        size_t result = 0;
-        for (const char* c = str; *c != '\0'; ++c) {
-            hash_combine(result, *c);
-        }
-        return result;
+        return hash_string(str);
     }
 };
 
@@ -114,3 +134,43 @@ struct CStrEqual {
         return c_str_eq(lhs, rhs);
     }
 };
+
+inline constexpr size_t cache_line_size = 64;
+
+// Allocator for columnar data, so that each column starts on its own cache line and can be scanned with aligned vector
+// loads.
+template <class T, size_t Alignment = cache_line_size>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <class U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(const size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* const ptr, size_t) {
+        ::operator delete(ptr, std::align_val_t(Alignment));
+    }
+
+    template <class U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const {
+        return true;
+    }
+
+    template <class U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+        return false;
+    }
+};
+
+template <class T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
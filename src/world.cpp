@@ -0,0 +1,297 @@
+#include "world.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// An army as it would be stored in an array of structs, with fields the per-tick update doesn't touch
+struct BenchArmy {
+    ProvinceId location;
+    ProvinceId target;
+    CountryId owner;
+    Fixed strength;
+    Fixed morale;
+    Fixed supply;
+    Fixed experience;
+    u64 flags;
+};
+
+constexpr Fixed attrition = Fixed::from_ratio(1, 1000);
+constexpr Fixed morale_recovery = Fixed::from_ratio(1, 100);
+constexpr Fixed max_morale = Fixed::from_int(1);
+
+void update_army(Fixed& strength, Fixed& morale) {
+    strength -= strength * attrition;
+    morale = std::min(morale + morale_recovery, max_morale);
+}
+
+template <class F>
+f64 time_ns_per(const size_t count, F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const f64 elapsed_s = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+    return elapsed_s * 1e9 / static_cast<f64>(count);
+}
+} // namespace
+
+void ChangeBits::resize(const u32 rows) {
+    words.resize((size_t(rows) + 63) / 64);
+    chunks.resize((size_t(rows) + entity_chunk_rows - 1) / entity_chunk_rows);
+    // Bits of rows past the end, so that a row added later doesn't start out marked
+    if (rows % 64 != 0) {
+        words.back() &= (u64(1) << (rows % 64)) - 1;
+    }
+}
+
+void ChangeBits::clear() {
+    std::fill(words.begin(), words.end(), 0);
+    std::fill(chunks.begin(), chunks.end(), 0);
+}
+
+void ChangeBits::set_range(const u32 begin, const u32 end) {
+    if (begin >= end) {
+        return;
+    }
+
+    const u32 first_word = begin / 64;
+    const u32 last_word = (end - 1) / 64;
+    const u64 first_mask = ~u64(0) << (begin % 64);
+    const u64 last_mask = ~u64(0) >> (63 - (end - 1) % 64);
+    if (first_word == last_word) {
+        words[first_word] |= first_mask & last_mask;
+    } else {
+        words[first_word] |= first_mask;
+        std::fill(words.begin() + first_word + 1, words.begin() + last_word, ~u64(0));
+        words[last_word] |= last_mask;
+    }
+
+    std::fill(chunks.begin() + begin / entity_chunk_rows, chunks.begin() + (end - 1) / entity_chunk_rows + 1, 1);
+}
+
+bool ChangeBits::any() const {
+    return std::find(chunks.begin(), chunks.end(), 1) != chunks.end();
+}
+
+void World::init(Simulation& sim) {
+    provinces.init("world.provinces", {"owner", "population"});
+    countries.init("world.countries", {"treasury", "capital"});
+    armies.init("world.armies", {"location", "strength", "morale"});
+
+    provinces.register_state(sim, [this] { add_provinces(province_count); });
+    countries.register_state(sim);
+    armies.register_state(sim);
+}
+
+void World::add_provinces(const u32 count) {
+    province_count = count;
+    provinces.clear();
+    for (ProvinceId province = 0; province < count; ++province) {
+        provinces.add();
+    }
+}
+
+void bench_world(ThreadPool& pool) {
+    constexpr u32 army_count = 100'000;
+    constexpr u32 tick_count = 200;
+
+    std::vector<BenchArmy> aos(army_count);
+    EntityTable<Army, ProvinceId, Fixed, Fixed> soa;
+    soa.init("bench.armies", {"location", "strength", "morale"});
+
+    for (u32 i = 0; i < army_count; ++i) {
+        BenchArmy& army = aos[i];
+        army.location = i % 4096;
+        army.strength = Fixed::from_int(1000 + i % 9000);
+        army.morale = Fixed::from_ratio(i % 100, 100);
+
+        const u32 row = soa.get_row(soa.add());
+        soa.write<ArmyState::location>(row) = army.location;
+        soa.write<ArmyState::strength>(row) = army.strength;
+        soa.write<ArmyState::morale>(row) = army.morale;
+    }
+    soa.end_tick();
+
+    const auto update_aos = [&] {
+        for (u32 tick = 0; tick < tick_count; ++tick) {
+            for (BenchArmy& army : aos) {
+                update_army(army.strength, army.morale);
+            }
+        }
+    };
+
+    const auto update_rows = [&](const u32 begin, const u32 end) {
+        Fixed* const strength = soa.write_range<ArmyState::strength>(begin, end);
+        Fixed* const morale = soa.write_range<ArmyState::morale>(begin, end);
+        for (u32 row = begin; row < end; ++row) {
+            update_army(strength[row], morale[row]);
+        }
+    };
+
+    // Both layouts must agree after the same number of ticks.
+    const auto check = [&] {
+        for (u32 i = 0; i < army_count; ++i) {
+            CHECK_F(soa.get<ArmyState::strength>(i) == aos[i].strength &&
+                    soa.get<ArmyState::morale>(i) == aos[i].morale);
+        }
+    };
+
+    const f64 aos_ns = time_ns_per(size_t(army_count) * tick_count, update_aos);
+
+    const f64 soa_ns = time_ns_per(size_t(army_count) * tick_count, [&] {
+        for (u32 tick = 0; tick < tick_count; ++tick) {
+            update_rows(0, soa.size());
+            soa.end_tick();
+        }
+    });
+    check();
+
+    const f64 soa_parallel_ns = time_ns_per(size_t(army_count) * tick_count, [&] {
+        for (u32 tick = 0; tick < tick_count; ++tick) {
+            soa.parallel_for(pool, update_rows);
+            soa.end_tick();
+        }
+    });
+    update_aos();
+    check();
+
+    LOG_F(INFO,
+          "{} armies, {} bytes per AoS army: update {:.2f} ns/army (AoS), {:.2f} ns/army (SoA), {:.2f} ns/army (SoA, "
+          "{} threads)",
+          army_count, sizeof(BenchArmy), aos_ns, soa_ns, soa_parallel_ns, pool.size());
+
+    // Hashing after a tick that only touched a few armies only rehashes their chunks.
+    StateHasher full_hasher;
+    const f64 full_hash_ns = time_ns_per(1, [&] { soa.hash(full_hasher); });
+    for (u32 i = 0; i < 16; ++i) {
+        soa.write<ArmyState::morale>(i * 97) = Fixed();
+    }
+    soa.end_tick();
+    StateHasher partial_hasher;
+    const f64 partial_hash_ns = time_ns_per(1, [&] { soa.hash(partial_hasher); });
+    LOG_F(INFO, "State hash of the table: {:.0f} us after every row changed, {:.0f} us after 16 rows changed",
+          full_hash_ns / 1000.0, partial_hash_ns / 1000.0);
+}
+
+void bench_scheduler(ThreadPool& pool) {
+    constexpr u32 province_count = 20'000;
+    constexpr u32 country_count = 200;
+    constexpr u32 army_count = 200'000;
+    constexpr u32 tick_count = 100;
+
+    constexpr Fixed growth = Fixed::from_ratio(1, 1000);
+    constexpr Fixed tax = Fixed::from_ratio(1, 100);
+    constexpr Fixed upkeep = Fixed::from_ratio(1, 1'000'000);
+
+    // Returns the tick hashes, which must not depend on how the systems were scheduled.
+    const auto run = [&](ThreadPool* const thread_pool) {
+        Simulation sim;
+        World world;
+        world.init(sim);
+        sim.thread_pool = thread_pool;
+        sim.init(1);
+
+        world.add_provinces(province_count);
+        std::vector<CountryId> country_ids;
+        for (u32 i = 0; i < country_count; ++i) {
+            country_ids.push_back(world.countries.add());
+        }
+        for (u32 i = 0; i < province_count; ++i) {
+            world.provinces.write<ProvinceState::owner>(i) = country_ids[i % country_count];
+            world.provinces.write<ProvinceState::population>(i) = Fixed::from_int(1000 + i % 5000);
+        }
+        for (u32 i = 0; i < army_count; ++i) {
+            const u32 row = world.armies.get_row(world.armies.add());
+            world.armies.write<ArmyState::location>(row) = i % province_count;
+            world.armies.write<ArmyState::strength>(row) = Fixed::from_int(1000 + i % 9000);
+            world.armies.write<ArmyState::morale>(row) = Fixed::from_ratio(i % 100, 100);
+        }
+
+        EntityTable<Province, CountryId, Fixed>& provinces = world.provinces;
+        EntityTable<Country, Fixed, ProvinceId>& countries = world.countries;
+        EntityTable<Army, ProvinceId, Fixed, Fixed>& armies = world.armies;
+        const std::string province_owner = provinces.get_column_name<ProvinceState::owner>();
+        const std::string province_population = provinces.get_column_name<ProvinceState::population>();
+        const std::string country_treasury = countries.get_column_name<CountryState::treasury>();
+        const std::string country_capital = countries.get_column_name<CountryState::capital>();
+        const std::string army_location = armies.get_column_name<ArmyState::location>();
+        const std::string army_strength = armies.get_column_name<ArmyState::strength>();
+        const std::string army_morale = armies.get_column_name<ArmyState::morale>();
+
+        sim.add_system("population", {{}, {province_population}}, [&](Simulation&) {
+            provinces.parallel_for(pool, [&](const u32 begin, const u32 end) {
+                Fixed* const population = provinces.write_range<ProvinceState::population>(begin, end);
+                for (u32 row = begin; row < end; ++row) {
+                    population[row] += population[row] * growth;
+                }
+            });
+        });
+
+        sim.add_system("economy", {{province_owner, province_population}, {country_treasury}}, [&](Simulation&) {
+            for (u32 row = 0; row < provinces.size(); ++row) {
+                const u32 country = countries.get_row(provinces.get<ProvinceState::owner>(row));
+                countries.write<CountryState::treasury>(country) += provinces.get<ProvinceState::population>(row) * tax;
+            }
+        });
+
+        sim.add_system("attrition", {{}, {army_strength, army_morale}}, [&](Simulation&) {
+            armies.parallel_for(pool, [&](const u32 begin, const u32 end) {
+                Fixed* const strength = armies.write_range<ArmyState::strength>(begin, end);
+                Fixed* const morale = armies.write_range<ArmyState::morale>(begin, end);
+                for (u32 row = begin; row < end; ++row) {
+                    update_army(strength[row], morale[row]);
+                }
+            });
+        });
+
+        sim.add_system("movement", {{army_morale}, {army_location, sim_rng}}, [&](Simulation& simulation) {
+            for (u32 row = 0; row < armies.size(); ++row) {
+                if (armies.get<ArmyState::morale>(row) == max_morale && simulation.rng.uniform(8) == 0) {
+                    armies.write<ArmyState::location>(row) = simulation.rng.uniform(province_count);
+                }
+            }
+        });
+
+        const SystemAccess ai_access = {{country_treasury, province_owner}, {country_capital, sim_rng}};
+        sim.add_system("ai", ai_access, [&](Simulation& simulation) {
+            for (u32 row = 0; row < countries.size(); ++row) {
+                const ProvinceId capital = simulation.rng.uniform(province_count);
+                if (provinces.get<ProvinceState::owner>(capital) == countries.get_id(row) &&
+                    countries.get<CountryState::treasury>(row) > Fixed::from_int(10'000)) {
+                    countries.write<CountryState::capital>(row) = capital;
+                }
+            }
+        });
+
+        sim.add_system("reinforcement", {{army_location, province_owner, country_treasury}, {army_strength}},
+                       [&](Simulation&) {
+                           armies.parallel_for(pool, [&](const u32 begin, const u32 end) {
+                               Fixed* const strength = armies.write_range<ArmyState::strength>(begin, end);
+                               for (u32 row = begin; row < end; ++row) {
+                                   const ProvinceId location = armies.get<ArmyState::location>(row);
+                                   const u32 owner = countries.get_row(provinces.get<ProvinceState::owner>(location));
+                                   strength[row] += countries.get<CountryState::treasury>(owner) * upkeep;
+                               }
+                           });
+                       });
+
+        for (u32 tick = 0; tick < tick_count; ++tick) {
+            sim.step();
+        }
+
+        LOG_F(INFO, "{} ticks with {}:", tick_count, thread_pool ? "the pool" : "systems in sequence");
+        sim.log_timings(sim.tick);
+        std::vector<u64> hashes(tick_count);
+        for (u32 tick = 0; tick < tick_count; ++tick) {
+            CHECK_F(sim.get_tick_hash(tick + 1, hashes[tick]));
+        }
+        return hashes;
+    };
+
+    const std::vector<u64> serial_hashes = run(nullptr);
+    const std::vector<u64> parallel_hashes = run(&pool);
+    for (u32 tick = 0; tick < tick_count; ++tick) {
+        CHECK_F(serial_hashes[tick] == parallel_hashes[tick], "Tick {} differs between schedules", tick + 1);
+    }
+    LOG_F(INFO, "Every tick hashed the same with {} threads as in sequence", pool.size());
+}
@@ -0,0 +1,490 @@
+#pragma once
+
+#include "fixed.hpp"
+#include "province.hpp"
+#include "save.hpp"
+#include "simulation.hpp"
+#include "slot_map.hpp"
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
+#include <array>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Rows are grouped into chunks for parallel iteration and for caching hashes. `EntityTable::parallel_for` hands out
+// whole chunks, so no two tasks write to the same word of a change bitset or the same cache line of a column.
+inline constexpr u32 entity_chunk_rows = 1024;
+static_assert(entity_chunk_rows % 64 == 0);
+
+// A bit per row of a column, set when the row is written, and a flag per chunk with any of its bits set.
+struct ChangeBits {
+    std::vector<u64> words;
+    std::vector<u8> chunks;
+
+    // Keeps the bits of rows that remain.
+    void resize(u32 rows);
+    void clear();
+
+    void set(const u32 row) {
+        words[row / 64] |= u64(1) << (row % 64);
+        chunks[row / entity_chunk_rows] = 1;
+    }
+
+    void set_range(u32 begin, u32 end);
+
+    bool test(const u32 row) const {
+        return (words[row / 64] >> (row % 64)) & 1;
+    }
+
+    bool any() const;
+
+    // Calls `f(row)` for each set bit, in order. Chunks without changes are skipped without reading their words.
+    template <class F>
+    void for_each(F&& f) const {
+        constexpr size_t chunk_words = entity_chunk_rows / 64;
+        for (size_t chunk = 0; chunk < chunks.size(); ++chunk) {
+            if (!chunks[chunk]) {
+                continue;
+            }
+            const size_t end = std::min(words.size(), (chunk + 1) * chunk_words);
+            for (size_t word = chunk * chunk_words; word < end; ++word) {
+                u64 bits = words[word];
+                while (bits != 0) {
+                    f(static_cast<u32>(word * 64 + static_cast<size_t>(__builtin_ctzll(bits))));
+                    bits &= bits - 1;
+                }
+            }
+        }
+    }
+};
+
+template <class T>
+struct EntityColumn {
+    // Hashed and saved as raw bytes
+    static_assert(std::is_trivially_copyable_v<T> && std::has_unique_object_representations_v<T>);
+
+    AlignedVector<T> values;
+    // Rows written during the current tick
+    ChangeBits changes;
+    // Rows written during the last complete tick, for systems and views that follow the column
+    ChangeBits last_changes;
+    // Hash of each chunk, and whether it changed since it was hashed
+    std::vector<u64> chunk_hashes;
+    std::vector<u8> stale_chunks;
+};
+
+template <class T, class A>
+bool load_vector(SaveFile& file, const std::string& name, std::vector<T, A>& values) {
+    const SaveBlockView view = file.get(name.c_str());
+    if (view.data == nullptr || view.element_size != sizeof(T)) {
+        return false;
+    }
+    const T* const data = view.as<T>();
+    values.assign(data, data + view.count());
+    return true;
+}
+
+// Struct-of-arrays table of game entities, with a typed column per field. Entities are referred to by `Id`s that stay
+// valid as other entities come and go, through slots as in `SlotMap`. Rows are dense: removing an entity moves the last
+// row into its place.
+//
+// Writes go through `write` or `write_range`, which record the rows written in each column's change bits. After each
+// tick, the bits move to `last_changes`, where views can find what changed, and the state hash only rehashes chunks
+// that changed.
+template <class Tag, class... Ts>
+struct EntityTable {
+    using Id = Handle<Tag>;
+
+    template <auto C>
+    using ColumnType = std::tuple_element_t<static_cast<size_t>(C), std::tuple<Ts...>>;
+
+    static constexpr u32 column_count = sizeof...(Ts);
+    static constexpr u32 no_slot = ~0u;
+
+    struct Slot {
+        // Row if occupied, or the next free slot otherwise
+        u32 index;
+        u32 generation;
+    };
+
+    // Prefix of the table's save blocks, and the names of its columns
+    std::string name;
+    std::array<const char*, column_count> column_names = {};
+
+    std::tuple<EntityColumn<Ts>...> columns;
+    std::vector<u32> row_slots;
+    std::vector<Slot> slots;
+    u32 free_head = no_slot;
+
+    // Entities were added or removed during the current tick or the last complete one. Rows may have moved, so views
+    // that keep anything per row must rebuild.
+    bool structure_changed = false;
+    bool last_structure_changed = false;
+    // Hash of the slots, which only change with the structure
+    u64 slots_hash = 0;
+    bool slots_stale = true;
+
+    void init(std::string name, const std::array<const char*, column_count>& column_names) {
+        this->name = std::move(name);
+        this->column_names = column_names;
+    }
+
+    // Adds a state block for the table, so that it is hashed, saved and loaded with the rest of the simulation. A new
+    // game empties the table, unless `reset` is given to set it up instead.
+    void register_state(Simulation& sim, std::function<void()> reset = {}) {
+        if (!reset) {
+            reset = [this] { clear(); };
+        }
+        sim.add_state_block(
+                name, [this](StateHasher& hasher) { hash(hasher); },
+                [this](SaveWriter& writer) { save(writer); }, [this](SaveFile& file) { return load(file); },
+                [this] { return end_tick(); }, std::move(reset));
+    }
+
+    // Removes every entity. IDs from before are invalid afterwards, even if their slots are reused.
+    void clear() {
+        for_each_column([&](auto& column, u32) {
+            column.values.clear();
+            column.changes.resize(0);
+            column.last_changes.resize(0);
+            column.chunk_hashes.clear();
+            column.stale_chunks.clear();
+        });
+        row_slots.clear();
+        slots.clear();
+        free_head = no_slot;
+        structure_changed = true;
+        last_structure_changed = true;
+        slots_stale = true;
+    }
+
+    u32 size() const {
+        return static_cast<u32>(row_slots.size());
+    }
+
+    // Name of column `C` in a `SystemAccess`. Systems that add or remove entities write the table's own name instead.
+    template <auto C>
+    std::string get_column_name() const {
+        return name + "." + column_names[static_cast<size_t>(C)];
+    }
+
+    // The new entity's fields are zero.
+    Id add() {
+        u32 slot_index;
+        if (free_head != no_slot) {
+            slot_index = free_head;
+            free_head = slots[slot_index].index;
+        } else {
+            slot_index = static_cast<u32>(slots.size());
+            slots.push_back({0, 1});
+        }
+
+        const u32 row = size();
+        Slot& slot = slots[slot_index];
+        slot.index = row;
+        row_slots.push_back(slot_index);
+        for_each_column([&](auto& column, u32) {
+            column.values.emplace_back();
+            column.changes.resize(row + 1);
+            column.changes.set(row);
+        });
+        mark_structure_changed();
+        return {slot_index, slot.generation};
+    }
+
+    void remove(const Id id) {
+        CHECK_F(contains(id), "Removing an invalid entity from {}", name);
+        Slot& slot = slots[id.index];
+        const u32 row = slot.index;
+        const u32 last = size() - 1;
+
+        for_each_column([&](auto& column, u32) {
+            if (row != last) {
+                column.values[row] = column.values[last];
+                column.changes.set(row);
+            }
+            // Marks the chunk that loses a row as changed, before the row's bit is dropped.
+            column.changes.set(last);
+            column.values.pop_back();
+            column.changes.resize(last);
+        });
+        if (row != last) {
+            row_slots[row] = row_slots[last];
+            slots[row_slots[row]].index = row;
+        }
+        row_slots.pop_back();
+
+        // Generation 0 is kept for null IDs.
+        slot.generation = slot.generation == ~0u ? 1 : slot.generation + 1;
+        slot.index = free_head;
+        free_head = id.index;
+        mark_structure_changed();
+    }
+
+    bool contains(const Id id) const {
+        return id.index < slots.size() && id.generation != 0 && slots[id.index].generation == id.generation;
+    }
+
+    u32 get_row(const Id id) const {
+        CHECK_F(contains(id), "Invalid entity in {}", name);
+        return slots[id.index].index;
+    }
+
+    Id get_id(const u32 row) const {
+        const u32 slot_index = row_slots.at(row);
+        return {slot_index, slots[slot_index].generation};
+    }
+
+    template <auto C>
+    const AlignedVector<ColumnType<C>>& get() const {
+        return std::get<static_cast<size_t>(C)>(columns).values;
+    }
+
+    template <auto C>
+    const ColumnType<C>& get(const u32 row) const {
+        return get<C>()[row];
+    }
+
+    template <auto C>
+    ColumnType<C>& write(const u32 row) {
+        auto& column = std::get<static_cast<size_t>(C)>(columns);
+        column.changes.set(row);
+        return column.values[row];
+    }
+
+    // Marks rows `[begin, end)` as written, a word at a time, and returns the start of the column, to be indexed by
+    // row. For loops over many rows.
+    template <auto C>
+    ColumnType<C>* write_range(const u32 begin, const u32 end) {
+        auto& column = std::get<static_cast<size_t>(C)>(columns);
+        column.changes.set_range(begin, end);
+        return column.values.data();
+    }
+
+    // Rows of column `C` written during the last complete tick
+    template <auto C>
+    const ChangeBits& get_changes() const {
+        return std::get<static_cast<size_t>(C)>(columns).last_changes;
+    }
+
+    // Runs `fn(begin, end)` over every row on the thread pool, in ranges of whole chunks. Tasks may write to any
+    // column within their range, but must not add or remove entities.
+    void parallel_for(ThreadPool& pool, const std::function<void(u32, u32)>& fn) {
+        pool.parallel_for(size(), entity_chunk_rows,
+                          [&](const size_t begin, const size_t end) {
+                              fn(static_cast<u32>(begin), static_cast<u32>(end));
+                          });
+    }
+
+    // Called by the simulation after the systems of each tick. Moves the tick's changes to `last_changes` and returns
+    // true if anything changed.
+    bool end_tick() {
+        bool changed = structure_changed;
+        last_structure_changed = structure_changed;
+        structure_changed = false;
+
+        for_each_column([&](auto& column, u32) {
+            std::swap(column.changes, column.last_changes);
+            column.changes.resize(size());
+            column.changes.clear();
+
+            const ChangeBits& last = column.last_changes;
+            column.stale_chunks.resize(last.chunks.size(), 1);
+            for (size_t chunk = 0; chunk < last.chunks.size(); ++chunk) {
+                column.stale_chunks[chunk] |= last.chunks[chunk];
+            }
+            changed = changed || last.any();
+        });
+        return changed;
+    }
+
+    void hash(StateHasher& hasher) {
+        if (slots_stale) {
+            StateHasher slots_hasher;
+            slots_hasher.update(slots);
+            slots_hasher.update(row_slots);
+            slots_hasher.update(free_head);
+            slots_hash = slots_hasher.finish();
+            slots_stale = false;
+        }
+        hasher.update(slots_hash);
+
+        const u32 rows = size();
+        const u32 chunk_count = (rows + entity_chunk_rows - 1) / entity_chunk_rows;
+        for_each_column([&](auto& column, u32) {
+            using T = typename std::decay_t<decltype(column.values)>::value_type;
+            column.chunk_hashes.resize(chunk_count);
+            column.stale_chunks.resize(chunk_count, 1);
+            for (u32 chunk = 0; chunk < chunk_count; ++chunk) {
+                if (!column.stale_chunks[chunk]) {
+                    continue;
+                }
+                const u32 begin = chunk * entity_chunk_rows;
+                const u32 end = std::min(rows, begin + entity_chunk_rows);
+                StateHasher chunk_hasher(chunk);
+                chunk_hasher.update(column.values.data() + begin, (end - begin) * sizeof(T));
+                column.chunk_hashes[chunk] = chunk_hasher.finish();
+                column.stale_chunks[chunk] = 0;
+            }
+            hasher.update(column.chunk_hashes);
+        });
+    }
+
+    void save(SaveWriter& writer) const {
+        writer.add_vector(name + ".slots", slots, SaveCodec::none);
+        writer.add_vector(name + ".rows", row_slots, SaveCodec::none);
+        writer.add_value(name + ".free", free_head);
+        for_each_column([&](const auto& column, const u32 i) {
+            writer.add_vector(name + "." + column_names[i], column.values, SaveCodec::none);
+        });
+    }
+
+    // Leaves the table as it was if anything is missing or inconsistent.
+    bool load(SaveFile& file) {
+        std::vector<Slot> new_slots;
+        std::vector<u32> new_row_slots;
+        u32 new_free_head;
+        if (!load_vector(file, name + ".slots", new_slots) || !load_vector(file, name + ".rows", new_row_slots) ||
+            !file.get_value((name + ".free").c_str(), new_free_head)) {
+            return false;
+        }
+        // Every slot must be either one row's, or on the free list exactly once, or `add` would go out of bounds.
+        std::vector<u8> slot_used(new_slots.size());
+        for (u32 row = 0; row < new_row_slots.size(); ++row) {
+            if (new_row_slots[row] >= new_slots.size() || new_slots[new_row_slots[row]].index != row) {
+                return false;
+            }
+            slot_used[new_row_slots[row]] = 1;
+        }
+        size_t free_count = 0;
+        for (u32 slot = new_free_head; slot != no_slot; slot = new_slots[slot].index) {
+            if (slot >= new_slots.size() || slot_used[slot]) {
+                return false;
+            }
+            slot_used[slot] = 1;
+            ++free_count;
+        }
+        if (free_count != new_slots.size() - new_row_slots.size()) {
+            return false;
+        }
+
+        std::tuple<AlignedVector<Ts>...> values;
+        bool ok = true;
+        std::apply(
+                [&](auto&... column_values) {
+                    u32 i = 0;
+                    ((ok = ok && load_vector(file, name + "." + column_names[i++], column_values) &&
+                           column_values.size() == new_row_slots.size()),
+                     ...);
+                },
+                values);
+        if (!ok) {
+            return false;
+        }
+
+        slots = std::move(new_slots);
+        row_slots = std::move(new_row_slots);
+        free_head = new_free_head;
+        take_values(values, std::index_sequence_for<Ts...>());
+        // Everything is new to views, and has to be hashed again.
+        for_each_column([&](auto& column, u32) {
+            column.changes.resize(size());
+            column.changes.clear();
+            column.last_changes.resize(size());
+            column.last_changes.set_range(0, size());
+            column.chunk_hashes.clear();
+            column.stale_chunks.clear();
+        });
+        structure_changed = false;
+        last_structure_changed = true;
+        slots_stale = true;
+        return true;
+    }
+
+private:
+    void mark_structure_changed() {
+        structure_changed = true;
+        slots_stale = true;
+    }
+
+    template <size_t... Is>
+    void take_values(std::tuple<AlignedVector<Ts>...>& values, std::index_sequence<Is...>) {
+        ((std::get<Is>(columns).values = std::move(std::get<Is>(values))), ...);
+    }
+
+    // Calls `f(column, index)` for each column.
+    template <class F>
+    void for_each_column(F&& f) {
+        for_each_column(f, std::index_sequence_for<Ts...>());
+    }
+
+    template <class F>
+    void for_each_column(F&& f) const {
+        for_each_column(f, std::index_sequence_for<Ts...>());
+    }
+
+    template <class F, size_t... Is>
+    void for_each_column(F& f, std::index_sequence<Is...>) {
+        (f(std::get<Is>(columns), static_cast<u32>(Is)), ...);
+    }
+
+    template <class F, size_t... Is>
+    void for_each_column(F& f, std::index_sequence<Is...>) const {
+        (f(std::get<Is>(columns), static_cast<u32>(Is)), ...);
+    }
+};
+
+// Tags for entity IDs
+struct Province;
+struct Country;
+struct Army;
+
+using CountryId = Handle<Country>;
+using ArmyId = Handle<Army>;
+
+// Columns of each table, in the order of its types
+enum class ProvinceState : u32 {
+    owner,
+    population,
+};
+
+enum class CountryState : u32 {
+    treasury,
+    capital,
+};
+
+enum class ArmyState : u32 {
+    location,
+    strength,
+    morale,
+};
+
+// Game state of every entity, in tables that the simulation hashes, saves and loads.
+struct World {
+    // One row per province, in `ProvinceId` order. Provinces are never removed, so a province's row is its ID.
+    EntityTable<Province, CountryId, Fixed> provinces;
+    EntityTable<Country, Fixed, ProvinceId> countries;
+    EntityTable<Army, ProvinceId, Fixed, Fixed> armies;
+
+    // Rows added to `provinces` when a game starts
+    u32 province_count = 0;
+
+    // Sets up the tables and registers their state with `sim`. Called again after a hot reload, since the state blocks
+    // and column names come from this library.
+    void init(Simulation& sim);
+    // Adds the provinces once they have loaded, replacing whatever the table held, and keeps them across new games.
+    void add_provinces(u32 count);
+};
+
+// Compares a per-tick update of 100k armies stored as an array of structs with the same update on an `EntityTable`,
+// on one thread and on the pool.
+void bench_world(ThreadPool& pool);
+
+// Runs a set of systems over a generated world, in sequence and scheduled on the pool, checks that every tick hashes
+// the same, and logs the timings and critical paths of both runs.
+void bench_scheduler(ThreadPool& pool);